@@ -28,6 +28,15 @@
 #endif // 1
 #endif // ARDUINO
 
+#if ! defined(ARDUINO)
+#include <errno.h>
+#endif
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+#include <fcntl.h>    // O_RDWR
+#include <sys/mman.h> // mmap() memfd_create()
+#include <sys/stat.h> // fstat()
+#endif
+
 #if defined(DEBUG) && (DEBUG == 1)
 #include "hexdump.h"
 #endif
@@ -38,6 +47,38 @@
 #define hex_dump_to_fp(a,b,c)
 #endif
 
+// the memory order of the indices shared between threads
+#if defined(__GNUC__) && ! defined(__AVR__)
+#define RBUF_LOAD_RELAXED(v)     __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#define RBUF_LOAD_ACQUIRE(v)     __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define RBUF_STORE_RELEASE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#define RBUF_STORE_RELAXED(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELAXED)
+#define RBUF_FENCE_ACQUIRE()     __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define RBUF_FENCE_RELEASE()     __atomic_thread_fence(__ATOMIC_RELEASE)
+// update v to x if it's still *pexp, or load v to *pexp
+#define RBUF_CAS_RELAXED(v, pexp, x) __atomic_compare_exchange_n(&(v), (pexp), (x), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#elif defined(__AVR__)
+// single core MCU: the volatile access and a compiler barrier are enough
+#define RBUF_BARRIER()           __asm__ __volatile__ ("" ::: "memory")
+#define RBUF_LOAD_RELAXED(v)     (*(volatile __typeof__(v) *)&(v))
+#define RBUF_LOAD_ACQUIRE(v)     ({ __typeof__(v) _rbuf_v = RBUF_LOAD_RELAXED(v); RBUF_BARRIER(); _rbuf_v; })
+#define RBUF_STORE_RELEASE(v, x) do { RBUF_BARRIER(); RBUF_LOAD_RELAXED(v) = (x); } while (0)
+#define RBUF_STORE_RELAXED(v, x) do { RBUF_LOAD_RELAXED(v) = (x); } while (0)
+#define RBUF_FENCE_ACQUIRE()     RBUF_BARRIER()
+#define RBUF_FENCE_RELEASE()     RBUF_BARRIER()
+#else
+#error "no atomics for this compiler"
+#endif
+
+// update the statistics, nothing is generated if RBUF_WITH_STATS is 0
+#if RBUF_WITH_STATS
+#define RBUF_STATS_ADD(pst, field, n) ((pst)->field += (n))
+#define RBUF_STATS_HIGH_WATER(pst, sz) do { if ((pst)->high_water < (size_t)(sz)) { (pst)->high_water = (sz); } } while (0)
+#else
+#define RBUF_STATS_ADD(pst, field, n) ((void)0)
+#define RBUF_STATS_HIGH_WATER(pst, sz) ((void)0)
+#endif
+
 
 /**
  * init a ring buffer structure
@@ -82,10 +123,12 @@ rbuf_write(void *prb, uint8_t * buf, size_t sz)
     sz_wr = rbuf_spare(prb);
     if (sz_wr < 1) {
         TE("out of space!");
+        RBUF_STATS_ADD(&(p)->stats, cnt_full, 1);
         return -1;
     }
     if (sz > sz_wr) {
         TD("adjust sz=%d to smaller spare size=%d.", sz, sz_wr);
+        RBUF_STATS_ADD(&(p)->stats, cnt_truncated, 1);
         sz = sz_wr;
     }
     assert ((p)->pos_write != (p)->pos_read);
@@ -94,9 +137,9 @@ rbuf_write(void *prb, uint8_t * buf, size_t sz)
     assert (sz <= (p)->sz_buf);
     assert ((p)->sz_buf > (p)->pos_write);
 
-    // the first part
+    // the first part, the mirrored buffer has only one part
     sz_wr = ((p)->sz_buf) - (p)->pos_write;
-    if (sz_wr > sz) {
+    if (sz_wr > sz || rbuf_is_mirrored(p)) {
         sz_wr = sz;
     }
     TD("copy first part pos=%d, buf='%s', size=%d.", (p)->pos_write, buf, sz_wr);
@@ -111,6 +154,8 @@ rbuf_write(void *prb, uint8_t * buf, size_t sz)
         memmove ((p)->buf1 + (p)->pos_write, buf + (sz - sz_wr), sz_wr);
         (p)->pos_write = ((p)->pos_write + sz_wr) % ((p)->sz_buf);
     }
+    RBUF_STATS_ADD(&(p)->stats, total_in, sz);
+    RBUF_STATS_HIGH_WATER(&(p)->stats, rbuf_size(prb));
 
     return sz;
 }
@@ -142,6 +187,7 @@ rbuf_peek_cb(void *prb, size_t offset, size_t sz, void * userdata, rbuf_callback
     sz_rd = rbuf_size(prb);
     if (sz_rd < 1) {
         TE("no data available!");
+        RBUF_STATS_ADD(&(p)->stats, cnt_empty, 1);
         return -1;
     }
     if (offset >= sz_rd) {
@@ -160,9 +206,9 @@ rbuf_peek_cb(void *prb, size_t offset, size_t sz, void * userdata, rbuf_callback
     assert (((p)->sz_buf) > (p)->pos_read);
     assert (((p)->sz_buf) > virt_pos_read);
 
-    // the first part
+    // the first part, the mirrored buffer has only one part
     sz_rd = ((p)->sz_buf) - 1 - virt_pos_read;
-    if (sz_rd > sz) {
+    if (sz_rd > sz || rbuf_is_mirrored(p)) {
         sz_rd = sz;
     }
 
@@ -175,6 +221,7 @@ rbuf_peek_cb(void *prb, size_t offset, size_t sz, void * userdata, rbuf_callback
         return -1;
     }
     if (ret != sz_rd) {
+        RBUF_STATS_ADD(&(p)->stats, cnt_short_cb, 1);
         return 0;
     }
 
@@ -191,6 +238,7 @@ rbuf_peek_cb(void *prb, size_t offset, size_t sz, void * userdata, rbuf_callback
             return -1;
         }
         if (ret != sz_rd) {
+            RBUF_STATS_ADD(&(p)->stats, cnt_short_cb, 1);
             return 0;
         }
     }
@@ -289,903 +337,6097 @@ rbuf_forward(void *prb, size_t sz)
     }
     if (sz > 0) {
         (p)->pos_read = ((p)->pos_read + sz) % ((p)->sz_buf);
+        RBUF_STATS_ADD(&(p)->stats, total_out, sz);
     }
     return sz;
 }
 
 /**
- * \brief write data to ring buffer
+ * \brief get the spare space of ring buffer for writing in place
  * \param prb the ring buffer structure
- * \param buf the buffer to be writen
- * \param num_items the number of items in the buffer
- * \return the number of items written to the ring buffer; -1 on error
- * This function is used with MACRO version of ring buffer
+ * \param want the size of data to be written
+ * \param seg1 the first segment of the spare space
+ * \param len1 the byte size of the first segment
+ * \param seg2 the second segment of the spare space, the start of the buffer
+ * \param len2 the byte size of the second segment, 0 if the space does not wrap
+ * \return the size of the reserved space (len1 + len2), it's smaller than want if no enough space; -1 on error
+ *
+ * The data is not visible to the reader until rbuf_commit() is called.
  */
 ssize_t
-macro_rbuf_write(void *prb, void * buf, size_t num_items)
+rbuf_reserve(void *prb, size_t want, uint8_t ** seg1, size_t * len1, uint8_t ** seg2, size_t * len2)
 {
+    ring_buffer_t *p = (ring_buffer_t *)prb;
     size_t sz_wr = 0;
 
     assert (NULL != prb);
-    if (num_items < 1 || NULL == buf) {
+    if (want < 1 || NULL == seg1 || NULL == len1 || NULL == seg2 || NULL == len2) {
         TE("input size parameter error!");
         return -1;
     }
-    sz_wr = RBUF_SPARE(prb);
+    sz_wr = rbuf_spare(prb);
     if (sz_wr < 1) {
         TE("out of space!");
+        RBUF_STATS_ADD(&(p)->stats, cnt_full, 1);
         return -1;
     }
-    if (num_items > sz_wr) {
-        TD("adjust sz=%d to smaller spare size=%d.", num_items, sz_wr);
-        num_items = sz_wr;
+    if (want > sz_wr) {
+        TD("adjust sz=%d to smaller spare size=%d.", (int)want, (int)sz_wr);
+        RBUF_STATS_ADD(&(p)->stats, cnt_truncated, 1);
+        want = sz_wr;
     }
-    assert (num_items <= sz_wr);
-    assert (num_items > 0);
-    assert (num_items <= RBUF_MAX_ITEMS(prb));
-    assert (RBUF_MAX_ITEMS(prb) > RBUF_POS_WR(prb));
+    assert ((p)->sz_buf > (p)->pos_write);
 
-    // the first part
-    sz_wr = RBUF_MAX_ITEMS(prb) - RBUF_POS_WR(prb);
-    if (sz_wr > num_items) {
-        sz_wr = num_items;
+    // the first part, the mirrored buffer has only one part
+    sz_wr = ((p)->sz_buf) - (p)->pos_write;
+    if (sz_wr > want || rbuf_is_mirrored(p)) {
+        sz_wr = want;
     }
-    TD("copy first part pos=%d, size=%d.", RBUF_POS_WR(prb), sz_wr);
-    memmove (RBUF_ITEM_ADDR(prb, RBUF_POS_WR(prb)), buf, RBUF_ITEM_SIZE(prb) * sz_wr);
-    RBUF_POS_WR(prb) = (RBUF_POS_WR(prb) + sz_wr) % RBUF_MAX_ITEMS(prb);
-
+    *seg1 = (p)->buf1 + (p)->pos_write;
+    *len1 = sz_wr;
     // second part
-    if (sz_wr < num_items) {
-        assert (0 == RBUF_POS_WR(prb));
-        sz_wr = num_items - sz_wr;
-        TD("copy second part pos=%d, size=%d.", RBUF_POS_WR(prb), sz_wr);
-        memmove (RBUF_ITEM_ADDR(prb, RBUF_POS_WR(prb))
-            , (char *)buf + RBUF_ITEM_SIZE(prb) * (num_items - sz_wr)
-            , RBUF_ITEM_SIZE(prb) * sz_wr);
-        RBUF_POS_WR(prb) = (RBUF_POS_WR(prb) + sz_wr) % RBUF_MAX_ITEMS(prb);
-    }
+    *seg2 = (p)->buf1;
+    *len2 = want - sz_wr;
+    return want;
+}
 
-    return num_items;
+/**
+ * \brief advance the write position over the data filled in the reserved space
+ * \param prb the ring buffer structure
+ * \param sz the byte size of data written to the segments returned by rbuf_reserve()
+ * \return the size of data committed; -1 on error
+ */
+ssize_t
+rbuf_commit(void *prb, size_t sz)
+{
+    ring_buffer_t *p = (ring_buffer_t *)prb;
+    size_t pos;
+
+    assert (NULL != prb);
+    if (sz > rbuf_spare(prb)) {
+        TE("commit more than the spare size: sz=%d, spare=%d.", (int)sz, (int)rbuf_spare(prb));
+        return -1;
+    }
+    pos = (p)->pos_write + sz;
+    if (pos >= (p)->sz_buf) {
+        pos -= (p)->sz_buf;
+    }
+    (p)->pos_write = pos;
+    RBUF_STATS_ADD(&(p)->stats, total_in, sz);
+    RBUF_STATS_HIGH_WATER(&(p)->stats, rbuf_size(prb));
+    return sz;
 }
 
 /**
- * \brief peek data from ring buffer and save to buf without advancing the inter read pointer
+ * \brief get the data in ring buffer as segments without copying and advancing the inter read pointer
  * \param prb the ring buffer structure
  * \param offset the offset of the reading data from the current read position
- * \param buf the buffer to be filled by data from ring buffer
- * \param num_items the number of items in the buffer
- * \return the number of items read to the buffer; -1 on error
- * This function is used with MACRO version of ring buffer
+ * \param sz the max size of data
+ * \param iov the segments of the data, the second one is used only if the data wraps
+ * \return the number of segments filled in iov, 0 if no data at the offset; -1 on error
+ *
+ * The segments can be passed to writev() directly, they are valid until the data is consumed.
  */
-ssize_t
-macro_rbuf_peek(void *prb, size_t offset, void * buf, size_t num_items)
+int
+rbuf_peek_iov(void *prb, size_t offset, size_t sz, struct iovec iov[2])
 {
+    ring_buffer_t *p = (ring_buffer_t *)prb;
     size_t sz_rd = 0;
-    size_t sz_cur = 0;
     size_t virt_pos_read;
 
     assert (NULL != prb);
-    if (num_items < 1 || NULL == buf) {
-       TE("input size parameter error!");
-        return -1;
-    }
-    sz_rd = RBUF_SIZE(prb);
-    if (sz_rd < 1) {
-        TE("no data available!");
+    if (sz < 1 || NULL == iov) {
+        TE("input size parameter error!");
         return -1;
     }
+    sz_rd = rbuf_size(prb);
     if (offset >= sz_rd) {
-        TE("offset out of range: offset=%d, size=%d.", offset, sz_rd);
-        return -1;
+        return 0;
     }
-    if (num_items + offset > sz_rd) {
-        TD("adjust sz=%d to smaller data size=%d.", num_items, sz_rd);
-        num_items = sz_rd - offset;
+    if (sz + offset > sz_rd) {
+        sz = sz_rd - offset;
     }
-    virt_pos_read = (RBUF_POS_RD(prb) + offset) % RBUF_MAX_ITEMS(prb);
-
-    assert (num_items + offset <= sz_rd);
-    assert (num_items > 0);
-    assert (num_items + offset <= RBUF_MAX_ITEMS(prb));
-    assert (RBUF_MAX_ITEMS(prb) > RBUF_POS_RD(prb));
-    assert (RBUF_MAX_ITEMS(prb) > virt_pos_read);
-
-    // the first part
-    sz_rd = RBUF_MAX_ITEMS(prb) - 1 - virt_pos_read;
-    if (sz_rd > num_items) {
-        sz_rd = num_items;
+    // the data starts from the next position of pos_read
+    virt_pos_read = (p)->pos_read + offset + 1;
+    if (virt_pos_read >= (p)->sz_buf) {
+        virt_pos_read -= (p)->sz_buf;
     }
 
-    TD("copy first part pos=%d, size=%d.", ((virt_pos_read + 1) % RBUF_MAX_ITEMS(prb)), sz_rd);
-    sz_cur = 0;
-    memmove (buf
-        , RBUF_ITEM_ADDR(prb, ((virt_pos_read + 1) % RBUF_MAX_ITEMS(prb)))
-        , RBUF_ITEM_SIZE(prb) * sz_rd);
-    sz_cur += sz_rd;
+    // the first part, the mirrored buffer has only one part
+    sz_rd = ((p)->sz_buf) - virt_pos_read;
+    if (sz_rd > sz || rbuf_is_mirrored(p)) {
+        sz_rd = sz;
+    }
+    iov[0].iov_base = (p)->buf1 + virt_pos_read;
+    iov[0].iov_len = sz_rd;
+    if (sz_rd >= sz) {
+        return 1;
+    }
     // second part
-    if (sz_cur < num_items) {
-        assert (0 == ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)));
-        sz_rd = num_items - sz_cur;
-        TD("copy second part pos=%d, size=%d.", ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)), sz_rd);
-        memmove ((char *)buf + RBUF_ITEM_SIZE(prb) * sz_cur
-            , RBUF_ITEM_ADDR(prb, ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)))
-            , RBUF_ITEM_SIZE(prb) * sz_rd);
+    iov[1].iov_base = (p)->buf1;
+    iov[1].iov_len = sz - sz_rd;
+    return 2;
+}
+
+/**
+ * \brief discard the data processed in place
+ * \param prb the ring buffer structure
+ * \param sz the byte size of data to be discarded, it should not be larger than rbuf_size()
+ * \return the byte size of data discarded; -1 on error
+ */
+ssize_t
+rbuf_consume(void *prb, size_t sz)
+{
+    ring_buffer_t *p = (ring_buffer_t *)prb;
+    size_t pos;
+
+    assert (NULL != prb);
+    if (sz > rbuf_size(prb)) {
+        TE("consume more than the data size: sz=%d, size=%d.", (int)sz, (int)rbuf_size(prb));
+        return -1;
     }
-    return num_items;
+    pos = (p)->pos_read + sz;
+    if (pos >= (p)->sz_buf) {
+        pos -= (p)->sz_buf;
+    }
+    (p)->pos_read = pos;
+    RBUF_STATS_ADD(&(p)->stats, total_out, sz);
+    return sz;
 }
 
 /**
- * \brief read data from ring buffer and save to buf
+ * \brief get a snapshot of the statistics of ring buffer
  * \param prb the ring buffer structure
- * \param buf the buffer to be filled by data from ring buffer
- * \param num_items the number of items in the buffer
- * \return the number of items read to the buffer; -1 on error
- * This function is used with MACRO version of ring buffer
+ * \param pst the statistics to be filled
+ * \return 0 on success; -1 if the statistics are not compiled in (RBUF_WITH_STATS is 0)
+ */
+int
+rbuf_stats(void *prb, ring_stats_t * pst)
+{
+    assert (NULL != prb);
+    assert (NULL != pst);
+#if RBUF_WITH_STATS
+    memcpy(pst, &((ring_buffer_t *)prb)->stats, sizeof(*pst));
+    return 0;
+#else
+    memset(pst, 0, sizeof(*pst));
+    return -1;
+#endif
+}
+
+/**
+ * \brief find a byte in ring buffer without copying
+ * \param prb the ring buffer structure
+ * \param offset the offset from the current read position to start the search
+ * \param val the byte to be found
+ * \return the offset of the byte from the current read position; -1 if not found
  */
 ssize_t
-macro_rbuf_read(void *prb, void * buf, size_t num_items)
+rbuf_find_byte(void *prb, size_t offset, uint8_t val)
 {
-    ssize_t ret;
-    ret = macro_rbuf_peek(prb, 0, buf, num_items);
-    if (ret > 0) {
-        macro_rbuf_forward(prb, ret);
+    struct iovec iov[2];
+    uint8_t * pos;
+    int cnt;
+    int i;
+
+    if (offset >= rbuf_size(prb)) {
+        return -1;
     }
-    return ret;
+    cnt = rbuf_peek_iov(prb, offset, rbuf_size(prb), iov);
+    for (i = 0; i < cnt; i ++) {
+        pos = (uint8_t *)memchr(iov[i].iov_base, val, iov[i].iov_len);
+        if (NULL != pos) {
+            return offset + (pos - (uint8_t *)iov[i].iov_base);
+        }
+        offset += iov[i].iov_len;
+    }
+    return -1;
 }
 
 /**
- * \brief discard data and forword in ring buffer
+ * \brief find any of the bytes in a set in ring buffer without copying
  * \param prb the ring buffer structure
- * \param num_items the number of items to be discarded in the buffer
- * \return he number of items to be discarded in the buffer; -1 on error
+ * \param offset the offset from the current read position to start the search
+ * \param set the bytes to be found
+ * \param num the number of bytes in the set
+ * \return the offset of the first byte in the set from the current read position; -1 if not found
  */
 ssize_t
-macro_rbuf_forward(void *prb, size_t num_items)
+rbuf_find_any(void *prb, size_t offset, const uint8_t * set, size_t num)
 {
-    if (RBUF_SIZE(prb) < 1) {
-        return 0;
+    struct iovec iov[2];
+    uint8_t table[256 / 8];
+    uint8_t * pos;
+    size_t j;
+    int cnt;
+    int i;
+
+    if (num < 2) {
+        return (num < 1) ? -1 : rbuf_find_byte(prb, offset, set[0]);
     }
-    if (num_items > RBUF_SIZE(prb)) {
-        num_items = RBUF_SIZE(prb);
+    memset(table, 0, sizeof(table));
+    for (j = 0; j < num; j ++) {
+        table[set[j] >> 3] |= (1 << (set[j] & 0x07));
     }
-    if (num_items > 0) {
-        RBUF_POS_RD(prb) = (RBUF_POS_RD(prb) + num_items) % RBUF_MAX_ITEMS(prb);
+    if (offset >= rbuf_size(prb)) {
+        return -1;
     }
-    return num_items;
+    cnt = rbuf_peek_iov(prb, offset, rbuf_size(prb), iov);
+    for (i = 0; i < cnt; i ++) {
+        pos = (uint8_t *)iov[i].iov_base;
+        for (j = 0; j < iov[i].iov_len; j ++) {
+            if (table[pos[j] >> 3] & (1 << (pos[j] & 0x07))) {
+                return offset + j;
+            }
+        }
+        offset += iov[i].iov_len;
+    }
+    return -1;
 }
 
+/// find a pattern in one segment, it's memmem() which is not available on all platforms
+static uint8_t *
+rbuf_find_seq_seg(uint8_t * buf, size_t sz, const uint8_t * pat, size_t len)
+{
+    uint8_t * end = buf + sz;
+    uint8_t * pos;
 
-#if defined(CIUT_ENABLED) && (CIUT_ENABLED == 1)
-#include <ciut.h>
+    while ((size_t)(end - buf) >= len) {
+        pos = (uint8_t *)memchr(buf, pat[0], end - buf - len + 1);
+        if (NULL == pos) {
+            return NULL;
+        }
+        if (0 == memcmp(pos + 1, pat + 1, len - 1)) {
+            return pos;
+        }
+        buf = pos + 1;
+    }
+    return NULL;
+}
 
-//#include "gpib-hwconf.h" // MAX_BUFFER_SEGMENT
+/**
+ * \brief find a byte sequence in ring buffer without copying, the sequence can cross the end of the buffer
+ * \param prb the ring buffer structure
+ * \param offset the offset from the current read position to start the search
+ * \param pat the byte sequence to be found
+ * \param len the byte size of the sequence
+ * \return the offset of the start of the sequence from the current read position; -1 if not found
+ */
+ssize_t
+rbuf_find_seq(void *prb, size_t offset, const uint8_t * pat, size_t len)
+{
+    struct iovec iov[2];
+    uint8_t * buf;
+    uint8_t * pos;
+    size_t sz_tail;
+    int cnt;
 
-#ifndef MAX_BUFFER_SEGMENT
-#define MAX_BUFFER_SEGMENT 250
-#endif
+    if (len < 1) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    if (offset >= rbuf_size(prb)) {
+        return -1;
+    }
+    cnt = rbuf_peek_iov(prb, offset, rbuf_size(prb), iov);
+    if (cnt < 1) {
+        return -1;
+    }
+    buf = (uint8_t *)iov[0].iov_base;
+    pos = rbuf_find_seq_seg(buf, iov[0].iov_len, pat, len);
+    if (NULL != pos) {
+        return offset + (pos - buf);
+    }
+    if (cnt < 2) {
+        return -1;
+    }
+    // the sequences start in the last (len - 1) bytes of the first segment and end in the second one
+    sz_tail = UG_MIN(len - 1, iov[0].iov_len);
+    for (pos = buf + iov[0].iov_len - sz_tail; pos < buf + iov[0].iov_len; pos ++) {
+        size_t sz1 = buf + iov[0].iov_len - pos;
+        if (len - sz1 > iov[1].iov_len) {
+            continue;
+        }
+        if (0 == memcmp(pos, pat, sz1) && 0 == memcmp(iov[1].iov_base, pat + sz1, len - sz1)) {
+            return offset + (pos - buf);
+        }
+    }
+    offset += iov[0].iov_len;
+    buf = (uint8_t *)iov[1].iov_base;
+    pos = rbuf_find_seq_seg(buf, iov[1].iov_len, pat, len);
+    if (NULL != pos) {
+        return offset + (pos - buf);
+    }
+    return -1;
+}
 
-static void
-rbuf_fill_test_buffer(uint8_t *buf, uint8_t start_value, size_t size)
+/**
+ * \brief allocate a ring buffer in heap
+ * \param data_size the capacity of the ring buffer
+ * \return the ring buffer structure; NULL on error
+ *
+ * The ring buffer can be resized by rbuf_resize(), and should be released by rbuf_destroy().
+ */
+ring_buffer_t *
+rbuf_create(size_t data_size)
 {
-    size_t i;
-    for (i = 0; i < size; i ++) {
-        buf[i] = start_value;
-        start_value ++;
+    ring_buffer_t *p;
+
+    if (data_size < 1) {
+        TE("input size parameter error!");
+        return NULL;
     }
+    p = (ring_buffer_t *)malloc(rbuf_occupied_bytes(data_size));
+    if (NULL == p) {
+        TE("out of memory!");
+        return NULL;
+    }
+    rbuf_init(p, rbuf_occupied_bytes(data_size));
+    return p;
 }
 
-#define MAX_SIZE (12*6)
+/**
+ * \brief release the ring buffer from rbuf_create() or rbuf_resize()
+ * \param prb the ring buffer structure
+ */
+void
+rbuf_destroy(ring_buffer_t * prb)
+{
+    free(prb);
+}
 
-TEST_CASE( .name="ring-buffer", .description="test ring buffer.", .skip=0 ) {
-    ring_buffer_t *prb = NULL;
-    uint8_t boundary[sizeof(ring_buffer_t)*2 + (MAX_SIZE + sizeof(size_t)*3 + 1) ];
+/**
+ * \brief change the capacity of the ring buffer, the data is kept in order
+ * \param prb the ring buffer structure from rbuf_create() or rbuf_resize()
+ * \param data_size the new capacity, it should not be smaller than the data size
+ * \return the new ring buffer structure, the old one is released; NULL on error and the old one is kept
+ *
+ * The data is moved to the start of the new buffer by at most two copies.
+ */
+ring_buffer_t *
+rbuf_resize(ring_buffer_t * prb, size_t data_size)
+{
+    struct iovec iov[2];
+    ring_buffer_t *p;
+    size_t sz;
+    int cnt;
+    int i;
 
-    uint8_t buffer[MAX_BUFFER_SEGMENT];
-    uint8_t buffer2[MAX_BUFFER_SEGMENT];
-    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
-    size_t sz_buf = sizeof(buffer);
-    ssize_t sz_rd = -1;
-    uint8_t cur_val = 0; // current start write value
-    uint8_t cur_rd = 0; // current read value
+    assert (NULL != prb);
+    assert (! rbuf_is_mirrored(prb));
+    sz = rbuf_size(prb);
+    if (data_size < 1 || data_size < sz) {
+        TE("the new size %d is smaller than the data size %d!", (int)data_size, (int)sz);
+        return NULL;
+    }
+    if (data_size == rbuf_max(prb)) {
+        return prb;
+    }
+    p = (ring_buffer_t *)malloc(rbuf_occupied_bytes(data_size));
+    if (NULL == p) {
+        TE("out of memory!");
+        return NULL;
+    }
+    // keep the other fields, such as the statistics
+    memcpy(p, prb, sizeof(ring_buffer_t));
+    (p)->sz_buf = data_size + 1;
+    (p)->buf1 = (unsigned char *)(p + 1);
+    (p)->pos_read = 0;
+    (p)->pos_write = 1;
+    cnt = rbuf_peek_iov(prb, 0, sz, iov);
+    for (i = 0; i < cnt; i ++) {
+        memcpy((p)->buf1 + (p)->pos_write, iov[i].iov_base, iov[i].iov_len);
+        (p)->pos_write += iov[i].iov_len;
+    }
+    (p)->pos_write %= (p)->sz_buf;
+    free(prb);
+    return p;
+}
 
-    REQUIRE ((sizeof(boundary) - sizeof(ring_buffer_t)*2) / 6 * 6 <= (sizeof(boundary) - sizeof(ring_buffer_t)*2));
-#define TEST_RBUF_SIZE rbuf_occupied_bytes(((MAX_SIZE + sizeof(size_t)*3 + 1) - sizeof(ring_buffer_t)) / 6 * 6)
+/**
+ * \brief write data to ring buffer, grow the buffer if no enough space
+ * \param pprb the ring buffer structure from rbuf_create(), it's updated if the buffer is resized
+ * \param buf the buffer to be writen
+ * \param sz the size of buffer
+ * \param max_size the max capacity of the ring buffer
+ * \return the size of data written to the ring buffer, it's smaller than sz if the max capacity is reached; -1 on error
+ *
+ * The capacity is doubled until the data fits or it reaches max_size.
+ */
+ssize_t
+rbuf_write_grow(ring_buffer_t ** pprb, uint8_t * buf, size_t sz, size_t max_size)
+{
+    ring_buffer_t *p;
+    size_t sz_new;
 
-#define MASK_BOUNDARY 'A'
-    prb = (ring_buffer_t *) boundary;
-    prb ++;
-    assert (boundary < (uint8_t *)prb && (uint8_t *)prb <= (boundary + sizeof(ring_buffer_t)));
-    assert ((uint8_t *)(prb+1) < (boundary + sizeof(boundary) - 1));
+    assert (NULL != pprb);
+    if (rbuf_spare(*pprb) < sz && rbuf_max(*pprb) < max_size) {
+        for (sz_new = rbuf_max(*pprb); sz_new < max_size && sz_new - rbuf_size(*pprb) < sz; sz_new *= 2);
+        p = rbuf_resize(*pprb, UG_MIN(sz_new, max_size));
+        if (NULL != p) {
+            *pprb = p;
+        }
+    }
+    return rbuf_write(*pprb, buf, sz);
+}
 
-#define CHECK_BOUNDARY(b, end) \
-    { \
+/**
+ * \brief shrink the ring buffer if most of the space is not used, it's called when the reader is idle
+ * \param pprb the ring buffer structure from rbuf_create(), it's updated if the buffer is resized
+ * \param min_size the min capacity of the ring buffer
+ * \return 1 if the buffer is shrunk; 0 if not; -1 on error
+ *
+ * The capacity is halved while the data uses no more than a quarter of it,
+ * so a buffer grown by rbuf_write_grow() is not shrunk and grown again for the same load.
+ */
+int
+rbuf_shrink_idle(ring_buffer_t ** pprb, size_t min_size)
+{
+    ring_buffer_t *p;
+    size_t sz_new;
+
+    assert (NULL != pprb);
+    sz_new = rbuf_max(*pprb);
+    while (sz_new / 2 >= min_size && sz_new / 2 > 0 && rbuf_size(*pprb) <= sz_new / 4) {
+        sz_new /= 2;
+    }
+    if (sz_new == rbuf_max(*pprb)) {
+        return 0;
+    }
+    p = rbuf_resize(*pprb, sz_new);
+    if (NULL == p) {
+        return -1;
+    }
+    *pprb = p;
+    return 1;
+}
+
+/**
+ * \brief calculate the byte size of a pool, including the header and all of the blocks
+ * \param data_sizes the capacity of the ring buffers of each class
+ * \param counts the number of ring buffers of each class
+ * \param num_classes the number of classes
+ * \return the byte size of the pool
+ */
+size_t
+rbuf_pool_occupied_bytes(const size_t * data_sizes, const size_t * counts, size_t num_classes)
+{
+    size_t sz = sizeof(ring_pool_t);
+    size_t i;
+
+    for (i = 0; i < num_classes; i ++) {
+        sz += RBUF_POOL_BLOCK_SIZE(data_sizes[i]) * counts[i];
+    }
+    return sz;
+}
+
+/**
+ * init a pool of ring buffers
+ * \param pool the pointer to the start of a memory buffer for the pool, aligned to the pointer size
+ * \param byte_size the byte size of the whole buffer, see rbuf_pool_occupied_bytes()
+ * \param data_sizes the capacity of the ring buffers of each class, in increasing order
+ * \param counts the number of ring buffers of each class
+ * \param num_classes the number of classes
+ * \return 0 on success; -1 on error
+ */
+int
+rbuf_pool_init(void *pool, size_t byte_size, const size_t * data_sizes, const size_t * counts, size_t num_classes)
+{
+    ring_pool_t *p = (ring_pool_t *)pool;
+    ring_pool_class_t *pc;
+    unsigned char * blk;
+    size_t sz_block;
+    size_t i;
+    size_t j;
+
+    assert (NULL != pool);
+    if (num_classes < 1 || num_classes > RBUF_POOL_MAX_CLASSES) {
+        TE("the number of classes out of range: %d.", (int)num_classes);
+        return -1;
+    }
+    for (i = 0; i < num_classes; i ++) {
+        if (data_sizes[i] < 1 || (i > 0 && data_sizes[i] <= data_sizes[i - 1])) {
+            TE("the sizes of classes should be in increasing order!");
+            return -1;
+        }
+    }
+    if (byte_size < rbuf_pool_occupied_bytes(data_sizes, counts, num_classes)) {
+        TE("no enough spare memory for the pool!");
+        return -1;
+    }
+    memset(pool, 0, sizeof(ring_pool_t));
+    (p)->num_classes = num_classes;
+    blk = (unsigned char *)(p + 1);
+    for (i = 0; i < num_classes; i ++) {
+        pc = &((p)->classes[i]);
+        pc->usage.data_size = data_sizes[i];
+        pc->usage.num_blocks = counts[i];
+        pc->start = blk;
+        // link the blocks in the order of the address
+        sz_block = RBUF_POOL_BLOCK_SIZE(data_sizes[i]);
+        for (j = counts[i]; j > 0; j --) {
+            *(void **)(blk + sz_block * (j - 1)) = pc->free_list;
+            pc->free_list = blk + sz_block * (j - 1);
+        }
+        blk += sz_block * counts[i];
+    }
+    return 0;
+}
+
+/**
+ * \brief get an empty ring buffer from the pool
+ * \param pool the pool structure
+ * \param data_size the min capacity
+ * \return the ring buffer of the smallest class which fits the size and has a free block; NULL if none
+ *
+ * The capacity of the ring buffer is the size of its class, see rbuf_max().
+ */
+ring_buffer_t *
+rbuf_pool_get(void *pool, size_t data_size)
+{
+    ring_pool_t *p = (ring_pool_t *)pool;
+    ring_pool_class_t *pc;
+    void * blk;
+    size_t i;
+    int flg_fit = 1;
+
+    assert (NULL != pool);
+    for (i = 0; i < (p)->num_classes; i ++) {
+        pc = &((p)->classes[i]);
+        if (pc->usage.data_size < data_size) {
+            continue;
+        }
+        if (NULL == pc->free_list) {
+            if (flg_fit) {
+                pc->usage.cnt_fail ++;
+                flg_fit = 0;
+            }
+            continue;
+        }
+        blk = pc->free_list;
+        pc->free_list = *(void **)blk;
+        pc->usage.num_used ++;
+        if (pc->usage.high_water < pc->usage.num_used) {
+            pc->usage.high_water = pc->usage.num_used;
+        }
+        rbuf_init(blk, rbuf_occupied_bytes(pc->usage.data_size));
+        return (ring_buffer_t *)blk;
+    }
+    TE("no free ring buffer for size=%d!", (int)data_size);
+    return NULL;
+}
+
+/**
+ * \brief return a ring buffer to the pool
+ * \param pool the pool structure
+ * \param prb the ring buffer from rbuf_pool_get() of the same pool
+ */
+void
+rbuf_pool_put(void *pool, ring_buffer_t * prb)
+{
+    ring_pool_t *p = (ring_pool_t *)pool;
+    ring_pool_class_t *pc;
+    size_t i;
+
+    assert (NULL != pool);
+    if (NULL == prb) {
+        return;
+    }
+    // the class is found by the address, there are only a few classes
+    for (i = 0; i < (p)->num_classes; i ++) {
+        pc = &((p)->classes[i]);
+        if ((unsigned char *)prb >= pc->start
+            && (unsigned char *)prb < pc->start + RBUF_POOL_BLOCK_SIZE(pc->usage.data_size) * pc->usage.num_blocks) {
+            assert (0 == ((unsigned char *)prb - pc->start) % RBUF_POOL_BLOCK_SIZE(pc->usage.data_size));
+            assert (pc->usage.num_used > 0);
+            *(void **)prb = pc->free_list;
+            pc->free_list = prb;
+            pc->usage.num_used --;
+            return;
+        }
+    }
+    TE("the ring buffer is not from the pool!");
+    assert (0);
+}
+
+/**
+ * \brief get the usage of a size class
+ * \param pool the pool structure
+ * \param cls the index of the class
+ * \param pu the usage to be filled
+ * \return 0 on success; -1 if the index is out of range
+ */
+int
+rbuf_pool_usage(void *pool, size_t cls, ring_pool_usage_t * pu)
+{
+    ring_pool_t *p = (ring_pool_t *)pool;
+
+    assert (NULL != pool);
+    assert (NULL != pu);
+    if (cls >= (p)->num_classes) {
+        return -1;
+    }
+    memcpy(pu, &((p)->classes[cls].usage), sizeof(*pu));
+    return 0;
+}
+
+/**
+ * \brief copy data to the spare space returned by rbuf_reserve() and skip it
+ * \param seg the two segments of the spare space
+ * \param sz_seg the byte size of the segments
+ * \param src the data
+ * \param sz the size of data, it should not be larger than the total size of the segments
+ */
+static void
+rbuf_fill_segments(uint8_t * seg[2], size_t sz_seg[2], uint8_t * src, size_t sz)
+{
+    size_t n = UG_MIN(sz_seg[0], sz);
+    memcpy (seg[0], src, n);
+    seg[0] += n;
+    sz_seg[0] -= n;
+    assert (sz - n <= sz_seg[1]);
+    memcpy (seg[1], src + n, sz - n);
+    seg[1] += sz - n;
+    sz_seg[1] -= sz - n;
+}
+
+/**
+ * \brief write a message to ring buffer, the message is written completely or not at all
+ * \param prb the ring buffer structure
+ * \param buf the payload of the message
+ * \param sz the size of the payload
+ * \return the size of the payload written; -1 on error or if no enough space for the whole message
+ *
+ * The length header and the payload become visible to the reader at the same time.
+ */
+ssize_t
+rbuf_write_msg(void *prb, uint8_t * buf, size_t sz)
+{
+    rbuf_msg_len_t len = sz;
+    uint8_t *seg[2];
+    size_t sz_seg[2];
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == buf || len != sz) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    if (rbuf_spare(prb) < rbuf_msg_occupied_bytes(sz)) {
+        TE("out of space!");
+        return -1;
+    }
+    rbuf_reserve(prb, rbuf_msg_occupied_bytes(sz), &seg[0], &sz_seg[0], &seg[1], &sz_seg[1]);
+    rbuf_fill_segments(seg, sz_seg, (uint8_t *)&len, sizeof(len));
+    rbuf_fill_segments(seg, sz_seg, buf, sz);
+    rbuf_commit(prb, rbuf_msg_occupied_bytes(sz));
+    return sz;
+}
+
+/**
+ * \brief get the payload size of the first message in ring buffer
+ * \param prb the ring buffer structure
+ * \return the size of the payload; -1 if no message available
+ */
+ssize_t
+rbuf_msg_size(void *prb)
+{
+    rbuf_msg_len_t len;
+
+    assert (NULL != prb);
+    if (rbuf_size(prb) < sizeof(len)) {
+        return -1;
+    }
+    rbuf_peek(prb, 0, (uint8_t *)&len, sizeof(len));
+    assert (rbuf_msg_occupied_bytes(len) <= rbuf_size(prb));
+    return len;
+}
+
+/**
+ * \brief get the payload of the first message as segments without copying
+ * \param prb the ring buffer structure
+ * \param iov the segments of the payload, the second one is used only if the payload wraps
+ * \return the number of segments filled in iov, 0 if no message available
+ *
+ * The segments are valid until the message is removed by rbuf_forward_msg().
+ */
+int
+rbuf_peek_msg(void *prb, struct iovec iov[2])
+{
+    ssize_t len;
+
+    len = rbuf_msg_size(prb);
+    if (len < 1) {
+        return 0;
+    }
+    return rbuf_peek_iov(prb, sizeof(rbuf_msg_len_t), len, iov);
+}
+
+/**
+ * \brief read the first message from ring buffer
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by the payload
+ * \param sz the size of buffer
+ * \return the size of the payload; 0 if no message available;
+ *   -1 if the buffer is smaller than the payload, the message is kept in the ring buffer
+ */
+ssize_t
+rbuf_read_msg(void *prb, uint8_t * buf, size_t sz)
+{
+    ssize_t len;
+
+    len = rbuf_msg_size(prb);
+    if (len < 1) {
+        return 0;
+    }
+    if (NULL == buf || (size_t)len > sz) {
+        TE("no enough buffer for the message: sz=%d, len=%d.", (int)sz, (int)len);
+        return -1;
+    }
+    rbuf_peek(prb, sizeof(rbuf_msg_len_t), buf, len);
+    rbuf_consume(prb, rbuf_msg_occupied_bytes(len));
+    return len;
+}
+
+/**
+ * \brief discard the first message in ring buffer
+ * \param prb the ring buffer structure
+ * \return the size of the payload discarded; 0 if no message available
+ */
+ssize_t
+rbuf_forward_msg(void *prb)
+{
+    ssize_t len;
+
+    len = rbuf_msg_size(prb);
+    if (len < 1) {
+        return 0;
+    }
+    rbuf_consume(prb, rbuf_msg_occupied_bytes(len));
+    return len;
+}
+
+/**
+ * \brief write several buffers to ring buffer as one, all of them are written or none
+ * \param prb the ring buffer structure
+ * \param iov the buffers to be written in order
+ * \param iovcnt the number of buffers
+ * \return the total size of data written; -1 on error or if no enough space for all of the buffers
+ *
+ * The space is checked once and the write position is updated once,
+ * so the reader sees either all of the buffers or nothing.
+ */
+ssize_t
+rbuf_writev(void *prb, const struct iovec * iov, int iovcnt)
+{
+    uint8_t *seg[2];
+    size_t sz_seg[2];
+    size_t sz = 0;
+    int i;
+
+    assert (NULL != prb);
+    if (iovcnt < 1 || NULL == iov) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i ++) {
+        sz += iov[i].iov_len;
+    }
+    if (sz < 1) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    if (rbuf_spare(prb) < sz) {
+        TE("out of space!");
+        RBUF_STATS_ADD(&((ring_buffer_t *)prb)->stats, cnt_full, 1);
+        return -1;
+    }
+    rbuf_reserve(prb, sz, &seg[0], &sz_seg[0], &seg[1], &sz_seg[1]);
+    for (i = 0; i < iovcnt; i ++) {
+        if (iov[i].iov_len > 0) {
+            rbuf_fill_segments(seg, sz_seg, (uint8_t *)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    rbuf_commit(prb, sz);
+    return sz;
+}
+
+/**
+ * \brief copy data from the segments returned by rbuf_peek_iov() and skip it
+ * \param seg the two segments of the data
+ * \param sz_seg the byte size of the segments
+ * \param dst the target buffer
+ * \param sz the size of target buffer, it should not be larger than the total size of the segments
+ */
+static void
+rbuf_drain_segments(uint8_t * seg[2], size_t sz_seg[2], uint8_t * dst, size_t sz)
+{
+    size_t n = UG_MIN(sz_seg[0], sz);
+    memcpy (dst, seg[0], n);
+    seg[0] += n;
+    sz_seg[0] -= n;
+    if (n < sz) {
+        assert (sz - n <= sz_seg[1]);
+        memcpy (dst + n, seg[1], sz - n);
+        seg[1] += sz - n;
+        sz_seg[1] -= sz - n;
+    }
+}
+
+/**
+ * \brief read data from ring buffer to several buffers, all of them are filled or none
+ * \param prb the ring buffer structure
+ * \param iov the buffers to be filled in order
+ * \param iovcnt the number of buffers
+ * \return the total size of data read; -1 on error or if no enough data for all of the buffers,
+ *   the data is kept in the ring buffer
+ *
+ * The read position is updated once after all of the buffers are filled.
+ */
+ssize_t
+rbuf_readv(void *prb, const struct iovec * iov, int iovcnt)
+{
+    struct iovec iov_rb[2];
+    uint8_t *seg[2];
+    size_t sz_seg[2];
+    size_t sz = 0;
+    int cnt;
+    int i;
+
+    assert (NULL != prb);
+    if (iovcnt < 1 || NULL == iov) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i ++) {
+        sz += iov[i].iov_len;
+    }
+    if (sz < 1) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    if (rbuf_size(prb) < sz) {
+        TE("no enough data: size=%d, want=%d.", (int)rbuf_size(prb), (int)sz);
+        RBUF_STATS_ADD(&((ring_buffer_t *)prb)->stats, cnt_empty, 1);
+        return -1;
+    }
+    cnt = rbuf_peek_iov(prb, 0, sz, iov_rb);
+    seg[0] = (uint8_t *)iov_rb[0].iov_base;
+    sz_seg[0] = iov_rb[0].iov_len;
+    seg[1] = (cnt > 1) ? (uint8_t *)iov_rb[1].iov_base : NULL;
+    sz_seg[1] = (cnt > 1) ? iov_rb[1].iov_len : 0;
+    for (i = 0; i < iovcnt; i ++) {
+        if (iov[i].iov_len > 0) {
+            rbuf_drain_segments(seg, sz_seg, (uint8_t *)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    rbuf_consume(prb, sz);
+    return sz;
+}
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+/**
+ * \brief read data from a file descriptor to ring buffer directly
+ * \param prb the ring buffer structure
+ * \param fd the file descriptor, it's usually nonblocking
+ * \param sz the max size of data to be read
+ * \return the size of data read to the ring buffer; 0 on end of file;
+ *   -1 on error with errno set: EAGAIN if no data ready in a nonblocking fd, ENOBUFS if the ring buffer is full
+ */
+ssize_t
+rbuf_fill_from_fd(void *prb, int fd, size_t sz)
+{
+    struct iovec iov[2];
+    ssize_t ret;
+
+    assert (NULL != prb);
+    if (rbuf_spare(prb) < 1) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ret = rbuf_reserve(prb, sz, (uint8_t **)&(iov[0].iov_base), &(iov[0].iov_len), (uint8_t **)&(iov[1].iov_base), &(iov[1].iov_len));
+    if (ret < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    do {
+        ret = readv(fd, iov, (iov[1].iov_len > 0)?2:1);
+    } while (ret < 0 && EINTR == errno);
+    if (ret > 0) {
+        // readv() may fill only a part of the segments
+        rbuf_commit(prb, ret);
+    }
+    return ret;
+}
+
+/**
+ * \brief write data from ring buffer to a file descriptor directly
+ * \param prb the ring buffer structure
+ * \param fd the file descriptor, it's usually nonblocking
+ * \param sz the max size of data to be written
+ * \return the size of data written to the fd and removed from the ring buffer; 0 if the ring buffer is empty;
+ *   -1 on error with errno set: EAGAIN if a nonblocking fd can't accept more data
+ */
+ssize_t
+rbuf_drain_to_fd(void *prb, int fd, size_t sz)
+{
+    struct iovec iov[2];
+    ssize_t ret;
+    int cnt;
+
+    assert (NULL != prb);
+    if (sz < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    cnt = rbuf_peek_iov(prb, 0, sz, iov);
+    if (cnt < 1) {
+        return 0;
+    }
+    do {
+        ret = writev(fd, iov, cnt);
+    } while (ret < 0 && EINTR == errno);
+    if (ret > 0) {
+        // writev() may take only a part of the segments
+        rbuf_consume(prb, ret);
+    }
+    return ret;
+}
+
+/**
+ * \brief create a ring buffer whose data area is mapped twice back-to-back in virtual memory
+ * \param data_size the min capacity of the ring buffer, it's rounded up to page size
+ * \return the ring buffer structure; NULL on error with errno set
+ *
+ * Any data or spare space starting in the first mapping continues into the second one,
+ * so rbuf_write(), rbuf_peek_cb(), rbuf_reserve() and rbuf_peek_iov() return or use
+ * only one segment. The buffer should be released by rbuf_destroy_mirrored().
+ */
+ring_buffer_t *
+rbuf_create_mirrored(size_t data_size)
+{
+    ring_buffer_t *p;
+    size_t sz_page;
+    size_t sz_buf;
+    uint8_t * base;
+    int fd;
+
+    sz_page = sysconf(_SC_PAGESIZE);
+    // one more byte for the barrier between rd/wr
+    sz_buf = (data_size + 1 + sz_page - 1) / sz_page * sz_page;
+
+    p = (ring_buffer_t *)malloc(sizeof(ring_buffer_t));
+    if (NULL == p) {
+        TE("out of memory!");
+        return NULL;
+    }
+#if defined(MFD_CLOEXEC)
+    fd = memfd_create("ringbuffer", MFD_CLOEXEC);
+#else
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "/ringbuffer-%d-%p", (int)getpid(), (void *)p);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+        }
+    }
+#endif
+    if (fd < 0) {
+        TE("unable to create the shared memory object!");
+        free(p);
+        return NULL;
+    }
+    if (ftruncate(fd, sz_buf) < 0) {
+        TE("unable to set the size of the shared memory object!");
+        goto err_fd;
+    }
+    // reserve the address space of the two mappings first, then replace them by the object
+    base = (uint8_t *)mmap(NULL, sz_buf * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == base) {
+        TE("unable to reserve the address space!");
+        goto err_fd;
+    }
+    if (MAP_FAILED == mmap(base, sz_buf, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)
+        || MAP_FAILED == mmap(base + sz_buf, sz_buf, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)) {
+        TE("unable to map the shared memory object!");
+        munmap(base, sz_buf * 2);
+        goto err_fd;
+    }
+    close(fd);
+
+    memset(p, 0, sizeof(ring_buffer_t));
+    (p)->pos_write = 1;
+    (p)->sz_buf = sz_buf;
+    (p)->buf1 = base;
+    return p;
+
+err_fd:
+    {
+        int err = errno;
+        close(fd);
+        free(p);
+        errno = err;
+    }
+    return NULL;
+}
+
+/**
+ * \brief release the ring buffer created by rbuf_create_mirrored()
+ * \param prb the ring buffer structure
+ */
+void
+rbuf_destroy_mirrored(ring_buffer_t * prb)
+{
+    if (NULL == prb) {
+        return;
+    }
+    assert (rbuf_is_mirrored(prb));
+    munmap((prb)->buf1, (prb)->sz_buf * 2);
+    free(prb);
+}
+
+/// the byte size of the file of a ring buffer
+#define RBUF_FILE_MAP_SIZE(p) (sizeof(ring_file_t) + sizeof(ring_buffer_t) + (p)->capacity)
+
+/**
+ * \brief open a ring buffer stored in a file, or create it if the file is empty or does not exist
+ * \param path the path of the file
+ * \param data_size the capacity of a new ring buffer, an existing ring buffer keeps its own capacity
+ * \return the ring buffer structure; NULL on error
+ *
+ * The data and positions are in the page cache, so they survive a crash of the process;
+ * rbuf_write() copies the data before moving the write position, so a write interrupted
+ * by the crash is not seen. Call rbuf_file_sync() to keep them on power loss.
+ * Positions which are not valid on open, such as the ones half written back before
+ * a power loss, are reset and the data is discarded.
+ * The ring buffer should be released by rbuf_file_close().
+ */
+ring_buffer_t *
+rbuf_file_open(const char * path, size_t data_size)
+{
+    struct stat st;
+    ring_file_t *p;
+    ring_buffer_t *prb;
+    size_t sz_map;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        TE("unable to open the file '%s'!", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        TE("unable to get the size of the file '%s'!", path);
+        goto err_fd;
+    }
+    sz_map = st.st_size;
+    if (sz_map < 1) {
+        // a new file
+        if (data_size < 1) {
+            TE("input parameter error!");
+            goto err_fd;
+        }
+        sz_map = rbuf_file_occupied_bytes(data_size);
+        if (ftruncate(fd, sz_map) < 0) {
+            TE("unable to set the size of the file '%s'!", path);
+            goto err_fd;
+        }
+    } else if (sz_map <= sizeof(ring_file_t) + sizeof(ring_buffer_t)) {
+        TE("the file '%s' is not a ring buffer!", path);
+        goto err_fd;
+    }
+    p = (ring_file_t *)mmap(NULL, sz_map, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == p) {
+        TE("unable to map the file '%s'!", path);
+        goto err_fd;
+    }
+    close(fd);
+    prb = (ring_buffer_t *)(p + 1);
+
+    if (0 == (p)->magic) {
+        // a new file, or the creation of the ring buffer was interrupted
+        rbuf_init(prb, sz_map - sizeof(ring_file_t));
+        (p)->version = RBUF_FILE_VERSION;
+        (p)->capacity = (prb)->sz_buf;
+        (p)->magic = RBUF_FILE_MAGIC;
+        return prb;
+    }
+    if (RBUF_FILE_MAGIC != (p)->magic || RBUF_FILE_VERSION != (p)->version
+        || sz_map != RBUF_FILE_MAP_SIZE(p)) {
+        TE("the file '%s' is not a ring buffer of this version!", path);
+        munmap(p, sz_map);
+        return NULL;
+    }
+    // recover the ring buffer: the address of the data area changes each time
+    (prb)->sz_buf = (p)->capacity;
+    (prb)->buf1 = (unsigned char *)(prb + 1);
+    if ((prb)->pos_read >= (prb)->sz_buf || (prb)->pos_write >= (prb)->sz_buf) {
+        TW("the positions rd=%d wr=%d of the file '%s' are broken, discard the data!", (int)(prb)->pos_read, (int)(prb)->pos_write, path);
+        rbuf_reset(prb);
+    }
+    return prb;
+
+err_fd:
+    close(fd);
+    return NULL;
+}
+
+/**
+ * \brief write the data and positions of the ring buffer back to the file
+ * \param prb the ring buffer structure from rbuf_file_open()
+ * \param flg_async only schedule the write back, do not wait for it
+ * \return 0 on success; -1 on error
+ */
+int
+rbuf_file_sync(ring_buffer_t * prb, int flg_async)
+{
+    ring_file_t *p = (ring_file_t *)prb - 1;
+    assert (RBUF_FILE_MAGIC == (p)->magic);
+    if (msync(p, RBUF_FILE_MAP_SIZE(p), flg_async ? MS_ASYNC : MS_SYNC) < 0) {
+        TE("unable to sync the file!");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief unmap the ring buffer from rbuf_file_open(), the data is kept in the file
+ * \param prb the ring buffer structure
+ */
+void
+rbuf_file_close(ring_buffer_t * prb)
+{
+    ring_file_t *p;
+
+    if (NULL == prb) {
+        return;
+    }
+    p = (ring_file_t *)prb - 1;
+    assert (RBUF_FILE_MAGIC == (p)->magic);
+    munmap(p, RBUF_FILE_MAP_SIZE(p));
+}
+#endif // ARDUINO _WIN32
+
+/**
+ * \brief write data to ring buffer
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param num_items the number of items in the buffer
+ * \return the number of items written to the ring buffer; -1 on error
+ * This function is used with MACRO version of ring buffer
+ */
+ssize_t
+macro_rbuf_write(void *prb, void * buf, size_t num_items)
+{
+    size_t sz_wr = 0;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    sz_wr = RBUF_SPARE(prb);
+    if (sz_wr < 1) {
+        TE("out of space!");
+        RBUF_STATS_ADD(RBUF_STATS_PTR(prb), cnt_full, 1);
+        return -1;
+    }
+    if (num_items > sz_wr) {
+        TD("adjust sz=%d to smaller spare size=%d.", num_items, sz_wr);
+        RBUF_STATS_ADD(RBUF_STATS_PTR(prb), cnt_truncated, 1);
+        num_items = sz_wr;
+    }
+    assert (num_items <= sz_wr);
+    assert (num_items > 0);
+    assert (num_items <= RBUF_MAX_ITEMS(prb));
+    assert (RBUF_MAX_ITEMS(prb) > RBUF_POS_WR(prb));
+
+    // the first part
+    sz_wr = RBUF_MAX_ITEMS(prb) - RBUF_POS_WR(prb);
+    if (sz_wr > num_items) {
+        sz_wr = num_items;
+    }
+    TD("copy first part pos=%d, size=%d.", RBUF_POS_WR(prb), sz_wr);
+    memmove (RBUF_ITEM_ADDR(prb, RBUF_POS_WR(prb)), buf, RBUF_ITEM_SIZE(prb) * sz_wr);
+    RBUF_POS_WR(prb) = (RBUF_POS_WR(prb) + sz_wr) % RBUF_MAX_ITEMS(prb);
+
+    // second part
+    if (sz_wr < num_items) {
+        assert (0 == RBUF_POS_WR(prb));
+        sz_wr = num_items - sz_wr;
+        TD("copy second part pos=%d, size=%d.", RBUF_POS_WR(prb), sz_wr);
+        memmove (RBUF_ITEM_ADDR(prb, RBUF_POS_WR(prb))
+            , (char *)buf + RBUF_ITEM_SIZE(prb) * (num_items - sz_wr)
+            , RBUF_ITEM_SIZE(prb) * sz_wr);
+        RBUF_POS_WR(prb) = (RBUF_POS_WR(prb) + sz_wr) % RBUF_MAX_ITEMS(prb);
+    }
+    RBUF_STATS_ADD(RBUF_STATS_PTR(prb), total_in, num_items);
+    RBUF_STATS_HIGH_WATER(RBUF_STATS_PTR(prb), RBUF_SIZE(prb));
+
+    return num_items;
+}
+
+/**
+ * \brief peek data from ring buffer and save to buf without advancing the inter read pointer
+ * \param prb the ring buffer structure
+ * \param offset the offset of the reading data from the current read position
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \return the number of items read to the buffer; -1 on error
+ * This function is used with MACRO version of ring buffer
+ */
+ssize_t
+macro_rbuf_peek(void *prb, size_t offset, void * buf, size_t num_items)
+{
+    size_t sz_rd = 0;
+    size_t sz_cur = 0;
+    size_t virt_pos_read;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+       TE("input size parameter error!");
+        return -1;
+    }
+    sz_rd = RBUF_SIZE(prb);
+    if (sz_rd < 1) {
+        TE("no data available!");
+        RBUF_STATS_ADD(RBUF_STATS_PTR(prb), cnt_empty, 1);
+        return -1;
+    }
+    if (offset >= sz_rd) {
+        TE("offset out of range: offset=%d, size=%d.", offset, sz_rd);
+        return -1;
+    }
+    if (num_items + offset > sz_rd) {
+        TD("adjust sz=%d to smaller data size=%d.", num_items, sz_rd);
+        num_items = sz_rd - offset;
+    }
+    virt_pos_read = (RBUF_POS_RD(prb) + offset) % RBUF_MAX_ITEMS(prb);
+
+    assert (num_items + offset <= sz_rd);
+    assert (num_items > 0);
+    assert (num_items + offset <= RBUF_MAX_ITEMS(prb));
+    assert (RBUF_MAX_ITEMS(prb) > RBUF_POS_RD(prb));
+    assert (RBUF_MAX_ITEMS(prb) > virt_pos_read);
+
+    // the first part
+    sz_rd = RBUF_MAX_ITEMS(prb) - 1 - virt_pos_read;
+    if (sz_rd > num_items) {
+        sz_rd = num_items;
+    }
+
+    TD("copy first part pos=%d, size=%d.", ((virt_pos_read + 1) % RBUF_MAX_ITEMS(prb)), sz_rd);
+    sz_cur = 0;
+    memmove (buf
+        , RBUF_ITEM_ADDR(prb, ((virt_pos_read + 1) % RBUF_MAX_ITEMS(prb)))
+        , RBUF_ITEM_SIZE(prb) * sz_rd);
+    sz_cur += sz_rd;
+    // second part
+    if (sz_cur < num_items) {
+        assert (0 == ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)));
+        sz_rd = num_items - sz_cur;
+        TD("copy second part pos=%d, size=%d.", ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)), sz_rd);
+        memmove ((char *)buf + RBUF_ITEM_SIZE(prb) * sz_cur
+            , RBUF_ITEM_ADDR(prb, ((virt_pos_read + sz_cur + 1) % RBUF_MAX_ITEMS(prb)))
+            , RBUF_ITEM_SIZE(prb) * sz_rd);
+    }
+    return num_items;
+}
+
+/**
+ * \brief read data from ring buffer and save to buf
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \return the number of items read to the buffer; -1 on error
+ * This function is used with MACRO version of ring buffer
+ */
+ssize_t
+macro_rbuf_read(void *prb, void * buf, size_t num_items)
+{
+    ssize_t ret;
+    ret = macro_rbuf_peek(prb, 0, buf, num_items);
+    if (ret > 0) {
+        macro_rbuf_forward(prb, ret);
+    }
+    return ret;
+}
+
+/**
+ * \brief discard data and forword in ring buffer
+ * \param prb the ring buffer structure
+ * \param num_items the number of items to be discarded in the buffer
+ * \return he number of items to be discarded in the buffer; -1 on error
+ */
+ssize_t
+macro_rbuf_forward(void *prb, size_t num_items)
+{
+    if (RBUF_SIZE(prb) < 1) {
+        return 0;
+    }
+    if (num_items > RBUF_SIZE(prb)) {
+        num_items = RBUF_SIZE(prb);
+    }
+    if (num_items > 0) {
+        RBUF_POS_RD(prb) = (RBUF_POS_RD(prb) + num_items) % RBUF_MAX_ITEMS(prb);
+        RBUF_STATS_ADD(RBUF_STATS_PTR(prb), total_out, num_items);
+    }
+    return num_items;
+}
+
+/**
+ * \brief get a snapshot of the statistics of ring buffer
+ * \param prb the ring buffer structure
+ * \param pst the statistics to be filled
+ * \return 0 on success; -1 if the statistics are not compiled in (RBUF_WITH_STATS is 0)
+ * This function is used with MACRO version of ring buffer
+ */
+int
+macro_rbuf_stats(void *prb, ring_stats_t * pst)
+{
+    assert (NULL != prb);
+    assert (NULL != pst);
+#if RBUF_WITH_STATS
+    memcpy(pst, RBUF_STATS_PTR(prb), sizeof(*pst));
+    return 0;
+#else
+    memset(pst, 0, sizeof(*pst));
+    return -1;
+#endif
+}
+
+/// the data size between the read and write positions of a buffer with n bytes
+#define RBUF_SPSC_DIST(rd, wr, n) (((wr) > (rd)) ? ((wr) - (rd) - 1) : ((wr) + (n) - (rd) - 1))
+
+/**
+ * init a SPSC ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to RBUF_CACHELINE_SIZE
+ * \param byte_size the byte size of the whole buffer
+ * \return 0 on success; -1 on error
+ */
+int
+rbuf_spsc_init(void *prb, size_t byte_size)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    if ((byte_size) <= sizeof(ring_spsc_t)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    memset((prb), 0, sizeof(ring_spsc_t));
+    (p)->pos_write = 1;
+    (p)->cache_write = 1;
+    (p)->sz_buf = (byte_size) - sizeof(ring_spsc_t);
+    return 0;
+}
+
+/**
+ * \brief get data size in ring buffer, called by the reader
+ * \param prb the ring buffer structure
+ * \return the data size in ring buffer
+ */
+size_t
+rbuf_spsc_size(void *prb)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    size_t rd = RBUF_LOAD_RELAXED((p)->pos_read);
+    (p)->cache_write = RBUF_LOAD_ACQUIRE((p)->pos_write);
+    return RBUF_SPSC_DIST(rd, (p)->cache_write, (p)->sz_buf);
+}
+
+/**
+ * \brief get the spare size of buffer, called by the writer
+ * \param prb the ring buffer structure
+ * \return the spare size of buffer
+ */
+size_t
+rbuf_spsc_spare(void *prb)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    size_t wr = RBUF_LOAD_RELAXED((p)->pos_write);
+    (p)->cache_read = RBUF_LOAD_ACQUIRE((p)->pos_read);
+    return rbuf_spsc_max(p) - RBUF_SPSC_DIST((p)->cache_read, wr, (p)->sz_buf);
+}
+
+/**
+ * \brief write data to ring buffer, called by the writer
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param sz the size of buffer
+ * \return the size of data written to the ring buffer; -1 on error
+ */
+ssize_t
+rbuf_spsc_write(void *prb, uint8_t * buf, size_t sz)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    size_t wr;
+    size_t sz_wr;
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    wr = RBUF_LOAD_RELAXED((p)->pos_write);
+    // check the local copy of the read position first
+    sz_wr = rbuf_spsc_max(p) - RBUF_SPSC_DIST((p)->cache_read, wr, (p)->sz_buf);
+    if (sz_wr < sz) {
+        (p)->cache_read = RBUF_LOAD_ACQUIRE((p)->pos_read);
+        sz_wr = rbuf_spsc_max(p) - RBUF_SPSC_DIST((p)->cache_read, wr, (p)->sz_buf);
+    }
+    if (sz_wr < 1) {
+        TE("out of space!");
+        return -1;
+    }
+    if (sz > sz_wr) {
+        TD("adjust sz=%d to smaller spare size=%d.", (int)sz, (int)sz_wr);
+        sz = sz_wr;
+    }
+    assert ((p)->sz_buf > wr);
+
+    // the first part
+    sz_wr = ((p)->sz_buf) - wr;
+    if (sz_wr > sz) {
+        sz_wr = sz;
+    }
+    memcpy (RBUF_SPSC_DATA(p) + wr, buf, sz_wr);
+    // second part
+    if (sz_wr < sz) {
+        memcpy (RBUF_SPSC_DATA(p), buf + sz_wr, sz - sz_wr);
+    }
+    wr += sz;
+    if (wr >= (p)->sz_buf) {
+        wr -= (p)->sz_buf;
+    }
+    // publish the data to the reader
+    RBUF_STORE_RELEASE((p)->pos_write, wr);
+    return sz;
+}
+
+/**
+ * \brief peek data from ring buffer without advancing the inter read pointer, called by the reader
+ * \param prb the ring buffer structure
+ * \param offset the offset of the reading data from the current read position
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param sz the size of buffer
+ * \return the size of data read to the buffer; -1 on error
+ */
+ssize_t
+rbuf_spsc_peek(void *prb, size_t offset, uint8_t * buf, size_t sz)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    size_t rd;
+    size_t sz_rd;
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    rd = RBUF_LOAD_RELAXED((p)->pos_read);
+    sz_rd = RBUF_SPSC_DIST(rd, (p)->cache_write, (p)->sz_buf);
+    if (sz_rd < sz + offset) {
+        (p)->cache_write = RBUF_LOAD_ACQUIRE((p)->pos_write);
+        sz_rd = RBUF_SPSC_DIST(rd, (p)->cache_write, (p)->sz_buf);
+    }
+    if (sz_rd < 1) {
+        TE("no data available!");
+        return -1;
+    }
+    if (offset >= sz_rd) {
+        TE("offset out of range: offset=%d, size=%d.", (int)offset, (int)sz_rd);
+        return -1;
+    }
+    if (sz + offset > sz_rd) {
+        TD("adjust sz=%d to smaller data size=%d.", (int)sz, (int)sz_rd);
+        sz = sz_rd - offset;
+    }
+    // the data starts from the next position of pos_read
+    rd += offset + 1;
+    if (rd >= (p)->sz_buf) {
+        rd -= (p)->sz_buf;
+    }
+
+    // the first part
+    sz_rd = ((p)->sz_buf) - rd;
+    if (sz_rd > sz) {
+        sz_rd = sz;
+    }
+    memcpy (buf, RBUF_SPSC_DATA(p) + rd, sz_rd);
+    // second part
+    if (sz_rd < sz) {
+        memcpy (buf + sz_rd, RBUF_SPSC_DATA(p), sz - sz_rd);
+    }
+    return sz;
+}
+
+/**
+ * \brief discard data and forword in ring buffer, called by the reader
+ * \param prb the ring buffer structure
+ * \param sz the byte size of data to be discarded in the buffer
+ * \return the byte size of data to be discarded in the buffer; -1 on error
+ */
+ssize_t
+rbuf_spsc_forward(void *prb, size_t sz)
+{
+    ring_spsc_t *p = (ring_spsc_t *)prb;
+    size_t rd;
+    size_t sz_rd;
+
+    rd = RBUF_LOAD_RELAXED((p)->pos_read);
+    sz_rd = RBUF_SPSC_DIST(rd, (p)->cache_write, (p)->sz_buf);
+    if (sz_rd < sz) {
+        (p)->cache_write = RBUF_LOAD_ACQUIRE((p)->pos_write);
+        sz_rd = RBUF_SPSC_DIST(rd, (p)->cache_write, (p)->sz_buf);
+    }
+    if (sz > sz_rd) {
+        sz = sz_rd;
+    }
+    if (sz > 0) {
+        rd += sz;
+        if (rd >= (p)->sz_buf) {
+            rd -= (p)->sz_buf;
+        }
+        // release the space to the writer
+        RBUF_STORE_RELEASE((p)->pos_read, rd);
+    }
+    return sz;
+}
+
+/**
+ * \brief read data from ring buffer, called by the reader
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param sz the size of buffer
+ * \return the size of data read to the buffer; -1 on error
+ */
+ssize_t
+rbuf_spsc_read(void *prb, uint8_t * buf, size_t sz)
+{
+    ssize_t ret;
+    ret = rbuf_spsc_peek(prb, 0, buf, sz);
+    if (ret > 0) {
+        rbuf_spsc_forward(prb, ret);
+    }
+    return ret;
+}
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+/**
+ * \brief set the size of a shared memory object, map it and init a SPSC ring buffer in it
+ * \param fd the shared memory object from shm_open() or memfd_create(), it can be closed after the call
+ * \param data_size the capacity of the ring buffer
+ * \return the SPSC ring buffer structure; NULL on error
+ *
+ * The other process gets the same object by shm_open() with the same name, or inherits
+ * or receives the fd, then calls rbuf_shm_attach(). The ring buffer is released by rbuf_shm_detach()
+ * in each process, the name of the object should be removed by shm_unlink().
+ */
+void *
+rbuf_shm_create(int fd, size_t data_size)
+{
+    ring_shm_t *p;
+    size_t sz_map;
+
+    if (fd < 0 || data_size < 1) {
+        TE("input parameter error!");
+        return NULL;
+    }
+    sz_map = rbuf_shm_occupied_bytes(data_size);
+    if (ftruncate(fd, sz_map) < 0) {
+        TE("unable to set the size of the shared memory object!");
+        return NULL;
+    }
+    p = (ring_shm_t *)mmap(NULL, sz_map, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == p) {
+        TE("unable to map the shared memory object!");
+        return NULL;
+    }
+    rbuf_spsc_init(p + 1, sz_map - sizeof(ring_shm_t));
+    (p)->version = RBUF_SHM_VERSION;
+    (p)->sz_map = sz_map;
+    // the ring buffer is ready for the processes attaching it
+    RBUF_STORE_RELEASE((p)->magic, RBUF_SHM_MAGIC);
+    return (p + 1);
+}
+
+/**
+ * \brief map a shared memory object which has a ring buffer created by rbuf_shm_create()
+ * \param fd the shared memory object from shm_open() or memfd_create(), it can be closed after the call
+ * \return the SPSC ring buffer structure; NULL on error or if the ring buffer is not created yet
+ */
+void *
+rbuf_shm_attach(int fd)
+{
+    struct stat st;
+    ring_shm_t *p;
+    size_t sz_map;
+
+    if (fstat(fd, &st) < 0) {
+        TE("unable to get the size of the shared memory object!");
+        return NULL;
+    }
+    sz_map = st.st_size;
+    if (sz_map <= sizeof(ring_shm_t) + sizeof(ring_spsc_t)) {
+        TE("the shared memory object is not a ring buffer!");
+        return NULL;
+    }
+    p = (ring_shm_t *)mmap(NULL, sz_map, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == p) {
+        TE("unable to map the shared memory object!");
+        return NULL;
+    }
+    if (RBUF_SHM_MAGIC != RBUF_LOAD_ACQUIRE((p)->magic)
+        || RBUF_SHM_VERSION != (p)->version
+        || sz_map != (p)->sz_map
+        || sz_map != sizeof(ring_shm_t) + sizeof(ring_spsc_t) + ((ring_spsc_t *)(p + 1))->sz_buf) {
+        TE("the shared memory object is not a ring buffer of this version!");
+        munmap(p, sz_map);
+        return NULL;
+    }
+    return (p + 1);
+}
+
+/**
+ * \brief unmap the ring buffer from rbuf_shm_create() or rbuf_shm_attach()
+ * \param prb the SPSC ring buffer structure
+ */
+void
+rbuf_shm_detach(void *prb)
+{
+    ring_shm_t *p;
+
+    if (NULL == prb) {
+        return;
+    }
+    p = (ring_shm_t *)prb - 1;
+    assert (RBUF_SHM_MAGIC == (p)->magic);
+    munmap(p, (p)->sz_map);
+}
+#endif // ARDUINO _WIN32
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/**
+ * init the wait structure of a SPSC ring buffer
+ * \param pw the wait structure
+ * \param low_watermark the writer waiting for space is woken if the data size <= low_watermark
+ * \param high_watermark the reader waiting for data is woken if the data size >= high_watermark, 0 is the same as 1
+ * \param flg_eventfd use eventfd instead of futex, so the fds can be added to epoll
+ * \return 0 on success; -1 on error
+ */
+int
+rbuf_wait_init(ring_wait_t * pw, size_t low_watermark, size_t high_watermark, int flg_eventfd)
+{
+    assert (NULL != pw);
+    memset(pw, 0, sizeof(*pw));
+    (pw)->low_watermark = low_watermark;
+    (pw)->high_watermark = (high_watermark < 1)?1:high_watermark;
+    (pw)->fd_rd = -1;
+    (pw)->fd_wr = -1;
+    if (flg_eventfd) {
+        (pw)->fd_rd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        (pw)->fd_wr = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if ((pw)->fd_rd < 0 || (pw)->fd_wr < 0) {
+            TE("unable to create eventfd!");
+            rbuf_wait_destroy(pw);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief release the resources of the wait structure
+ * \param pw the wait structure
+ */
+void
+rbuf_wait_destroy(ring_wait_t * pw)
+{
+    if ((pw)->fd_rd >= 0) {
+        close((pw)->fd_rd);
+    }
+    if ((pw)->fd_wr >= 0) {
+        close((pw)->fd_wr);
+    }
+    (pw)->fd_rd = -1;
+    (pw)->fd_wr = -1;
+}
+
+/// the data size of SPSC ring buffer, it does not touch the cached indices, so both sides can call it
+static size_t
+rbuf_spsc_size_snapshot(ring_spsc_t *p)
+{
+    size_t rd = RBUF_LOAD_ACQUIRE((p)->pos_read);
+    size_t wr = RBUF_LOAD_ACQUIRE((p)->pos_write);
+    return RBUF_SPSC_DIST(rd, wr, (p)->sz_buf);
+}
+
+/// check if the reader (or the writer) can go on, it does not wait for the watermark if the other side is waiting too
+static int
+rbuf_spsc_wait_ready(ring_spsc_t *p, ring_wait_t * pw, int flg_reader)
+{
+    size_t sz = rbuf_spsc_size_snapshot(p);
+    if (flg_reader) {
+        return (sz >= UG_MIN((pw)->high_watermark, rbuf_spsc_max(p)))
+            || (sz > 0 && RBUF_LOAD_RELAXED((pw)->flg_wait_wr));
+    }
+    return (sz <= UG_MIN((pw)->low_watermark, rbuf_spsc_max(p) - 1))
+        || (sz < rbuf_spsc_max(p) && RBUF_LOAD_RELAXED((pw)->flg_wait_rd));
+}
+
+static void rbuf_spsc_notify(ring_spsc_t *p, ring_wait_t * pw, int flg_reader);
+
+/**
+ * \brief sleep until woken, time out or interrupted
+ * \param seq the futex word
+ * \param val the value of the futex word before the waiting flag is set
+ * \param fd the eventfd, -1 if futex is used
+ * \param deadline the CLOCK_MONOTONIC time to give up, NULL if wait forever
+ * \return 0 on woken up (maybe spuriously); -1 on time out
+ */
+static int
+rbuf_wait_sleep(uint32_t * seq, uint32_t val, int fd, struct timespec * deadline)
+{
+    struct timespec ts;
+    struct pollfd pfd;
+    uint64_t cnt;
+    int ret;
+
+    if (NULL != deadline) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec = deadline->tv_sec - ts.tv_sec;
+        ts.tv_nsec = deadline->tv_nsec - ts.tv_nsec;
+        if (ts.tv_nsec < 0) {
+            ts.tv_sec --;
+            ts.tv_nsec += 1000000000L;
+        }
+        if (ts.tv_sec < 0) {
+            ts.tv_sec = 0;
+            ts.tv_nsec = 0;
+        }
+    }
+    if (fd >= 0) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, (NULL == deadline)?-1:(int)(ts.tv_sec * 1000 + (ts.tv_nsec + 999999) / 1000000));
+        if (ret > 0) {
+            // reset the counter of eventfd
+            if (read(fd, &cnt, sizeof(cnt)) < 0) {
+                TD("the eventfd was read by others.");
+            }
+        }
+        return (0 == ret)?-1:0;
+    }
+    if (NULL != deadline && 0 == ts.tv_sec && 0 == ts.tv_nsec) {
+        return -1;
+    }
+    // the timeout of FUTEX_WAIT is relative
+    ret = syscall(SYS_futex, seq, FUTEX_WAIT_PRIVATE, val, (NULL == deadline)?NULL:&ts, NULL, 0);
+    if (ret < 0 && ETIMEDOUT == errno) {
+        return -1;
+    }
+    return 0;
+}
+
+/// wait for the reader (or the writer) can go on
+static int
+rbuf_spsc_wait(ring_spsc_t *p, ring_wait_t * pw, int flg_reader, int timeout_ms)
+{
+    struct timespec deadline;
+    uint32_t * seq = flg_reader?&((pw)->seq_rd):&((pw)->seq_wr);
+    uint32_t * flg = flg_reader?&((pw)->flg_wait_rd):&((pw)->flg_wait_wr);
+    uint32_t val;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec ++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    for (;;) {
+        if (rbuf_spsc_wait_ready(p, pw, flg_reader)) {
+            return 0;
+        }
+        val = RBUF_LOAD_ACQUIRE(*seq);
+        // tell the other side to wake us, then check again in case it missed the flag
+        __atomic_store_n(flg, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (rbuf_spsc_wait_ready(p, pw, flg_reader)) {
+            return 0;
+        }
+        // the other side may be waiting for the watermark, don't let both of us sleep
+        rbuf_spsc_notify(p, pw, ! flg_reader);
+        if (rbuf_wait_sleep(seq, val, flg_reader?(pw)->fd_rd:(pw)->fd_wr, (timeout_ms >= 0)?&deadline:NULL) < 0) {
+            if (rbuf_spsc_wait_ready(p, pw, flg_reader)) {
+                return 0;
+            }
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
+
+/// wake the reader (or the writer) if it's waiting and can go on
+static void
+rbuf_spsc_notify(ring_spsc_t *p, ring_wait_t * pw, int flg_reader)
+{
+    uint32_t * seq = flg_reader?&((pw)->seq_rd):&((pw)->seq_wr);
+    uint32_t * flg = flg_reader?&((pw)->flg_wait_rd):&((pw)->flg_wait_wr);
+    int fd = flg_reader?(pw)->fd_rd:(pw)->fd_wr;
+    uint64_t one = 1;
+
+    // pairs with the fence in rbuf_spsc_wait(), the new positions are visible if the flag is not
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 == RBUF_LOAD_RELAXED(*flg)) {
+        return;
+    }
+    if (! rbuf_spsc_wait_ready(p, pw, flg_reader)) {
+        return;
+    }
+    if (0 == __atomic_exchange_n(flg, 0, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    __atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+    if (fd >= 0) {
+        if (write(fd, &one, sizeof(one)) < 0) {
+            TE("unable to write eventfd!");
+        }
+    } else {
+        syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * \brief wait until the data size reaches the high watermark, called by the reader
+ * \param prb the ring buffer structure
+ * \param pw the wait structure
+ * \param timeout_ms the max time to wait, in milliseconds; -1 if wait forever
+ * \return 0 if the data is ready; -1 on time out with errno ETIMEDOUT
+ *
+ * With eventfd, the reader in an event loop calls it with timeout_ms 0 when the fd
+ * becomes readable; if it times out, the fd will be signaled when the data is ready.
+ */
+int
+rbuf_spsc_wait_readable(void *prb, ring_wait_t * pw, int timeout_ms)
+{
+    return rbuf_spsc_wait((ring_spsc_t *)prb, pw, 1, timeout_ms);
+}
+
+/**
+ * \brief wait until the data size falls to the low watermark, called by the writer
+ * \param prb the ring buffer structure
+ * \param pw the wait structure
+ * \param timeout_ms the max time to wait, in milliseconds; -1 if wait forever
+ * \return 0 if the space is ready; -1 on time out with errno ETIMEDOUT
+ */
+int
+rbuf_spsc_wait_writable(void *prb, ring_wait_t * pw, int timeout_ms)
+{
+    return rbuf_spsc_wait((ring_spsc_t *)prb, pw, 0, timeout_ms);
+}
+
+/**
+ * \brief wake the reader if it's waiting and the data reaches the high watermark, called by the writer after writing
+ * \param prb the ring buffer structure
+ * \param pw the wait structure
+ */
+void
+rbuf_spsc_notify_written(void *prb, ring_wait_t * pw)
+{
+    rbuf_spsc_notify((ring_spsc_t *)prb, pw, 1);
+}
+
+/**
+ * \brief wake the writer if it's waiting and the data falls to the low watermark, called by the reader after reading
+ * \param prb the ring buffer structure
+ * \param pw the wait structure
+ */
+void
+rbuf_spsc_notify_read(void *prb, ring_wait_t * pw)
+{
+    rbuf_spsc_notify((ring_spsc_t *)prb, pw, 0);
+}
+#endif // __linux__
+
+/**
+ * init a power-of-two ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to 8 bytes for the 64-bit counters
+ * \param byte_size the byte size of the whole buffer
+ * \param item_size the size of each item in the buffer
+ * \return 0 on success; -1 on error
+ *
+ * The number of slots is rounded down to power of two, the spare bytes at the end are not used.
+ */
+int
+rbuf_pow2_init(void *prb, size_t byte_size, size_t item_size)
+{
+    ring_pow2_t *p = (ring_pow2_t *)prb;
+    size_t num;
+    size_t slots;
+
+    if (item_size < 1 || (byte_size) < RBUF_POW2_OCCUPIED_BYTES(1, item_size)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    num = ((byte_size) - sizeof(ring_pow2_t)) / item_size;
+    for (slots = 1; slots <= num / 2; slots <<= 1);
+
+    memset((prb), 0, sizeof(ring_pow2_t));
+    (p)->mask = slots - 1;
+    (p)->item_size = item_size;
+    return 0;
+}
+
+/**
+ * \brief write data to ring buffer
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param num_items the number of items in the buffer
+ * \return the number of items written to the ring buffer; -1 on error
+ */
+ssize_t
+rbuf_pow2_write(void *prb, void * buf, size_t num_items)
+{
+    ring_pow2_t *p = (ring_pow2_t *)prb;
+    size_t sz_wr = 0;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    sz_wr = rbuf_pow2_spare(prb);
+    if (sz_wr < 1) {
+        TE("out of space!");
+        return -1;
+    }
+    if (num_items > sz_wr) {
+        TD("adjust sz=%d to smaller spare size=%d.", (int)num_items, (int)sz_wr);
+        num_items = sz_wr;
+    }
+
+    // the first part
+    idx = (size_t)(p)->pos_write & (p)->mask;
+    sz_wr = rbuf_pow2_max(p) - idx;
+    if (sz_wr > num_items) {
+        sz_wr = num_items;
+    }
+    memcpy (RBUF_POW2_DATA(p) + idx * (p)->item_size, buf, sz_wr * (p)->item_size);
+    // second part
+    if (sz_wr < num_items) {
+        memcpy (RBUF_POW2_DATA(p), (char *)buf + sz_wr * (p)->item_size, (num_items - sz_wr) * (p)->item_size);
+    }
+    (p)->pos_write += num_items;
+    return num_items;
+}
+
+/**
+ * \brief peek data from ring buffer without advancing the inter read pointer
+ * \param prb the ring buffer structure
+ * \param offset the offset of the reading data from the current read position, in items
+ * \param num_items the number of items
+ * \param userdata the userdata pointer to be passed to callback function
+ * \param cb_write the callback function pointer to be called when find the data, the sizes passed to it are in bytes
+ * \return the number of items read; -1 on error which need to skip to next message; 0 on reach to end of buffer which need to retry again
+ */
+ssize_t
+rbuf_pow2_peek_cb(void *prb, size_t offset, size_t num_items, void * userdata, rbuf_callback_write_t cb_write)
+{
+    ring_pow2_t *p = (ring_pow2_t *)prb;
+    size_t sz_rd = 0;
+    size_t idx;
+    ssize_t ret;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == cb_write) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    sz_rd = rbuf_pow2_size(prb);
+    if (sz_rd < 1) {
+        TE("no data available!");
+        return -1;
+    }
+    if (offset >= sz_rd) {
+        TE("offset out of range: offset=%d, size=%d.", (int)offset, (int)sz_rd);
+        return -1;
+    }
+    if (num_items + offset > sz_rd) {
+        TD("adjust sz=%d to smaller data size=%d.", (int)num_items, (int)sz_rd);
+        num_items = sz_rd - offset;
+    }
+
+    // the first part
+    idx = (size_t)((p)->pos_read + offset) & (p)->mask;
+    sz_rd = rbuf_pow2_max(p) - idx;
+    if (sz_rd > num_items) {
+        sz_rd = num_items;
+    }
+    ret = cb_write(userdata, num_items * (p)->item_size, 0, RBUF_POW2_DATA(p) + idx * (p)->item_size, sz_rd * (p)->item_size);
+    if (ret < 0) {
+        TE("user callback return error!");
+        return -1;
+    }
+    if (ret != sz_rd * (p)->item_size) {
+        return 0;
+    }
+    // second part
+    if (sz_rd < num_items) {
+        ret = cb_write(userdata, num_items * (p)->item_size, sz_rd * (p)->item_size, RBUF_POW2_DATA(p), (num_items - sz_rd) * (p)->item_size);
+        if (ret < 0) {
+            TE("user callback return error!");
+            return -1;
+        }
+        if (ret != (num_items - sz_rd) * (p)->item_size) {
+            return 0;
+        }
+    }
+    return num_items;
+}
+
+/**
+ * \brief peek data from ring buffer and save to buf without advancing the inter read pointer
+ * \param prb the ring buffer structure
+ * \param offset the offset of the reading data from the current read position
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \return the number of items read to the buffer; -1 on error
+ */
+ssize_t
+rbuf_pow2_peek(void *prb, size_t offset, void * buf, size_t num_items)
+{
+    ring_pow2_t *p = (ring_pow2_t *)prb;
+    size_t sz_rd = 0;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    sz_rd = rbuf_pow2_size(prb);
+    if (sz_rd < 1) {
+        TE("no data available!");
+        return -1;
+    }
+    if (offset >= sz_rd) {
+        TE("offset out of range: offset=%d, size=%d.", (int)offset, (int)sz_rd);
+        return -1;
+    }
+    if (num_items + offset > sz_rd) {
+        TD("adjust sz=%d to smaller data size=%d.", (int)num_items, (int)sz_rd);
+        num_items = sz_rd - offset;
+    }
+
+    // the first part
+    idx = (size_t)((p)->pos_read + offset) & (p)->mask;
+    sz_rd = rbuf_pow2_max(p) - idx;
+    if (sz_rd > num_items) {
+        sz_rd = num_items;
+    }
+    memcpy (buf, RBUF_POW2_DATA(p) + idx * (p)->item_size, sz_rd * (p)->item_size);
+    // second part
+    if (sz_rd < num_items) {
+        memcpy ((char *)buf + sz_rd * (p)->item_size, RBUF_POW2_DATA(p), (num_items - sz_rd) * (p)->item_size);
+    }
+    return num_items;
+}
+
+/**
+ * \brief discard data and forword in ring buffer
+ * \param prb the ring buffer structure
+ * \param num_items the number of items to be discarded in the buffer
+ * \return the number of items to be discarded in the buffer; -1 on error
+ */
+ssize_t
+rbuf_pow2_forward(void *prb, size_t num_items)
+{
+    ring_pow2_t *p = (ring_pow2_t *)prb;
+    if (num_items > rbuf_pow2_size(prb)) {
+        num_items = rbuf_pow2_size(prb);
+    }
+    (p)->pos_read += num_items;
+    return num_items;
+}
+
+/**
+ * \brief read data from ring buffer and save to buf
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \return the number of items read to the buffer; -1 on error
+ */
+ssize_t
+rbuf_pow2_read(void *prb, void * buf, size_t num_items)
+{
+    ssize_t ret;
+    ret = rbuf_pow2_peek(prb, 0, buf, num_items);
+    if (ret > 0) {
+        rbuf_pow2_forward(prb, ret);
+    }
+    return ret;
+}
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+/// the byte size of the mapping of a ring buffer from rbuf_pow2_create_huge()
+#define RBUF_POW2_HUGE_MAP_SIZE(items_in_buf, item_size) \
+    ((RBUF_POW2_OCCUPIED_BYTES((items_in_buf), (item_size)) + RBUF_HUGE_PAGE_SIZE - 1) / RBUF_HUGE_PAGE_SIZE * RBUF_HUGE_PAGE_SIZE)
+
+/**
+ * \brief create a power-of-two ring buffer in huge pages
+ * \param items_in_buf the min number of item slots, it's rounded up to power of two
+ * \param item_size the size of each item in the buffer
+ * \param flg_prefault touch all of the pages now, so the first pass over the buffer has no page fault
+ * \return the ring buffer structure used by rbuf_pow2_*(); NULL on error
+ *
+ * It uses MAP_HUGETLB if there are reserved huge pages; otherwise it asks for transparent
+ * huge pages on an aligned mapping. The counters are 64 bits, so the capacity is not limited
+ * to 2^31 items like the RBUF_* ring.
+ * The ring buffer should be released by rbuf_pow2_destroy_huge().
+ */
+void *
+rbuf_pow2_create_huge(size_t items_in_buf, size_t item_size, int flg_prefault)
+{
+    uint8_t * base;
+    uint8_t * p;
+    size_t slots;
+    size_t sz_map;
+    size_t i;
+    int flags;
+
+    if (items_in_buf < 1 || item_size < 1) {
+        TE("input size parameter error!");
+        return NULL;
+    }
+    for (slots = 1; slots < items_in_buf; slots <<= 1);
+    sz_map = RBUF_POW2_HUGE_MAP_SIZE(slots, item_size);
+
+    p = (uint8_t *)MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (flg_prefault ? MAP_POPULATE : 0);
+#if defined(MAP_HUGE_2MB)
+    if (RBUF_HUGE_PAGE_SIZE == (2UL * 1024 * 1024)) {
+        flags |= MAP_HUGE_2MB;
+    }
+#endif
+    p = (uint8_t *)mmap(NULL, sz_map, PROT_READ | PROT_WRITE, flags, -1, 0);
+#endif
+    if (MAP_FAILED == p) {
+        TD("no reserved huge page, use transparent huge pages");
+        // align the mapping to huge page, so all of it can be backed by huge pages
+        base = (uint8_t *)mmap(NULL, sz_map + RBUF_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == base) {
+            TE("unable to map %d bytes!", (int)sz_map);
+            return NULL;
+        }
+        p = (uint8_t *)(((uintptr_t)base + RBUF_HUGE_PAGE_SIZE - 1) / RBUF_HUGE_PAGE_SIZE * RBUF_HUGE_PAGE_SIZE);
+        if (p > base) {
+            munmap(base, p - base);
+        }
+        munmap(p + sz_map, base + RBUF_HUGE_PAGE_SIZE - p);
+#if defined(MADV_HUGEPAGE)
+        madvise(p, sz_map, MADV_HUGEPAGE);
+#endif
+        if (flg_prefault) {
+            // after madvise(), so the faults get huge pages
+            for (i = 0; i < sz_map; i += 4096) {
+                p[i] = 0;
+            }
+        }
+    }
+    rbuf_pow2_init(p, RBUF_POW2_OCCUPIED_BYTES(slots, item_size), item_size);
+    return p;
+}
+
+/**
+ * \brief release the ring buffer from rbuf_pow2_create_huge()
+ * \param prb the ring buffer structure
+ */
+void
+rbuf_pow2_destroy_huge(void *prb)
+{
+    if (NULL == prb) {
+        return;
+    }
+    munmap(prb, RBUF_POW2_HUGE_MAP_SIZE(rbuf_pow2_max(prb), ((ring_pow2_t *)prb)->item_size));
+}
+#endif // ARDUINO _WIN32
+
+/**
+ * init a lossy ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to RBUF_CACHELINE_SIZE
+ * \param byte_size the byte size of the whole buffer
+ * \param item_size the size of each item in the buffer
+ * \return 0 on success; -1 on error
+ *
+ * The number of slots is rounded down to power of two, the spare bytes at the end are not used.
+ */
+int
+rbuf_lossy_init(void *prb, size_t byte_size, size_t item_size)
+{
+    ring_lossy_t *p = (ring_lossy_t *)prb;
+    size_t num;
+    size_t slots;
+
+    if (item_size < 1 || (byte_size) < RBUF_LOSSY_OCCUPIED_BYTES(1, item_size)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    num = ((byte_size) - sizeof(ring_lossy_t)) / item_size;
+    for (slots = 1; slots <= num / 2; slots <<= 1);
+
+    memset((prb), 0, sizeof(ring_lossy_t));
+    (p)->mask = slots - 1;
+    (p)->item_size = item_size;
+    return 0;
+}
+
+/**
+ * \brief get number of items can be read from ring buffer, called by the reader
+ * \param prb the ring buffer structure
+ * \return the number of items in ring buffer
+ */
+size_t
+rbuf_lossy_size(void *prb)
+{
+    ring_lossy_t *p = (ring_lossy_t *)prb;
+    size_t sz = RBUF_LOAD_ACQUIRE((p)->pos_write) - (p)->pos_read;
+    return UG_MIN(sz, rbuf_lossy_max(p));
+}
+
+/**
+ * \brief write data to ring buffer, the oldest items are overwritten if no enough space
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param num_items the number of items in the buffer
+ * \return the number of items written to the ring buffer; -1 on error
+ *
+ * If num_items is larger than the slots, only the last items are stored.
+ */
+ssize_t
+rbuf_lossy_write(void *prb, void * buf, size_t num_items)
+{
+    ring_lossy_t *p = (ring_lossy_t *)prb;
+    size_t wr;
+    size_t sz_wr;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    wr = RBUF_LOAD_RELAXED((p)->pos_write);
+    sz_wr = num_items;
+    if (sz_wr > rbuf_lossy_max(p)) {
+        // the head of the items would be overwritten by the tail
+        wr += sz_wr - rbuf_lossy_max(p);
+        buf = (char *)buf + (sz_wr - rbuf_lossy_max(p)) * (p)->item_size;
+        sz_wr = rbuf_lossy_max(p);
+    }
+    // tell the reader the slots are being overwritten before touching them
+    RBUF_STORE_RELAXED((p)->pos_claim, wr + sz_wr);
+    RBUF_FENCE_RELEASE();
+
+    // the first part
+    idx = wr & (p)->mask;
+    num_items = UG_MIN(rbuf_lossy_max(p) - idx, sz_wr);
+    memcpy (RBUF_LOSSY_DATA(p) + idx * (p)->item_size, buf, num_items * (p)->item_size);
+    // second part
+    if (num_items < sz_wr) {
+        memcpy (RBUF_LOSSY_DATA(p), (char *)buf + num_items * (p)->item_size, (sz_wr - num_items) * (p)->item_size);
+    }
+    // publish the items to the reader
+    RBUF_STORE_RELEASE((p)->pos_write, wr + sz_wr);
+    return sz_wr;
+}
+
+/**
+ * \brief read data from ring buffer, called by the reader
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \param dropped the number of items dropped since the last read, it can be NULL
+ * \return the number of items read to the buffer; -1 if no data available
+ *
+ * The items in buf are always the oldest ones not overwritten, the ones being
+ * overwritten while they are copied are also counted as dropped.
+ */
+ssize_t
+rbuf_lossy_read(void *prb, void * buf, size_t num_items, size_t * dropped)
+{
+    ring_lossy_t *p = (ring_lossy_t *)prb;
+    size_t rd = (p)->pos_read;
+    size_t wr;
+    size_t lost = 0;
+    size_t sz_rd;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (NULL != dropped) {
+        *dropped = 0;
+    }
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    wr = RBUF_LOAD_ACQUIRE((p)->pos_write);
+    if (wr - rd > rbuf_lossy_max(p)) {
+        // lapped by the writer
+        lost = wr - rbuf_lossy_max(p) - rd;
+        rd += lost;
+    }
+    num_items = UG_MIN(num_items, wr - rd);
+
+    // the first part
+    idx = rd & (p)->mask;
+    sz_rd = UG_MIN(rbuf_lossy_max(p) - idx, num_items);
+    memcpy (buf, RBUF_LOSSY_DATA(p) + idx * (p)->item_size, sz_rd * (p)->item_size);
+    // second part
+    if (sz_rd < num_items) {
+        memcpy ((char *)buf + sz_rd * (p)->item_size, RBUF_LOSSY_DATA(p), (num_items - sz_rd) * (p)->item_size);
+    }
+
+    // drop the items the writer started to overwrite during the copy
+    RBUF_FENCE_ACQUIRE();
+    wr = RBUF_LOAD_RELAXED((p)->pos_claim);
+    if (wr - rd > rbuf_lossy_max(p)) {
+        sz_rd = UG_MIN(wr - rbuf_lossy_max(p) - rd, num_items);
+        memmove (buf, (char *)buf + sz_rd * (p)->item_size, (num_items - sz_rd) * (p)->item_size);
+        lost += sz_rd;
+        rd += sz_rd;
+        num_items -= sz_rd;
+    }
+    rd += num_items;
+    RBUF_STORE_RELAXED((p)->pos_read, rd);
+    (p)->dropped += lost;
+    if (NULL != dropped) {
+        *dropped = lost;
+    }
+    if (num_items < 1) {
+        return -1;
+    }
+    return num_items;
+}
+
+#if ! defined(__AVR__)
+/// get the sequence number of slot x
+#define RBUF_MPMC_SEQ(prb, x) (*(size_t *)((uint8_t *)((ring_mpmc_t *)(prb) + 1) + ((ring_mpmc_t *)(prb))->sz_slot * (x)))
+/// get the address of the item in slot x
+#define RBUF_MPMC_ITEM_ADDR(prb, x) ((uint8_t *)&RBUF_MPMC_SEQ(prb, x) + sizeof(size_t))
+
+/**
+ * init a MPMC ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to RBUF_CACHELINE_SIZE
+ * \param byte_size the byte size of the whole buffer
+ * \param item_size the size of each item in the buffer
+ * \return 0 on success; -1 on error
+ *
+ * The number of slots is rounded down to power of two, the spare bytes at the end are not used.
+ * It should be called before the buffer is shared with other threads.
+ */
+int
+rbuf_mpmc_init(void *prb, size_t byte_size, size_t item_size)
+{
+    ring_mpmc_t *p = (ring_mpmc_t *)prb;
+    size_t num;
+    size_t slots;
+    size_t i;
+
+    if (item_size < 1 || (byte_size) < RBUF_MPMC_OCCUPIED_BYTES(1, item_size)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    num = ((byte_size) - sizeof(ring_mpmc_t)) / RBUF_MPMC_SLOT_SIZE(item_size);
+    for (slots = 1; slots <= num / 2; slots <<= 1);
+
+    memset((prb), 0, sizeof(ring_mpmc_t));
+    (p)->mask = slots - 1;
+    (p)->item_size = item_size;
+    (p)->sz_slot = RBUF_MPMC_SLOT_SIZE(item_size);
+    for (i = 0; i < slots; i ++) {
+        RBUF_MPMC_SEQ(p, i) = i;
+    }
+    return 0;
+}
+
+/**
+ * \brief get number of items in ring buffer
+ * \param prb the ring buffer structure
+ * \return the number of items in ring buffer, it's a snapshot if other threads are accessing the buffer
+ */
+size_t
+rbuf_mpmc_size(void *prb)
+{
+    ring_mpmc_t *p = (ring_mpmc_t *)prb;
+    size_t rd = RBUF_LOAD_ACQUIRE((p)->pos_read);
+    size_t wr = RBUF_LOAD_ACQUIRE((p)->pos_write);
+    // the writers may claim the positions before rd is loaded
+    if (wr - rd > rbuf_mpmc_max(p)) {
+        return (wr > rd)?rbuf_mpmc_max(p):0;
+    }
+    return wr - rd;
+}
+
+/**
+ * \brief write data to ring buffer, it can be called by multiple threads
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param num_items the number of items in the buffer
+ * \return the number of items written to the ring buffer; -1 on error
+ *
+ * Each item is claimed and published separately, so the items from one call
+ * may be interleaved with the ones from other writers.
+ */
+ssize_t
+rbuf_mpmc_write(void *prb, void * buf, size_t num_items)
+{
+    ring_mpmc_t *p = (ring_mpmc_t *)prb;
+    size_t cnt;
+    size_t pos;
+    size_t seq;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    pos = RBUF_LOAD_RELAXED((p)->pos_write);
+    for (cnt = 0; cnt < num_items; cnt ++) {
+        for (;;) {
+            idx = pos & (p)->mask;
+            seq = RBUF_LOAD_ACQUIRE(RBUF_MPMC_SEQ(p, idx));
+            if (seq == pos) {
+                // the slot is free, claim it
+                if (RBUF_CAS_RELAXED((p)->pos_write, &pos, pos + 1)) {
+                    break;
+                }
+            } else if ((ssize_t)(seq - pos) < 0) {
+                // the slot is not read yet since the last round
+                break;
+            } else {
+                // other writers claimed the position
+                pos = RBUF_LOAD_RELAXED((p)->pos_write);
+            }
+        }
+        if (seq != pos) {
+            break;
+        }
+        memcpy (RBUF_MPMC_ITEM_ADDR(p, idx), (uint8_t *)buf + cnt * (p)->item_size, (p)->item_size);
+        // publish the item to the readers
+        RBUF_STORE_RELEASE(RBUF_MPMC_SEQ(p, idx), pos + 1);
+        pos ++;
+    }
+    if (cnt < 1) {
+        TE("out of space!");
+        return -1;
+    }
+    return cnt;
+}
+
+/**
+ * \brief read data from ring buffer and save to buf, it can be called by multiple threads
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param num_items the number of items in the buffer
+ * \return the number of items read to the buffer; -1 on error
+ */
+ssize_t
+rbuf_mpmc_read(void *prb, void * buf, size_t num_items)
+{
+    ring_mpmc_t *p = (ring_mpmc_t *)prb;
+    size_t cnt;
+    size_t pos;
+    size_t seq;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (num_items < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    pos = RBUF_LOAD_RELAXED((p)->pos_read);
+    for (cnt = 0; cnt < num_items; cnt ++) {
+        for (;;) {
+            idx = pos & (p)->mask;
+            seq = RBUF_LOAD_ACQUIRE(RBUF_MPMC_SEQ(p, idx));
+            if (seq == pos + 1) {
+                // the slot is filled, claim it
+                if (RBUF_CAS_RELAXED((p)->pos_read, &pos, pos + 1)) {
+                    break;
+                }
+            } else if ((ssize_t)(seq - (pos + 1)) < 0) {
+                // the slot is not written yet
+                break;
+            } else {
+                // other readers claimed the position
+                pos = RBUF_LOAD_RELAXED((p)->pos_read);
+            }
+        }
+        if (seq != pos + 1) {
+            break;
+        }
+        memcpy ((uint8_t *)buf + cnt * (p)->item_size, RBUF_MPMC_ITEM_ADDR(p, idx), (p)->item_size);
+        // release the slot to the writers of the next round
+        RBUF_STORE_RELEASE(RBUF_MPMC_SEQ(p, idx), pos + (p)->mask + 1);
+        pos ++;
+    }
+    if (cnt < 1) {
+        TE("no data available!");
+        return -1;
+    }
+    return cnt;
+}
+#endif // __AVR__
+
+#if ! defined(__AVR__)
+/**
+ * init a broadcast ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to RBUF_CACHELINE_SIZE
+ * \param byte_size the byte size of the whole buffer
+ * \return 0 on success; -1 on error
+ *
+ * The byte size of data is rounded down to power of two, the spare bytes at the end are not used.
+ */
+int
+rbuf_bcast_init(void *prb, size_t byte_size)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    size_t num;
+    size_t slots;
+
+    if ((byte_size) <= sizeof(ring_bcast_t)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    num = (byte_size) - sizeof(ring_bcast_t);
+    for (slots = 1; slots <= num / 2; slots <<= 1);
+
+    memset((prb), 0, sizeof(ring_bcast_t));
+    (p)->mask = slots - 1;
+    return 0;
+}
+
+/// get the read counter of the slowest reader, or the write counter if no reader
+static size_t
+rbuf_bcast_min_read(ring_bcast_t *p, size_t wr)
+{
+    size_t pos = wr;
+    size_t rd;
+    int i;
+
+    // pairs with the fence in rbuf_bcast_join(): if a new reader is not seen here,
+    // it starts after the data written so far
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (i = 0; i < RBUF_BCAST_MAX_READERS; i ++) {
+        // 2 is the slot being claimed by rbuf_bcast_join()
+        if (1 != RBUF_LOAD_ACQUIRE((p)->readers[i].flg_active)) {
+            continue;
+        }
+        rd = RBUF_LOAD_ACQUIRE((p)->readers[i].pos_read);
+        if (wr - rd > wr - pos) {
+            pos = rd;
+        }
+    }
+    return pos;
+}
+
+/**
+ * \brief get the spare size of buffer, called by the writer
+ * \param prb the ring buffer structure
+ * \return the spare size limited by the slowest reader
+ */
+size_t
+rbuf_bcast_spare(void *prb)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    size_t wr = RBUF_LOAD_RELAXED((p)->pos_write);
+    (p)->cache_min = rbuf_bcast_min_read(p, wr);
+    return rbuf_bcast_max(p) - (wr - (p)->cache_min);
+}
+
+/**
+ * \brief write data to ring buffer once for all of the readers, called by the writer
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param sz the size of buffer
+ * \return the size of data written to the ring buffer; -1 on error
+ */
+ssize_t
+rbuf_bcast_write(void *prb, uint8_t * buf, size_t sz)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    size_t wr;
+    size_t sz_wr;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    wr = RBUF_LOAD_RELAXED((p)->pos_write);
+    // check the local copy of the slowest read position first
+    sz_wr = rbuf_bcast_max(p) - (wr - (p)->cache_min);
+    if (sz_wr < sz) {
+        (p)->cache_min = rbuf_bcast_min_read(p, wr);
+        sz_wr = rbuf_bcast_max(p) - (wr - (p)->cache_min);
+    }
+    if (sz_wr < 1) {
+        TE("out of space!");
+        return -1;
+    }
+    if (sz > sz_wr) {
+        TD("adjust sz=%d to smaller spare size=%d.", (int)sz, (int)sz_wr);
+        sz = sz_wr;
+    }
+
+    // the first part
+    idx = wr & (p)->mask;
+    sz_wr = UG_MIN(rbuf_bcast_max(p) - idx, sz);
+    memcpy (RBUF_BCAST_DATA(p) + idx, buf, sz_wr);
+    // second part
+    if (sz_wr < sz) {
+        memcpy (RBUF_BCAST_DATA(p), buf + sz_wr, sz - sz_wr);
+    }
+    // publish the data to the readers
+    RBUF_STORE_RELEASE((p)->pos_write, wr + sz);
+    return sz;
+}
+
+/**
+ * \brief register a new reader, it can be called by any thread
+ * \param prb the ring buffer structure
+ * \return the reader index; -1 if no free reader slot
+ *
+ * The reader gets the data written after it joined.
+ */
+int
+rbuf_bcast_join(void *prb)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    size_t flg;
+    int i;
+
+    assert (NULL != prb);
+    for (i = 0; i < RBUF_BCAST_MAX_READERS; i ++) {
+        if (RBUF_LOAD_RELAXED((p)->readers[i].flg_active)) {
+            continue;
+        }
+        // claim the slot, the position is not used until the slot is active
+        flg = 0;
+        if (! __atomic_compare_exchange_n(&((p)->readers[i].flg_active), &flg, 2, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        // hold the data from the current position, before the writer may see us
+        RBUF_STORE_RELAXED((p)->readers[i].pos_read, RBUF_LOAD_ACQUIRE((p)->pos_write));
+        __atomic_store_n(&((p)->readers[i].flg_active), 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        // the writer may have written more data without seeing us, it's safe to start after it
+        RBUF_STORE_RELEASE((p)->readers[i].pos_read, RBUF_LOAD_ACQUIRE((p)->pos_write));
+        return i;
+    }
+    TE("no free reader slot!");
+    return -1;
+}
+
+/**
+ * \brief unregister a reader, the writer is not gated by it any more
+ * \param prb the ring buffer structure
+ * \param reader the reader index returned by rbuf_bcast_join()
+ */
+void
+rbuf_bcast_leave(void *prb, int reader)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    assert (0 <= reader && reader < RBUF_BCAST_MAX_READERS);
+    RBUF_STORE_RELEASE((p)->readers[reader].flg_active, 0);
+}
+
+/**
+ * \brief get data size for a reader
+ * \param prb the ring buffer structure
+ * \param reader the reader index returned by rbuf_bcast_join()
+ * \return the data size not read by the reader
+ */
+size_t
+rbuf_bcast_size(void *prb, int reader)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    assert (0 <= reader && reader < RBUF_BCAST_MAX_READERS);
+    return RBUF_LOAD_ACQUIRE((p)->pos_write) - (p)->readers[reader].pos_read;
+}
+
+/**
+ * \brief get the data of a reader as segments without copying
+ * \param prb the ring buffer structure
+ * \param reader the reader index returned by rbuf_bcast_join()
+ * \param offset the offset of the reading data from the current read position of the reader
+ * \param sz the max size of data
+ * \param iov the segments of the data, the second one is used only if the data wraps
+ * \return the number of segments filled in iov, 0 if no data at the offset; -1 on error
+ *
+ * The segments are valid until the reader consumes the data.
+ */
+int
+rbuf_bcast_peek_iov(void *prb, int reader, size_t offset, size_t sz, struct iovec iov[2])
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    size_t sz_rd;
+    size_t idx;
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == iov || reader < 0 || reader >= RBUF_BCAST_MAX_READERS) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    sz_rd = rbuf_bcast_size(prb, reader);
+    if (offset >= sz_rd) {
+        return 0;
+    }
+    sz = UG_MIN(sz, sz_rd - offset);
+
+    // the first part
+    idx = ((p)->readers[reader].pos_read + offset) & (p)->mask;
+    sz_rd = UG_MIN(rbuf_bcast_max(p) - idx, sz);
+    iov[0].iov_base = RBUF_BCAST_DATA(p) + idx;
+    iov[0].iov_len = sz_rd;
+    if (sz_rd >= sz) {
+        return 1;
+    }
+    // second part
+    iov[1].iov_base = RBUF_BCAST_DATA(p);
+    iov[1].iov_len = sz - sz_rd;
+    return 2;
+}
+
+/**
+ * \brief discard the data processed by a reader
+ * \param prb the ring buffer structure
+ * \param reader the reader index returned by rbuf_bcast_join()
+ * \param sz the byte size of data to be discarded
+ * \return the byte size of data discarded
+ */
+ssize_t
+rbuf_bcast_consume(void *prb, int reader, size_t sz)
+{
+    ring_bcast_t *p = (ring_bcast_t *)prb;
+    assert (0 <= reader && reader < RBUF_BCAST_MAX_READERS);
+    sz = UG_MIN(sz, rbuf_bcast_size(prb, reader));
+    if (sz > 0) {
+        // release the space to the writer
+        RBUF_STORE_RELEASE((p)->readers[reader].pos_read, (p)->readers[reader].pos_read + sz);
+    }
+    return sz;
+}
+
+/**
+ * \brief read data of a reader and save to buf
+ * \param prb the ring buffer structure
+ * \param reader the reader index returned by rbuf_bcast_join()
+ * \param buf the buffer to be filled by data from ring buffer
+ * \param sz the size of buffer
+ * \return the size of data read to the buffer; -1 on error or no data
+ */
+ssize_t
+rbuf_bcast_read(void *prb, int reader, uint8_t * buf, size_t sz)
+{
+    struct iovec iov[2];
+    int cnt;
+
+    if (NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    cnt = rbuf_bcast_peek_iov(prb, reader, 0, sz, iov);
+    if (cnt < 1) {
+        return -1;
+    }
+    memcpy (buf, iov[0].iov_base, iov[0].iov_len);
+    if (cnt > 1) {
+        memcpy (buf + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+        iov[0].iov_len += iov[1].iov_len;
+    }
+    return rbuf_bcast_consume(prb, reader, iov[0].iov_len);
+}
+#endif // __AVR__
+
+#if ! defined(__AVR__)
+// the shard claimed by the current thread in a sharded ring buffer
+typedef struct _ring_shard_tls_t {
+    ring_shard_t * p; // the sharded ring buffer
+    size_t id;        // the id of the ring buffer when the shard was claimed
+    size_t idx;       // the index of the shard
+} ring_shard_tls_t;
+
+static __thread ring_shard_tls_t rbuf_shard_tls[RBUF_SHARD_TLS_SLOTS];
+static size_t rbuf_shard_last_id = 0;
+
+#if ! defined(ARDUINO)
+#include <pthread.h>
+
+// the key to release the shards of a thread when it exits
+static pthread_key_t rbuf_shard_key;
+static pthread_once_t rbuf_shard_key_once = PTHREAD_ONCE_INIT;
+
+/// release all of the shards of an exiting thread, arg is its rbuf_shard_tls
+static void
+rbuf_shard_tls_destroy(void * arg)
+{
+    ring_shard_tls_t * ptls = (ring_shard_tls_t *)arg;
+    size_t i;
+
+    for (i = 0; i < RBUF_SHARD_TLS_SLOTS; i ++) {
+        if (NULL != ptls[i].p && (ptls[i].p)->id == ptls[i].id) {
+            RBUF_STORE_RELEASE(RBUF_SHARD_SLOT(ptls[i].p, ptls[i].idx)->flg_used, 0);
+        }
+        ptls[i].p = NULL;
+    }
+}
+
+static void
+rbuf_shard_key_create(void)
+{
+    if (0 != pthread_key_create(&rbuf_shard_key, rbuf_shard_tls_destroy)) {
+        TE("unable to create the key of the thread local storage!");
+    }
+}
+#endif // ARDUINO
+
+/**
+ * init a sharded ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure, aligned to RBUF_CACHELINE_SIZE
+ * \param byte_size the byte size of the whole buffer, see RBUF_SHARD_OCCUPIED_BYTES()
+ * \param num_shards the max number of writer threads
+ * \param flg_seq if the records are numbered and read in the order of the numbers, the writers share one counter
+ * \return 0 on success; -1 on error
+ *
+ * It should be called before the writer threads start.
+ */
+int
+rbuf_shard_init(void *prb, size_t byte_size, size_t num_shards, int flg_seq)
+{
+    ring_shard_t *p = (ring_shard_t *)prb;
+    size_t stride;
+    size_t i;
+
+    if (num_shards < 1 || (byte_size) <= sizeof(ring_shard_t)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    stride = ((byte_size) - sizeof(ring_shard_t)) / num_shards / RBUF_CACHELINE_SIZE * RBUF_CACHELINE_SIZE;
+    if (stride <= sizeof(ring_shard_slot_t) + rbuf_spsc_occupied_bytes(sizeof(ring_shard_hdr_t))) {
+        TE("no enough spare memory for the shards!");
+        return -1;
+    }
+    memset((prb), 0, sizeof(ring_shard_t));
+    (p)->num_shards = num_shards;
+    (p)->sz_stride = stride;
+    (p)->flg_seq = (flg_seq ? 1 : 0);
+    (p)->id = __atomic_add_fetch(&rbuf_shard_last_id, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < num_shards; i ++) {
+        RBUF_SHARD_SLOT(p, i)->flg_used = 0;
+        rbuf_spsc_init(RBUF_SHARD_PTR(p, i), stride - sizeof(ring_shard_slot_t));
+    }
+    return 0;
+}
+
+/// get the shard of the current thread, claim a free one if it's the first write of the thread
+static ring_spsc_t *
+rbuf_shard_get(ring_shard_t *p)
+{
+    size_t flg;
+    size_t num;
+    size_t idx;
+    size_t i;
+
+    idx = RBUF_SHARD_TLS_SLOTS;
+    for (i = 0; i < RBUF_SHARD_TLS_SLOTS; i ++) {
+        if (p == rbuf_shard_tls[i].p) {
+            if ((p)->id == rbuf_shard_tls[i].id) {
+                return RBUF_SHARD_PTR(p, rbuf_shard_tls[i].idx);
+            }
+            // the buffer was initialized again, the old shard is gone
+            rbuf_shard_tls[i].p = NULL;
+        }
+        if (NULL == rbuf_shard_tls[i].p && idx >= RBUF_SHARD_TLS_SLOTS) {
+            idx = i;
+        }
+    }
+    if (idx >= RBUF_SHARD_TLS_SLOTS) {
+        // a second shard in the same buffer would break the order of the records of the thread
+        TE("the thread writes to too many sharded ring buffers!");
+        return NULL;
+    }
+    i = idx;
+
+    // the released shards come first, they may have records left
+    for (idx = 0; idx < (p)->num_shards; idx ++) {
+        flg = 0;
+        if (__atomic_compare_exchange_n(&(RBUF_SHARD_SLOT(p, idx)->flg_used), &flg, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (idx >= (p)->num_shards) {
+        TE("no free shard!");
+        return NULL;
+    }
+    // let the reader check the shard
+    num = RBUF_LOAD_RELAXED((p)->num_claimed);
+    while (num <= idx && ! __atomic_compare_exchange_n(&((p)->num_claimed), &num, idx + 1, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+#if ! defined(ARDUINO)
+    pthread_once(&rbuf_shard_key_once, rbuf_shard_key_create);
+    pthread_setspecific(rbuf_shard_key, rbuf_shard_tls);
+#endif
+    rbuf_shard_tls[i].p = p;
+    rbuf_shard_tls[i].id = (p)->id;
+    rbuf_shard_tls[i].idx = idx;
+    return RBUF_SHARD_PTR(p, idx);
+}
+
+/**
+ * \brief release the shard of the current thread, called by a writer which stops writing
+ * \param prb the ring buffer structure
+ * \return 0 on success; -1 if the thread has no shard in the ring buffer
+ *
+ * The records left in the shard are still read by the reader, and the shard can be claimed
+ * by another thread. It's called automatically when the thread exits.
+ */
+int
+rbuf_shard_release(void *prb)
+{
+    ring_shard_t *p = (ring_shard_t *)prb;
+    size_t i;
+
+    assert (NULL != prb);
+    for (i = 0; i < RBUF_SHARD_TLS_SLOTS; i ++) {
+        if (p == rbuf_shard_tls[i].p) {
+            rbuf_shard_tls[i].p = NULL;
+            if ((p)->id == rbuf_shard_tls[i].id) {
+                RBUF_STORE_RELEASE(RBUF_SHARD_SLOT(p, rbuf_shard_tls[i].idx)->flg_used, 0);
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * \brief write one record to the shard of the current thread, called by the writers
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be writen
+ * \param sz the size of buffer
+ * \return the size of the record; -1 on error, or if there's no space or no free shard
+ *
+ * The record is written as a whole or not at all.
+ */
+ssize_t
+rbuf_shard_write(void *prb, uint8_t * buf, size_t sz)
+{
+    ring_shard_t *p = (ring_shard_t *)prb;
+    ring_spsc_t *ps;
+    ring_shard_hdr_t hdr;
+    size_t wr;
+
+    assert (NULL != prb);
+    if (sz < 1 || NULL == buf) {
+        TE("input size parameter error!");
+        return -1;
+    }
+    ps = rbuf_shard_get(p);
+    if (NULL == ps) {
+        return -1;
+    }
+    // check the local copy of the read position first
+    wr = RBUF_LOAD_RELAXED((ps)->pos_write);
+    if (rbuf_spsc_max(ps) - RBUF_SPSC_DIST((ps)->cache_read, wr, (ps)->sz_buf) < sizeof(hdr) + sz
+        && rbuf_spsc_spare(ps) < sizeof(hdr) + sz) {
+        TE("out of space!");
+        return -1;
+    }
+    hdr.len = sz;
+    hdr.seq = 0;
+    // number it after the space is checked, so the reader never waits for a number not to be written
+    if ((p)->flg_seq) {
+        hdr.seq = __atomic_add_fetch(&((p)->seq), 1, __ATOMIC_RELAXED);
+    }
+    // the reader waits for the whole record
+    rbuf_spsc_write(ps, (uint8_t *)&hdr, sizeof(hdr));
+    rbuf_spsc_write(ps, buf, sz);
+    return sz;
+}
+
+/// get the header of the first record in a shard, return 1 if the whole record is available
+static int
+rbuf_shard_peek_hdr(ring_spsc_t *ps, ring_shard_hdr_t *phdr)
+{
+    size_t sz = rbuf_spsc_size(ps);
+    if (sz < sizeof(*phdr)) {
+        return 0;
+    }
+    rbuf_spsc_peek(ps, 0, (uint8_t *)phdr, sizeof(*phdr));
+    return (sz >= sizeof(*phdr) + phdr->len);
+}
+
+/**
+ * \brief read one record from the shards, called by the reader
+ * \param prb the ring buffer structure
+ * \param buf the buffer to be filled by the record
+ * \param sz the size of buffer
+ * \return the size of the record; 0 if no record available;
+ *   -1 if the buffer is smaller than the record, the record is kept in the ring buffer
+ *
+ * The shards are read in round robin, one record each time; if the records are numbered,
+ * they are read in the order of the numbers, and it returns 0 if the next one is not written yet.
+ */
+ssize_t
+rbuf_shard_read(void *prb, uint8_t * buf, size_t sz)
+{
+    ring_shard_t *p = (ring_shard_t *)prb;
+    ring_shard_hdr_t hdr;
+    ring_shard_hdr_t best;
+    size_t num;
+    size_t found;
+    size_t idx;
+    size_t i;
+
+    assert (NULL != prb);
+    num = RBUF_LOAD_ACQUIRE((p)->num_claimed);
+    found = num;
+    best.len = 0;
+    best.seq = 0;
+    for (i = 0; i < num; i ++) {
+        idx = ((p)->next + i) % num;
+        if (! rbuf_shard_peek_hdr(RBUF_SHARD_PTR(p, idx), &hdr)) {
+            continue;
+        }
+        if (found >= num || (ssize_t)(hdr.seq - best.seq) < 0) {
+            found = idx;
+            best = hdr;
+        }
+        if (! (p)->flg_seq) {
+            break;
+        }
+    }
+    if (found >= num) {
+        return 0;
+    }
+    if ((p)->flg_seq && best.seq != (p)->seq_read + 1) {
+        // the record before it is numbered but not written yet
+        return 0;
+    }
+    if (NULL == buf || best.len > sz) {
+        TE("no enough buffer for the record: sz=%d, len=%d.", (int)sz, (int)best.len);
+        return -1;
+    }
+    rbuf_spsc_forward(RBUF_SHARD_PTR(p, found), sizeof(hdr));
+    rbuf_spsc_read(RBUF_SHARD_PTR(p, found), buf, best.len);
+    (p)->next = found + 1;
+    (p)->seq_read = best.seq;
+    return best.len;
+}
+#endif // __AVR__
+
+// the arrays of the time-windowed ring buffer
+#define RBUF_WIN_TS_ARR(p)   ((rbuf_win_ts_t *)((ring_window_t *)(p) + 1))
+#define RBUF_WIN_MINQ_ARR(p) ((size_t *)(RBUF_WIN_TS_ARR(p) + rbuf_win_max(p)))
+#define RBUF_WIN_MAXQ_ARR(p) (RBUF_WIN_MINQ_ARR(p) + rbuf_win_max(p))
+#define RBUF_WIN_VAL_ARR(p)  ((rbuf_win_val_t *)(RBUF_WIN_MAXQ_ARR(p) + rbuf_win_max(p)))
+// get the element of an item by its counter
+#define RBUF_WIN_TS(p, cnt)   (RBUF_WIN_TS_ARR(p)[(cnt) & (p)->mask])
+#define RBUF_WIN_MINQ(p, cnt) (RBUF_WIN_MINQ_ARR(p)[(cnt) & (p)->mask])
+#define RBUF_WIN_MAXQ(p, cnt) (RBUF_WIN_MAXQ_ARR(p)[(cnt) & (p)->mask])
+#define RBUF_WIN_VAL(p, cnt)  (RBUF_WIN_VAL_ARR(p)[(cnt) & (p)->mask])
+
+/**
+ * init a time-windowed ring buffer structure
+ * \param prb the pointer to the start of a memory buffer for ring buffer structure
+ * \param byte_size the byte size of the whole buffer, see RBUF_WIN_OCCUPIED_BYTES()
+ * \return 0 on success; -1 on error
+ *
+ * The number of item slots is rounded down to power of two, the spare bytes at the end are not used.
+ */
+int
+rbuf_win_init(void *prb, size_t byte_size)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+    size_t num;
+    size_t slots;
+
+    if ((byte_size) < RBUF_WIN_OCCUPIED_BYTES(1)) {
+        TE("no enough spare memory for both the ring buffer structure and data!");
+        return -1;
+    }
+    num = ((byte_size) - sizeof(ring_window_t)) / RBUF_WIN_SLOT_SIZE;
+    for (slots = 1; slots <= num / 2; slots <<= 1);
+
+    memset((prb), 0, sizeof(ring_window_t));
+    (p)->mask = slots - 1;
+    return 0;
+}
+
+/**
+ * \brief append one item to the window
+ * \param prb the ring buffer structure
+ * \param ts the timestamp, not older than the newest item
+ * \param val the value
+ * \return 0 on success; -1 if the buffer is full or the timestamp goes back
+ */
+int
+rbuf_win_push(void *prb, rbuf_win_ts_t ts, rbuf_win_val_t val)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+    size_t pos;
+
+    assert (NULL != prb);
+    pos = (p)->pos_write;
+    if (rbuf_win_size(p) > (p)->mask) {
+        TE("out of space!");
+        return -1;
+    }
+    if (rbuf_win_size(p) > 0 && ts < RBUF_WIN_TS(p, pos - 1)) {
+        TE("the timestamp goes back!");
+        return -1;
+    }
+    RBUF_WIN_TS(p, pos) = ts;
+    RBUF_WIN_VAL(p, pos) = val;
+
+    // the older items not smaller (larger) than the new one are never the min (max) again
+    while ((p)->min_tail != (p)->min_head && RBUF_WIN_VAL(p, RBUF_WIN_MINQ(p, (p)->min_tail - 1)) >= val) {
+        (p)->min_tail --;
+    }
+    RBUF_WIN_MINQ(p, (p)->min_tail) = pos;
+    (p)->min_tail ++;
+    while ((p)->max_tail != (p)->max_head && RBUF_WIN_VAL(p, RBUF_WIN_MAXQ(p, (p)->max_tail - 1)) <= val) {
+        (p)->max_tail --;
+    }
+    RBUF_WIN_MAXQ(p, (p)->max_tail) = pos;
+    (p)->max_tail ++;
+
+    (p)->sum += val;
+    (p)->pos_write = pos + 1;
+    return 0;
+}
+
+/**
+ * \brief get one item without removing it
+ * \param prb the ring buffer structure
+ * \param offset the index of the item, 0 is the oldest one
+ * \param pts the timestamp of the item, it can be NULL
+ * \param pval the value of the item, it can be NULL
+ * \return 0 on success; -1 if the offset is out of range
+ */
+int
+rbuf_win_peek(void *prb, size_t offset, rbuf_win_ts_t * pts, rbuf_win_val_t * pval)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+
+    assert (NULL != prb);
+    if (offset >= rbuf_win_size(p)) {
+        return -1;
+    }
+    if (NULL != pts) {
+        *pts = RBUF_WIN_TS(p, (p)->pos_read + offset);
+    }
+    if (NULL != pval) {
+        *pval = RBUF_WIN_VAL(p, (p)->pos_read + offset);
+    }
+    return 0;
+}
+
+/**
+ * \brief get the timestamps of the oldest and the newest items
+ * \param prb the ring buffer structure
+ * \param oldest the timestamp of the oldest item, it can be NULL
+ * \param newest the timestamp of the newest item, it can be NULL
+ * \return 0 on success; -1 if the buffer is empty
+ */
+int
+rbuf_win_range(void *prb, rbuf_win_ts_t * oldest, rbuf_win_ts_t * newest)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+
+    assert (NULL != prb);
+    if (rbuf_win_size(p) < 1) {
+        return -1;
+    }
+    if (NULL != oldest) {
+        *oldest = RBUF_WIN_TS(p, (p)->pos_read);
+    }
+    if (NULL != newest) {
+        *newest = RBUF_WIN_TS(p, (p)->pos_write - 1);
+    }
+    return 0;
+}
+
+/**
+ * \brief remove the oldest items
+ * \param prb the ring buffer structure
+ * \param num_items the number of items to be removed
+ * \return the number of items removed
+ */
+ssize_t
+rbuf_win_forward(void *prb, size_t num_items)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+    size_t i;
+
+    assert (NULL != prb);
+    if (num_items > rbuf_win_size(p)) {
+        num_items = rbuf_win_size(p);
+    }
+    for (i = 0; i < num_items; i ++) {
+        (p)->sum -= RBUF_WIN_VAL(p, (p)->pos_read + i);
+    }
+    (p)->pos_read += num_items;
+    // the candidates are in the order of the counters, the removed ones are at the head
+    while ((p)->min_head != (p)->min_tail && (ssize_t)(RBUF_WIN_MINQ(p, (p)->min_head) - (p)->pos_read) < 0) {
+        (p)->min_head ++;
+    }
+    while ((p)->max_head != (p)->max_tail && (ssize_t)(RBUF_WIN_MAXQ(p, (p)->max_head) - (p)->pos_read) < 0) {
+        (p)->max_head ++;
+    }
+    return num_items;
+}
+
+/// get the number of the timestamps older than ts in a sorted array
+static size_t
+rbuf_win_lower_bound(const rbuf_win_ts_t * arr, size_t num, rbuf_win_ts_t ts)
+{
+    size_t lo = 0;
+    size_t mid;
+
+    while (lo < num) {
+        mid = lo + (num - lo) / 2;
+        if (arr[mid] < ts) {
+            lo = mid + 1;
+        } else {
+            num = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * \brief remove the items older than a timestamp
+ * \param prb the ring buffer structure
+ * \param ts the start of the window, the items with the timestamp smaller than it are removed
+ * \return the number of items removed
+ *
+ * The items are searched by binary search in the two segments of the array.
+ */
+ssize_t
+rbuf_win_forward_until(void *prb, rbuf_win_ts_t ts)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+    size_t idx;
+    size_t num;
+    size_t len1;
+
+    assert (NULL != prb);
+    num = rbuf_win_size(p);
+    if (num < 1) {
+        return 0;
+    }
+    idx = (p)->pos_read & (p)->mask;
+    len1 = UG_MIN(num, rbuf_win_max(p) - idx);
+    if (len1 < num && RBUF_WIN_TS_ARR(p)[idx + len1 - 1] < ts) {
+        // the whole first segment is removed
+        num = len1 + rbuf_win_lower_bound(RBUF_WIN_TS_ARR(p), num - len1, ts);
+    } else {
+        num = rbuf_win_lower_bound(RBUF_WIN_TS_ARR(p) + idx, len1, ts);
+    }
+    return rbuf_win_forward(prb, num);
+}
+
+/**
+ * \brief get the aggregates of the items in the window in constant time
+ * \param prb the ring buffer structure
+ * \param pagg the aggregates to be filled
+ * \return 0 on success; -1 if the buffer is empty, only the count (0) and the sum are valid
+ */
+int
+rbuf_win_aggregate(void *prb, ring_win_agg_t * pagg)
+{
+    ring_window_t *p = (ring_window_t *)prb;
+
+    assert (NULL != prb);
+    assert (NULL != pagg);
+    memset(pagg, 0, sizeof(*pagg));
+    pagg->count = rbuf_win_size(p);
+    pagg->sum = (p)->sum;
+    if (pagg->count < 1) {
+        return -1;
+    }
+    pagg->min = RBUF_WIN_VAL(p, RBUF_WIN_MINQ(p, (p)->min_head));
+    pagg->max = RBUF_WIN_VAL(p, RBUF_WIN_MAXQ(p, (p)->max_head));
+    pagg->oldest = RBUF_WIN_TS(p, (p)->pos_read);
+    pagg->newest = RBUF_WIN_TS(p, (p)->pos_write - 1);
+    return 0;
+}
+
+
+#if defined(CIUT_ENABLED) && (CIUT_ENABLED == 1)
+#include <ciut.h>
+
+//#include "gpib-hwconf.h" // MAX_BUFFER_SEGMENT
+
+#ifndef MAX_BUFFER_SEGMENT
+#define MAX_BUFFER_SEGMENT 250
+#endif
+
+static void
+rbuf_fill_test_buffer(uint8_t *buf, uint8_t start_value, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i ++) {
+        buf[i] = start_value;
+        start_value ++;
+    }
+}
+
+#define MAX_SIZE (12*6)
+
+TEST_CASE( .name="ring-buffer", .description="test ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    uint8_t boundary[sizeof(ring_buffer_t)*3 + MAX_SIZE + 1];
+
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer2[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    size_t sz_buf = sizeof(buffer);
+    ssize_t sz_rd = -1;
+    uint8_t cur_val = 0; // current start write value
+    uint8_t cur_rd = 0; // current read value
+
+    REQUIRE ((sizeof(boundary) - sizeof(ring_buffer_t)*2) / 6 * 6 <= (sizeof(boundary) - sizeof(ring_buffer_t)*2));
+#define TEST_RBUF_SIZE rbuf_occupied_bytes(MAX_SIZE - 12)
+
+#define MASK_BOUNDARY 'A'
+    prb = (ring_buffer_t *) boundary;
+    prb ++;
+    assert (boundary < (uint8_t *)prb && (uint8_t *)prb <= (boundary + sizeof(ring_buffer_t)));
+    assert ((uint8_t *)(prb+1) < (boundary + sizeof(boundary) - 1));
+
+#define CHECK_BOUNDARY(b, end) \
+    { \
         uint8_t *p; \
         for (p = (uint8_t *)(b); p < (uint8_t *)(end); p ++) { \
             REQUIRE(MASK_BOUNDARY == *p); \
         } \
     }
 
-    SECTION("test ring buffer, init") {
-        REQUIRE(-1 == rbuf_init(prb, 0));
-        REQUIRE(-1 == rbuf_init(prb, 1));
-        REQUIRE(-1 == rbuf_init(prb, sizeof(ring_buffer_t)-1));
-        REQUIRE(-1 == rbuf_init(prb, sizeof(ring_buffer_t)));
-        REQUIRE(0 == rbuf_init(prb, sizeof(ring_buffer_t)+1));
+    SECTION("test ring buffer, init") {
+        REQUIRE(-1 == rbuf_init(prb, 0));
+        REQUIRE(-1 == rbuf_init(prb, 1));
+        REQUIRE(-1 == rbuf_init(prb, sizeof(ring_buffer_t)-1));
+        REQUIRE(-1 == rbuf_init(prb, sizeof(ring_buffer_t)));
+        REQUIRE(0 == rbuf_init(prb, sizeof(ring_buffer_t)+1));
+    }
+
+    SECTION("test ring buffer, parameters") {
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(-1 == rbuf_write(prb, NULL, 0));
+        REQUIRE(-1 == rbuf_write(prb, buffer, 0));
+        REQUIRE(-1 == rbuf_read(prb, NULL, 0));
+        REQUIRE(-1 == rbuf_read(prb, buffer, 0));
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        rbuf_reset(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    }
+
+    SECTION("test ring buffer, basic forward") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+        REQUIRE(0 == rbuf_forward(prb, 1));
+        REQUIRE(1 == rbuf_write(prb, buffer, 1));
+        REQUIRE(1 == rbuf_size(prb));
+        REQUIRE(1 == rbuf_forward(prb, 1));
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(1 == rbuf_write(prb, buffer, 1));
+        REQUIRE(1 == rbuf_size(prb));
+        REQUIRE(1 == rbuf_forward(prb, 200));
+        REQUIRE(0 == rbuf_size(prb));
+    }
+
+    SECTION("test ring buffer, test forward") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+
+        // fullfill the ring buffer
+        sz_buf = sizeof(buffer);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(sz_rd == rbuf_size(prb));
+        REQUIRE(0 == rbuf_spare(prb));
+
+        // read all of the ring buffer
+        sz_buf = rbuf_size(prb);
+        sz_rd = sz_buf/2;
+        for (; sz_rd>0;) {
+            rbuf_forward(prb, sz_rd);
+            REQUIRE(sz_buf - sz_rd == rbuf_size(prb));
+            sz_buf = rbuf_size(prb);
+            sz_rd = sz_buf/2;
+        }
+    }
+    SECTION("test ring buffer, test peek") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+
+        // fullfill the ring buffer
+        sz_buf = sizeof(buffer);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(sz_rd == rbuf_size(prb));
+        REQUIRE(0 == rbuf_spare(prb));
+
+        // read all of the ring buffer
+        while (rbuf_size(prb) > 0) {
+            ret = rbuf_peek(prb, 0, buffer2, 1);
+            ret = rbuf_read(prb, buffer, 1);        
+            REQUIRE(buffer[0] == buffer2[0]);
+        }
+    }
+    SECTION("test ring buffer, basic read write") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+
+        // fullfill the ring buffer
+        sz_buf = sizeof(buffer);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(sz_rd == rbuf_size(prb));
+        REQUIRE(0 == rbuf_spare(prb));
+
+        // try to write to fulled ring buffer
+        REQUIRE(-1 == rbuf_write(prb, buffer_comp, sizeof(buffer_comp)));
+
+        // read all of the ring buffer
+        ret = rbuf_peek(prb, 0, buffer2, sz_rd);
+        REQUIRE(ret == rbuf_size(prb));
+        REQUIRE(ret == rbuf_size(prb));
+        ret = rbuf_peek(prb, sz_rd/2, buffer2+sz_rd/2, sz_rd/2);
+        REQUIRE(ret == sz_rd/2);
+        ret = rbuf_peek(prb, 1, buffer2+1, 1);
+        REQUIRE(ret == 1);
+        ret = rbuf_peek(prb, sz_rd-1, buffer2+sz_rd-1, 1);
+        REQUIRE(ret == 1);
+
+        ret = rbuf_read(prb, buffer, sz_rd);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        cur_rd += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+
+        // try to read empty ring buffer
+        REQUIRE(-1 == rbuf_read(prb, buffer, sizeof(buffer)));
+
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        rbuf_reset(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    }
+    SECTION("test ring buffer, reset after read and write") {
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        CIUT_LOG("rbuf_max=%d", rbuf_max(prb));
+        REQUIRE(rbuf_max(prb) % 12 == 0);
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+
+        // full the ring buffer, after that size()=FULL, spare()=0
+        sz_buf = rbuf_max(prb);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(sz_rd == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_size(prb));
+        REQUIRE(0 == rbuf_spare(prb));
+
+        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
+        sz_buf = rbuf_max(prb) * 5 / 6;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
+        sz_rd = rbuf_read(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE((rbuf_max(prb) - sz_buf) == rbuf_size(prb));
+        REQUIRE(sz_rd == rbuf_spare(prb));
+        CIUT_LOG("rbuf_max=%d; rbuf_size=%d", rbuf_max(prb), rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*2/12 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*10/12 == rbuf_spare(prb));
+        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+        cur_rd += sz_rd;
+
+        // reset the buffer and check boundary
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        rbuf_reset(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    }
+
+    SECTION("test ring buffer, partial read write") {
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        rbuf_init(prb, TEST_RBUF_SIZE);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+        REQUIRE(rbuf_max(prb) % 12 == 0);
+
+        // full the ring buffer, after that size()=FULL, spare()=0
+        sz_buf = rbuf_max(prb);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(sz_rd == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_size(prb));
+        REQUIRE(0 == rbuf_spare(prb));
+
+        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
+        sz_buf = rbuf_max(prb) * 5 / 6;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
+        sz_rd = rbuf_read(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE((rbuf_max(prb) - sz_buf) == rbuf_size(prb));
+        REQUIRE(sz_rd == rbuf_spare(prb));
+        REQUIRE(rbuf_max(prb)*2/12 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*10/12 == rbuf_spare(prb));
+        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+        cur_rd += sz_rd;
+
+        // write all, after that size()=6/6, spare()=0/6
+        sz_buf = rbuf_max(prb)*2;
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sizeof(buffer_comp));
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(rbuf_max(prb)*12/12 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*0/12 == rbuf_spare(prb));
+
+        // read 3/6, after that size()=3/6, spare()=3/6
+        sz_buf = rbuf_max(prb)*6/12;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        memset(buffer2, 0, sizeof(buffer));
+        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
+        sz_rd = rbuf_read(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(rbuf_max(prb)*6/12 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*6/12 == rbuf_spare(prb));
+        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
+        hex_dump_to_fp(stderr, buffer_comp, sz_rd);
+        hex_dump_to_fp(stderr, buffer, sz_rd);
+        hex_dump_to_fp(stderr, buffer2, sz_rd);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+        cur_rd += sz_rd;
+
+        // write another 2/6, after that size()=5/6, spare()=1/6
+        sz_buf = rbuf_max(prb)*2/6;
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
+        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        REQUIRE(sz_rd > 0);
+        REQUIRE(sz_rd == sz_buf);
+        cur_val += sz_rd;
+        REQUIRE(rbuf_max(prb)*5/6 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb)*1/6 == rbuf_spare(prb));
+
+        // read all of them, after that size()=0, spare()=FULL
+        sz_buf = rbuf_max(prb) + 1;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
+        sz_rd = rbuf_read(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+        REQUIRE(0 == rbuf_size(prb));
+        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+        cur_rd += sz_rd;
+
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        rbuf_reset(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    }
+}
+
+//#undef MAX_SIZE
+//#define MAX_SIZE 12
+#define ITEM_T char
+static void
+rbuf_fill_test_buffer_macro(ITEM_T *buf, ITEM_T start_value, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i ++) {
+        buf[i] = start_value;
+        start_value ++;
+    }
+}
+
+
+TEST_CASE( .name="macro-ring", .description="test MACRO ring buffer.", .skip=0 ) {
+
+    void *prb = NULL;
+
+    ITEM_T buffer[MAX_BUFFER_SEGMENT];
+    ITEM_T buffer2[MAX_BUFFER_SEGMENT];
+    ITEM_T buffer_comp[MAX_BUFFER_SEGMENT];
+
+    // the statistics in the header need the alignment of size_t
+    ITEM_T boundary[MAX_SIZE*2 + RBUF_HEADER_BYTES*2] __attribute__((aligned(sizeof(size_t))));
+
+    size_t sz_buf = sizeof(buffer) / sizeof(ITEM_T);
+    ssize_t sz_rd = -1;
+    ITEM_T cur_val = 0; // current start write value
+    ITEM_T cur_rd = 0; // current read value
+
+#undef MASK_BOUNDARY
+#define MASK_BOUNDARY ('A')
+    prb = (char *)boundary + ((sizeof(boundary)/2 - (sizeof(ITEM_T) * (MAX_SIZE/2))) / sizeof(size_t) * sizeof(size_t));
+    CIUT_LOG("boundary=%p; prb=%p, boundary end=%p", boundary, prb, (char *)boundary + sizeof(boundary));
+
+    assert ((char *)boundary < (char *)prb && (char *)prb <= ((char *)boundary + sizeof(boundary)));
+    assert ( (char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)) < ((char *)boundary + sizeof(boundary) - 1));
+    memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+#define CHECK_BOUNDARY(b, end) \
+    { \
+        char *p; \
+        for (p = (char *)(b); p < (char *)(end); p ++) { \
+            REQUIRE(MASK_BOUNDARY == *p); \
+        } \
+    }
+
+    SECTION("test ring buffer, parameters") {
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        REQUIRE(-1 == RBUF_WRITE(prb, NULL, 0));
+        REQUIRE(-1 == RBUF_WRITE(prb, buffer, 0));
+        REQUIRE(-1 == RBUF_READ(prb, NULL, 0));
+        REQUIRE(-1 == RBUF_READ(prb, buffer, 0));
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+        RBUF_RESET(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+    }
+
+    SECTION("test ring buffer, basic forward") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+        REQUIRE(0 == RBUF_FORWARD(prb, 1));
+        REQUIRE(1 == RBUF_WRITE(prb, buffer, 1));
+        REQUIRE(1 == RBUF_SIZE(prb));
+        REQUIRE(1 == RBUF_FORWARD(prb, 1));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(1 == RBUF_WRITE(prb, buffer, 1));
+        REQUIRE(1 == RBUF_SIZE(prb));
+        REQUIRE(1 == RBUF_FORWARD(prb, 200));
+        REQUIRE(0 == RBUF_SIZE(prb));
+    }
+
+    SECTION("test ring buffer, forward") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        CIUT_LOG("max number=%d, OCCUPIED_BYTES(sz=%d)", MAX_SIZE+1, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("RBUF_POS_RD()=%d, RBUF_POS_WR()=%d, RBUF_ITEM_SIZE()=%d, RBUF_MAX_ITEMS()=%d", RBUF_POS_RD(prb), RBUF_POS_WR(prb), RBUF_ITEM_SIZE(prb), RBUF_MAX_ITEMS(prb));
+        CIUT_LOG("boundary sz=%d", sizeof(boundary));
+        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
+        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+
+        // fullfill the ring buffer
+        sz_buf = sizeof(buffer) / sizeof(ITEM_T);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(sz_rd == RBUF_SIZE(prb));
+        REQUIRE(0 == RBUF_SPARE(prb));
+
+        sz_buf = RBUF_SIZE(prb);
+        sz_rd = sz_buf/2;
+        for (; sz_rd>0;) {
+            RBUF_FORWARD(prb, sz_rd);
+            REQUIRE(sz_buf - sz_rd == RBUF_SIZE(prb));
+            sz_buf = RBUF_SIZE(prb);
+            sz_rd = sz_buf/2;
+        }
+    }
+    SECTION("test ring buffer, basic read write") {
+        int ret;
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        CIUT_LOG("max number=%d, OCCUPIED_BYTES(sz=%d)", MAX_SIZE+1, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("RBUF_POS_RD()=%d, RBUF_POS_WR()=%d, RBUF_ITEM_SIZE()=%d, RBUF_MAX_ITEMS()=%d", RBUF_POS_RD(prb), RBUF_POS_WR(prb), RBUF_ITEM_SIZE(prb), RBUF_MAX_ITEMS(prb));
+        CIUT_LOG("boundary sz=%d", sizeof(boundary));
+        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
+        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+
+        // fullfill the ring buffer
+        sz_buf = sizeof(buffer) / sizeof(ITEM_T);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(sz_rd == RBUF_SIZE(prb));
+        REQUIRE(0 == RBUF_SPARE(prb));
+
+        // try to write to fulled ring buffer
+        REQUIRE(-1 == RBUF_WRITE(prb, buffer_comp, sizeof(buffer_comp)/sizeof(ITEM_T)));
+
+        // read all of the ring buffer
+        ret = RBUF_PEEK(prb, 0, buffer2, sz_rd);
+        ret = RBUF_PEEK(prb, sz_rd/2, buffer2+sz_rd/2, sz_rd/2);
+        ret = RBUF_PEEK(prb, 1, buffer2+1, 1);
+        ret = RBUF_PEEK(prb, sz_rd-1, buffer2+sz_rd-1, 1);
+
+        ret = RBUF_READ(prb, buffer, sz_rd);
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        cur_rd += sz_rd;
+        REQUIRE(sz_rd < sz_buf);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+
+        // try to read empty ring buffer
+        REQUIRE(-1 == RBUF_READ(prb, buffer, sizeof(buffer)/sizeof(ITEM_T)));
+
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+        RBUF_RESET(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+    }
+    SECTION("test ring buffer, reset after read write") {
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+
+        // full the ring buffer, after that size()=FULL, spare()=0
+        sz_buf = RBUF_MAX(prb);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(sz_rd == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SIZE(prb));
+        REQUIRE(0 == RBUF_SPARE(prb));
+
+        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
+        sz_buf = RBUF_MAX(prb) * 5 / 6;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        memset(buffer2, 0, sizeof(buffer));
+        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
+        sz_rd = RBUF_READ(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE((RBUF_MAX(prb) - sz_buf) == RBUF_SIZE(prb));
+        REQUIRE(sz_rd == RBUF_SPARE(prb));
+        REQUIRE(RBUF_MAX(prb)*2/12 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb)*10/12 == RBUF_SPARE(prb));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        cur_rd += sz_rd;
+
+        // reset the buffer and check boundary
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+        CIUT_LOG("boundary sz=%d", sizeof(boundary));
+        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
+        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+
+        RBUF_RESET(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+    }
+    SECTION("test ring buffer, partial read write") {
+        cur_val = 0;
+        cur_rd = 0;
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+
+        // full the ring buffer, after that size()=FULL, spare()=0
+        sz_buf = RBUF_MAX(prb);
+        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
+        REQUIRE(sz_buf > 0);
+        memset(buffer, 0, sizeof(buffer));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(sz_rd == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SIZE(prb));
+        REQUIRE(0 == RBUF_SPARE(prb));
+
+        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
+        sz_buf = RBUF_MAX(prb) * 5 / 6;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        memset(buffer2, 0, sizeof(buffer));
+        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
+        sz_rd = RBUF_READ(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE((RBUF_MAX(prb) - sz_buf) == RBUF_SIZE(prb));
+        REQUIRE(sz_rd == RBUF_SPARE(prb));
+        REQUIRE(RBUF_MAX(prb)*2/12 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb)*10/12 == RBUF_SPARE(prb));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        cur_rd += sz_rd;
+
+        // write all, after that size()=6/6, spare()=0/6
+        sz_buf = RBUF_MAX(prb)*2;
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sizeof(buffer_comp)/sizeof(ITEM_T));
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        cur_val += sz_rd;
+        REQUIRE(RBUF_MAX(prb)*12/12 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb)*0/12 == RBUF_SPARE(prb));
+
+        // read 3/6, after that size()=3/6, spare()=3/6
+        sz_buf = RBUF_MAX(prb)*6/12;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        memset(buffer, 0, sizeof(buffer));
+        memset(buffer2, 0, sizeof(buffer));
+        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
+        sz_rd = RBUF_READ(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE(sz_rd == sz_buf);
+        REQUIRE(RBUF_MAX(prb)*6/12 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb)*6/12 == RBUF_SPARE(prb));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        cur_rd += sz_rd;
+
+        // write another 2/6, after that size()=5/6, spare()=1/6
+        sz_buf = RBUF_MAX(prb)*2/6;
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
+        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
+        CIUT_LOG("rbuf_write() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        REQUIRE(sz_rd > 0);
+        REQUIRE(sz_rd == sz_buf);
+        cur_val += sz_rd;
+        REQUIRE(RBUF_MAX(prb)*5/6 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb)*1/6 == RBUF_SPARE(prb));
+
+        // read all of them, after that size()=0, spare()=FULL
+        sz_buf = RBUF_MAX(prb) + 1;
+        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
+        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
+        sz_rd = RBUF_READ(prb, buffer, sz_buf);
+        CIUT_LOG("rbuf_read() return %d", sz_rd);
+        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
+        CIUT_LOG("buf=%s", buffer);
+        REQUIRE(sz_rd > 0);
+        REQUIRE(0 == RBUF_SIZE(prb));
+        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+        REQUIRE(0 == RBUF_SIZE(prb));
+        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        cur_rd += sz_rd;
+
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+        CIUT_LOG("boundary sz=%d", sizeof(boundary));
+        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
+        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+
+        RBUF_RESET(prb);
+        CHECK_BOUNDARY(boundary, prb);
+        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+    }
+}
+
+#if ! defined(ARDUINO)
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#define SPSC_TEST_BYTES (1024 * 1024)
+
+static void *
+rbuf_spsc_test_writer(void * arg)
+{
+    uint8_t buffer[97];
+    size_t cnt = 0;
+    ssize_t ret;
+    uint8_t cur_val = 0;
+
+    while (cnt < SPSC_TEST_BYTES) {
+        if (rbuf_spsc_spare(arg) < 1) {
+            sched_yield();
+            continue;
+        }
+        rbuf_fill_test_buffer(buffer, cur_val, sizeof(buffer));
+        ret = rbuf_spsc_write(arg, buffer, UG_MIN(sizeof(buffer), SPSC_TEST_BYTES - cnt));
+        if (ret > 0) {
+            cur_val += ret;
+            cnt += ret;
+        }
+    }
+    return NULL;
+}
+
+#if defined(__linux__)
+static ring_wait_t * g_spsc_test_wait = NULL;
+static int g_spsc_test_done = 0; // set by the writer after the last byte is written
+
+static void *
+rbuf_spsc_test_writer_wait(void * arg)
+{
+    uint8_t buffer[13];
+    size_t cnt = 0;
+    ssize_t ret;
+    uint8_t cur_val = 0;
+
+    while (cnt < SPSC_TEST_BYTES) {
+        if (rbuf_spsc_spare(arg) < 1) {
+            // sleep until the data falls to the low watermark
+            rbuf_spsc_wait_writable(arg, g_spsc_test_wait, 1000);
+            continue;
+        }
+        rbuf_fill_test_buffer(buffer, cur_val, sizeof(buffer));
+        ret = rbuf_spsc_write(arg, buffer, UG_MIN(sizeof(buffer), SPSC_TEST_BYTES - cnt));
+        if (ret > 0) {
+            cur_val += ret;
+            cnt += ret;
+        }
+        rbuf_spsc_notify_written(arg, g_spsc_test_wait);
+    }
+    RBUF_STORE_RELEASE(g_spsc_test_done, 1);
+    return NULL;
+}
+#endif // __linux__
+#endif // ARDUINO
+
+TEST_CASE( .name="spsc-ring", .description="test SPSC ring buffer.", .skip=0 ) {
+    ring_spsc_t *prb = NULL;
+    uint8_t boundary[rbuf_spsc_occupied_bytes(MAX_SIZE)] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    ssize_t sz_rd = -1;
+    size_t i;
+
+    prb = (ring_spsc_t *) boundary;
+
+    SECTION("test SPSC ring buffer, init") {
+        REQUIRE(-1 == rbuf_spsc_init(prb, 0));
+        REQUIRE(-1 == rbuf_spsc_init(prb, sizeof(ring_spsc_t)));
+        REQUIRE(0 == rbuf_spsc_init(prb, sizeof(ring_spsc_t)+1));
+        REQUIRE(0 == rbuf_spsc_init(prb, sizeof(boundary)));
+        REQUIRE(MAX_SIZE == rbuf_spsc_max(prb));
+        REQUIRE(0 == rbuf_spsc_size(prb));
+        REQUIRE(MAX_SIZE == rbuf_spsc_spare(prb));
+        REQUIRE(-1 == rbuf_spsc_write(prb, NULL, 0));
+        REQUIRE(-1 == rbuf_spsc_write(prb, buffer, 0));
+        REQUIRE(-1 == rbuf_spsc_read(prb, buffer, 0));
+        REQUIRE(-1 == rbuf_spsc_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == rbuf_spsc_forward(prb, 1));
+    }
+
+    SECTION("test SPSC ring buffer, wrap around") {
+        uint8_t cur_val = 0;
+        uint8_t cur_rd = 0;
+        rbuf_spsc_init(prb, sizeof(boundary));
+
+        // fullfill the ring buffer
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sizeof(buffer_comp));
+        sz_rd = rbuf_spsc_write(prb, buffer_comp, sizeof(buffer_comp));
+        REQUIRE(MAX_SIZE == sz_rd);
+        cur_val += sz_rd;
+        REQUIRE(0 == rbuf_spsc_spare(prb));
+        REQUIRE(-1 == rbuf_spsc_write(prb, buffer_comp, 1));
+
+        // the positions pass the end of the buffer several times
+        for (i = 0; i < MAX_SIZE * 3; i ++) {
+            sz_rd = rbuf_spsc_peek(prb, 1, buffer, 2);
+            REQUIRE(2 == sz_rd);
+            REQUIRE((uint8_t)(cur_rd + 1) == buffer[0]);
+            sz_rd = rbuf_spsc_read(prb, buffer, 5);
+            REQUIRE(5 == sz_rd);
+            rbuf_fill_test_buffer(buffer_comp, cur_rd, 5);
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 5));
+            cur_rd += 5;
+            REQUIRE(MAX_SIZE - 5 == rbuf_spsc_size(prb));
+
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 5);
+            sz_rd = rbuf_spsc_write(prb, buffer_comp, 5);
+            REQUIRE(5 == sz_rd);
+            cur_val += 5;
+            REQUIRE(MAX_SIZE == rbuf_spsc_size(prb));
+        }
+        REQUIRE(MAX_SIZE == rbuf_spsc_forward(prb, MAX_SIZE * 2));
+        REQUIRE(0 == rbuf_spsc_size(prb));
+        rbuf_spsc_reset(prb);
+        REQUIRE(MAX_SIZE == rbuf_spsc_max(prb));
+        REQUIRE(MAX_SIZE == rbuf_spsc_spare(prb));
+    }
+
+#if ! defined(ARDUINO)
+    SECTION("test SPSC ring buffer, two threads") {
+        pthread_t thr;
+        size_t cnt = 0;
+        uint8_t cur_rd = 0;
+        rbuf_spsc_init(prb, sizeof(boundary));
+        REQUIRE(0 == pthread_create(&thr, NULL, rbuf_spsc_test_writer, prb));
+        while (cnt < SPSC_TEST_BYTES) {
+            if (rbuf_spsc_size(prb) < 1) {
+                sched_yield();
+                continue;
+            }
+            sz_rd = rbuf_spsc_read(prb, buffer, sizeof(buffer));
+            REQUIRE(sz_rd > 0);
+            for (i = 0; i < (size_t)sz_rd; i ++) {
+                REQUIRE(cur_rd == buffer[i]);
+                cur_rd ++;
+            }
+            cnt += sz_rd;
+        }
+        pthread_join(thr, NULL);
+        REQUIRE(0 == rbuf_spsc_size(prb));
+    }
+#endif // ARDUINO
+
+#if defined(__linux__)
+    SECTION("test SPSC ring buffer, wait with watermarks") {
+        pthread_t thr;
+        ring_wait_t wt;
+        size_t cnt;
+        uint8_t cur_rd;
+        int flg_eventfd;
+
+        for (flg_eventfd = 0; flg_eventfd < 2; flg_eventfd ++) {
+            rbuf_spsc_init(prb, sizeof(boundary));
+            REQUIRE(0 == rbuf_wait_init(&wt, MAX_SIZE / 4, MAX_SIZE / 2, flg_eventfd));
+            REQUIRE((flg_eventfd?1:0) == (rbuf_wait_fd_readable(&wt) >= 0));
+
+            // nothing to be woken
+            REQUIRE(0 == rbuf_spsc_wait_writable(prb, &wt, 0));
+            REQUIRE(-1 == rbuf_spsc_wait_readable(prb, &wt, 10));
+            REQUIRE(ETIMEDOUT == errno);
+            REQUIRE(1 == rbuf_spsc_write(prb, buffer, 1));
+            rbuf_spsc_notify_written(prb, &wt);
+            REQUIRE(-1 == rbuf_spsc_wait_readable(prb, &wt, 0));
+            REQUIRE(1 == rbuf_spsc_forward(prb, 1));
+
+            g_spsc_test_wait = &wt;
+            g_spsc_test_done = 0;
+            REQUIRE(0 == pthread_create(&thr, NULL, rbuf_spsc_test_writer_wait, prb));
+            cnt = 0;
+            cur_rd = 0;
+            while (cnt < SPSC_TEST_BYTES) {
+                if (rbuf_spsc_wait_readable(prb, &wt, 100) < 0) {
+                    if (0 == RBUF_LOAD_ACQUIRE(g_spsc_test_done)) {
+                        // the writer is slow, not finished
+                        continue;
+                    }
+                    // only the tail of the data is below the watermark
+                    REQUIRE(cnt + rbuf_spsc_size(prb) == SPSC_TEST_BYTES);
+                }
+                // it may be below the watermark if the writer is waiting too
+                REQUIRE(rbuf_spsc_size(prb) > 0);
+                sz_rd = rbuf_spsc_read(prb, buffer, sizeof(buffer));
+                REQUIRE(sz_rd > 0);
+                rbuf_spsc_notify_read(prb, &wt);
+                for (i = 0; i < (size_t)sz_rd; i ++) {
+                    REQUIRE(cur_rd == buffer[i]);
+                    cur_rd ++;
+                }
+                cnt += sz_rd;
+            }
+            pthread_join(thr, NULL);
+            rbuf_wait_destroy(&wt);
+            REQUIRE(-1 == rbuf_wait_fd_readable(&wt));
+        }
+    }
+#endif // __linux__
+}
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+#include <sys/wait.h>
+
+TEST_CASE( .name="shm-ring", .description="test SPSC ring buffer in shared memory.", .skip=0 ) {
+    void *prb = NULL;
+    void *prb2 = NULL;
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    int fd;
+
+    SECTION("test shared memory ring buffer, mapped twice") {
+        char name[64];
+
+        snprintf(name, sizeof(name), "/ringbuffer-test-%d", (int)getpid());
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        REQUIRE(fd >= 0);
+        // not created yet
+        REQUIRE(NULL == rbuf_shm_attach(fd));
+        REQUIRE(NULL == rbuf_shm_create(fd, 0));
+        prb = rbuf_shm_create(fd, 100);
+        REQUIRE(NULL != prb);
+        REQUIRE(100 == rbuf_spsc_max(prb));
+        close(fd);
+
+        fd = shm_open(name, O_RDWR, 0600);
+        REQUIRE(fd >= 0);
+        prb2 = rbuf_shm_attach(fd);
+        close(fd);
+        shm_unlink(name);
+        REQUIRE(NULL != prb2);
+        REQUIRE(prb != prb2);
+        REQUIRE(100 == rbuf_spsc_max(prb2));
+
+        rbuf_fill_test_buffer(buffer_comp, 0, 80);
+        REQUIRE(80 == rbuf_spsc_write(prb, buffer_comp, 80));
+        REQUIRE(80 == rbuf_spsc_size(prb2));
+        REQUIRE(50 == rbuf_spsc_read(prb2, buffer, 50));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 50));
+        // wrap around
+        rbuf_fill_test_buffer(buffer_comp + 80, 80, 60);
+        REQUIRE(60 == rbuf_spsc_write(prb, buffer_comp + 80, 60));
+        REQUIRE(90 == rbuf_spsc_read(prb2, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp + 50, 90));
+
+        rbuf_shm_detach(prb2);
+        rbuf_shm_detach(prb);
+    }
+
+#if defined(MFD_CLOEXEC)
+    SECTION("test shared memory ring buffer, writer process") {
+        size_t cnt = 0;
+        ssize_t ret;
+        uint8_t cur_val = 0;
+        int status;
+        pid_t pid;
+        size_t i;
+
+        fd = memfd_create("ringbuffer-test", 0);
+        REQUIRE(fd >= 0);
+        prb = rbuf_shm_create(fd, 4096);
+        REQUIRE(NULL != prb);
+
+        pid = fork();
+        REQUIRE(pid >= 0);
+        if (0 == pid) {
+            // the child maps the inherited object at its own address
+            prb2 = rbuf_shm_attach(fd);
+            if (NULL == prb2) {
+                _exit(1);
+            }
+            while (cnt < SPSC_TEST_BYTES) {
+                rbuf_fill_test_buffer(buffer, cur_val, 113);
+                ret = rbuf_spsc_write(prb2, buffer, UG_MIN(113, SPSC_TEST_BYTES - cnt));
+                if (ret < 1) {
+                    sched_yield();
+                    continue;
+                }
+                cur_val += ret;
+                cnt += ret;
+            }
+            _exit(0);
+        }
+        close(fd);
+        while (cnt < SPSC_TEST_BYTES) {
+            ret = rbuf_spsc_read(prb, buffer, sizeof(buffer));
+            if (ret < 1) {
+                sched_yield();
+                continue;
+            }
+            for (i = 0; i < (size_t)ret; i ++) {
+                REQUIRE(cur_val == buffer[i]);
+                cur_val ++;
+            }
+            cnt += ret;
+        }
+        REQUIRE(pid == waitpid(pid, &status, 0));
+        REQUIRE(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+        REQUIRE(0 == rbuf_spsc_size(prb));
+        rbuf_shm_detach(prb);
+    }
+#endif // MFD_CLOEXEC
+}
+#endif // ARDUINO _WIN32
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+TEST_CASE( .name="file-ring", .description="test ring buffer stored in a file.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    ring_file_t *phdr = NULL;
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    char path[64];
+
+    snprintf(path, sizeof(path), "/tmp/ringbuffer-test-%d.rbuf", (int)getpid());
+    unlink(path);
+
+    SECTION("test file ring buffer, reopen") {
+        REQUIRE(NULL == rbuf_file_open(path, 0));
+        prb = rbuf_file_open(path, 100);
+        REQUIRE(NULL != prb);
+        REQUIRE(100 == rbuf_max(prb));
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(! rbuf_is_mirrored(prb));
+
+        rbuf_fill_test_buffer(buffer_comp, 0, 90);
+        REQUIRE(90 == rbuf_write(prb, buffer_comp, 90));
+        REQUIRE(60 == rbuf_read(prb, buffer, 60));
+        // wrap around
+        rbuf_fill_test_buffer(buffer_comp + 90, 90, 50);
+        REQUIRE(50 == rbuf_write(prb, buffer_comp + 90, 50));
+        REQUIRE(0 == rbuf_file_sync(prb, 0));
+        rbuf_file_close(prb);
+
+        // the capacity of the file is kept
+        prb = rbuf_file_open(path, 200);
+        REQUIRE(NULL != prb);
+        REQUIRE(100 == rbuf_max(prb));
+        REQUIRE(80 == rbuf_size(prb));
+        REQUIRE(80 == rbuf_peek(prb, 0, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp + 60, 80));
+
+        // broken positions
+        prb->pos_read = prb->sz_buf;
+        rbuf_file_close(prb);
+        prb = rbuf_file_open(path, 100);
+        REQUIRE(NULL != prb);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(100 == rbuf_spare(prb));
+
+        // not a ring buffer
+        phdr = (ring_file_t *)prb - 1;
+        phdr->version = RBUF_FILE_VERSION + 1;
+        rbuf_file_close(prb);
+        REQUIRE(NULL == rbuf_file_open(path, 100));
+    }
+
+#if ! defined(ARDUINO)
+    SECTION("test file ring buffer, crash of the writer") {
+        size_t cnt;
+        int status;
+        pid_t pid;
+
+        pid = fork();
+        REQUIRE(pid >= 0);
+        if (0 == pid) {
+            prb = rbuf_file_open(path, 1000);
+            if (NULL == prb) {
+                _exit(1);
+            }
+            // keep the latest data
+            for (cnt = 0; cnt < 5000; cnt += 100) {
+                rbuf_fill_test_buffer(buffer, cnt, 100);
+                if (rbuf_spare(prb) < 100) {
+                    rbuf_forward(prb, 100);
+                }
+                rbuf_write(prb, buffer, 100);
+            }
+            // no close or sync
+            abort();
+        }
+        REQUIRE(pid == waitpid(pid, &status, 0));
+        REQUIRE(WIFSIGNALED(status));
+
+        prb = rbuf_file_open(path, 1000);
+        REQUIRE(NULL != prb);
+        REQUIRE(1000 == rbuf_size(prb));
+        REQUIRE(100 == rbuf_read(prb, buffer, 100));
+        // the first chunk kept is the one written at cnt 5000 - 1000
+        rbuf_fill_test_buffer(buffer_comp, (uint8_t)(5000 - 1000), 100);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 100));
+        rbuf_file_close(prb);
+    }
+#endif // ARDUINO
+    unlink(path);
+}
+#endif // ARDUINO _WIN32
+
+TEST_CASE( .name="pow2-ring", .description="test power-of-two ring buffer.", .skip=0 ) {
+    ring_pow2_t *prb = NULL;
+    uint8_t boundary[RBUF_POW2_OCCUPIED_BYTES(64, 3) + 3*2] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer2[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    uint8_t cur_val = 0;
+    uint8_t cur_rd = 0;
+    ssize_t sz_rd = -1;
+    size_t i;
+
+    prb = (ring_pow2_t *) boundary;
+
+    SECTION("test power-of-two ring buffer, init") {
+        REQUIRE(-1 == rbuf_pow2_init(prb, sizeof(ring_pow2_t), 1));
+        REQUIRE(-1 == rbuf_pow2_init(prb, sizeof(boundary), 0));
+        REQUIRE(0 == rbuf_pow2_init(prb, sizeof(ring_pow2_t) + 1, 1));
+        REQUIRE(1 == rbuf_pow2_max(prb));
+        REQUIRE(0 == rbuf_pow2_init(prb, RBUF_POW2_OCCUPIED_BYTES(64, 1) - 1, 1));
+        REQUIRE(32 == rbuf_pow2_max(prb));
+        REQUIRE(0 == rbuf_pow2_init(prb, sizeof(boundary), 3));
+        REQUIRE(64 == rbuf_pow2_max(prb));
+        REQUIRE(0 == rbuf_pow2_size(prb));
+        REQUIRE(64 == rbuf_pow2_spare(prb));
+        REQUIRE(-1 == rbuf_pow2_write(prb, NULL, 0));
+        REQUIRE(-1 == rbuf_pow2_write(prb, buffer, 0));
+        REQUIRE(-1 == rbuf_pow2_read(prb, buffer, 1));
+        REQUIRE(0 == rbuf_pow2_forward(prb, 1));
+    }
+
+    SECTION("test power-of-two ring buffer, byte items") {
+        REQUIRE(0 == rbuf_pow2_init(prb, RBUF_POW2_OCCUPIED_BYTES(64, 1), 1));
+        REQUIRE(64 == rbuf_pow2_max(prb));
+
+        // all of the slots are used
+        rbuf_fill_test_buffer(buffer_comp, cur_val, sizeof(buffer_comp));
+        sz_rd = rbuf_pow2_write(prb, buffer_comp, sizeof(buffer_comp));
+        REQUIRE(64 == sz_rd);
+        cur_val += sz_rd;
+        REQUIRE(64 == rbuf_pow2_size(prb));
+        REQUIRE(0 == rbuf_pow2_spare(prb));
+        REQUIRE(-1 == rbuf_pow2_write(prb, buffer_comp, 1));
+
+        for (i = 0; i < 64 * 3; i ++) {
+            sz_rd = rbuf_pow2_peek(prb, 60, buffer2, 10);
+            REQUIRE(4 == sz_rd);
+            REQUIRE((uint8_t)(cur_rd + 60) == buffer2[0]);
+            sz_rd = rbuf_pow2_read(prb, buffer, 7);
+            REQUIRE(7 == sz_rd);
+            rbuf_fill_test_buffer(buffer_comp, cur_rd, 7);
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 7));
+            cur_rd += 7;
+
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 7);
+            REQUIRE(7 == rbuf_pow2_write(prb, buffer_comp, 7));
+            cur_val += 7;
+            REQUIRE(64 == rbuf_pow2_size(prb));
+        }
+        REQUIRE(64 == rbuf_pow2_forward(prb, 100));
+        REQUIRE(0 == rbuf_pow2_size(prb));
+    }
+
+    SECTION("test power-of-two ring buffer, multi-byte items") {
+        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
+        REQUIRE(0 == rbuf_pow2_init(prb, RBUF_POW2_OCCUPIED_BYTES(64, 3), 3));
+        // the counters pass the 32-bit boundary
+        prb->pos_read = prb->pos_write = 0xFFFFFFF0UL;
+
+        for (i = 0; i < 64; i ++) {
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 3 * 50);
+            REQUIRE(50 == rbuf_pow2_write(prb, buffer_comp, 50));
+            cur_val += 3 * 50;
+            REQUIRE(50 == rbuf_pow2_size(prb));
+            REQUIRE(50 == rbuf_pow2_read(prb, buffer, 64));
+            rbuf_fill_test_buffer(buffer_comp, cur_rd, 3 * 50);
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 3 * 50));
+            cur_rd += 3 * 50;
+        }
+        REQUIRE(prb->pos_write > 0xFFFFFFFFUL);
+        REQUIRE(0 == rbuf_pow2_size(prb));
+        CHECK_BOUNDARY((char *)(prb) + RBUF_POW2_OCCUPIED_BYTES(64, 3), ((char *)boundary + sizeof(boundary)));
+        rbuf_pow2_reset(prb);
+        REQUIRE(64 == rbuf_pow2_spare(prb));
+    }
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+    SECTION("test power-of-two ring buffer, huge pages") {
+        REQUIRE(NULL == rbuf_pow2_create_huge(0, 3, 0));
+        REQUIRE(NULL == rbuf_pow2_create_huge(100, 0, 0));
+        // the slots are rounded up, the mapping has more than one huge page
+        prb = (ring_pow2_t *)rbuf_pow2_create_huge(RBUF_HUGE_PAGE_SIZE / 2 + 1, 3, 1);
+        REQUIRE(NULL != prb);
+        REQUIRE(0 == ((uintptr_t)prb % RBUF_HUGE_PAGE_SIZE));
+        REQUIRE(RBUF_HUGE_PAGE_SIZE == rbuf_pow2_max(prb));
+        REQUIRE(3 == prb->item_size);
+        // start near the end of the 32-bit range of items
+        prb->pos_read = prb->pos_write = 0x7FFFFFFFUL - 10;
+        rbuf_fill_test_buffer(buffer_comp, 0, 3 * 50);
+        for (i = 0; i < 10; i ++) {
+            REQUIRE(50 == rbuf_pow2_write(prb, buffer_comp, 50));
+        }
+        REQUIRE(500 == rbuf_pow2_size(prb));
+        REQUIRE(prb->pos_write > 0x7FFFFFFFUL);
+        for (i = 0; i < 10; i ++) {
+            REQUIRE(50 == rbuf_pow2_read(prb, buffer, 50));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 3 * 50));
+        }
+        rbuf_pow2_destroy_huge(prb);
+
+        prb = (ring_pow2_t *)rbuf_pow2_create_huge(64, 3, 0);
+        REQUIRE(NULL != prb);
+        REQUIRE(64 == rbuf_pow2_max(prb));
+        REQUIRE(0 == rbuf_pow2_size(prb));
+        rbuf_pow2_destroy_huge(prb);
+    }
+#endif // ARDUINO _WIN32
+}
+
+TEST_CASE( .name="ring-buffer-resize", .description="test resizing ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    ring_buffer_t *prb2 = NULL;
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    size_t i;
+
+    SECTION("test ring buffer, resize") {
+        REQUIRE(NULL == rbuf_create(0));
+        prb = rbuf_create(16);
+        REQUIRE(NULL != prb);
+        REQUIRE(16 == rbuf_max(prb));
+
+        // the data wraps
+        rbuf_fill_test_buffer(buffer_comp, 0, 30);
+        REQUIRE(10 == rbuf_write(prb, buffer_comp, 10));
+        REQUIRE(8 == rbuf_read(prb, buffer, 8));
+        REQUIRE(12 == rbuf_write(prb, buffer_comp + 10, 12));
+        REQUIRE(14 == rbuf_size(prb));
+
+        REQUIRE(NULL == rbuf_resize(prb, 13));
+        prb = rbuf_resize(prb, 64);
+        REQUIRE(NULL != prb);
+        REQUIRE(64 == rbuf_max(prb));
+        REQUIRE(14 == rbuf_size(prb));
+        REQUIRE(8 == rbuf_write(prb, buffer_comp + 22, 8));
+        prb = rbuf_resize(prb, 22);
+        REQUIRE(NULL != prb);
+        REQUIRE(0 == rbuf_spare(prb));
+        REQUIRE(22 == rbuf_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp + 8, 22));
+        rbuf_destroy(prb);
+    }
+
+    SECTION("test ring buffer, grow and shrink") {
+        prb = rbuf_create(8);
+        REQUIRE(NULL != prb);
+        rbuf_fill_test_buffer(buffer_comp, 0, 200);
+        REQUIRE(5 == rbuf_write_grow(&prb, buffer_comp, 5, 100));
+        REQUIRE(8 == rbuf_max(prb));
+        REQUIRE(3 == rbuf_read(prb, buffer, 3));
+        // grow by doubling
+        REQUIRE(20 == rbuf_write_grow(&prb, buffer_comp + 5, 20, 100));
+        REQUIRE(32 == rbuf_max(prb));
+        // the hard cap
+        REQUIRE(100 - 22 == rbuf_write_grow(&prb, buffer_comp + 25, 150, 100));
+        REQUIRE(100 == rbuf_max(prb));
+        REQUIRE(-1 == rbuf_write_grow(&prb, buffer_comp, 1, 100));
+        REQUIRE(0 == rbuf_shrink_idle(&prb, 8));
+
+        for (i = 3; i < 103; i += sizeof(buffer) / 2) {
+            REQUIRE(UG_MIN(sizeof(buffer) / 2, 103 - i) == rbuf_read(prb, buffer, sizeof(buffer) / 2));
+            REQUIRE(0 == memcmp(buffer, buffer_comp + i, UG_MIN(sizeof(buffer) / 2, 103 - i)));
+        }
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(5 == rbuf_write(prb, buffer_comp, 5));
+        REQUIRE(1 == rbuf_shrink_idle(&prb, 30));
+        REQUIRE(50 == rbuf_max(prb));
+        REQUIRE(1 == rbuf_shrink_idle(&prb, 8));
+        REQUIRE(12 == rbuf_max(prb));
+        REQUIRE(0 == rbuf_shrink_idle(&prb, 8));
+        REQUIRE(5 == rbuf_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 5));
+
+        // the same size, nothing is moved
+        prb2 = rbuf_resize(prb, rbuf_max(prb));
+        REQUIRE(prb == prb2);
+        rbuf_destroy(prb);
+    }
+}
+
+TEST_CASE( .name="ring-buffer-pool", .description="test pool of ring buffers.", .skip=0 ) {
+    static const size_t data_sizes[] = { 16, 100, 1000 };
+    static const size_t counts[] = { 3, 2, 1 };
+    static const size_t sizes_bad[] = { 100, 16 };
+    void * pool[(RBUF_POOL_BLOCK_SIZE(16) * 3 + RBUF_POOL_BLOCK_SIZE(100) * 2 + RBUF_POOL_BLOCK_SIZE(1000) + sizeof(ring_pool_t)) / sizeof(void *)];
+    ring_buffer_t *rbs[6];
+    ring_pool_usage_t usage;
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    size_t i;
+
+    SECTION("test pool of ring buffers") {
+        REQUIRE(sizeof(pool) == rbuf_pool_occupied_bytes(data_sizes, counts, NUM_ARRAY(data_sizes)));
+        REQUIRE(-1 == rbuf_pool_init(pool, sizeof(pool) - 1, data_sizes, counts, NUM_ARRAY(data_sizes)));
+        REQUIRE(-1 == rbuf_pool_init(pool, sizeof(pool), sizes_bad, counts, NUM_ARRAY(sizes_bad)));
+        REQUIRE(-1 == rbuf_pool_init(pool, sizeof(pool), data_sizes, counts, 0));
+        REQUIRE(0 == rbuf_pool_init(pool, sizeof(pool), data_sizes, counts, NUM_ARRAY(data_sizes)));
+        REQUIRE(3 == rbuf_pool_classes(pool));
+        REQUIRE(-1 == rbuf_pool_usage(pool, 3, &usage));
+
+        // the smallest class which fits
+        rbs[0] = rbuf_pool_get(pool, 10);
+        REQUIRE(NULL != rbs[0]);
+        REQUIRE(16 == rbuf_max(rbs[0]));
+        REQUIRE(0 == rbuf_size(rbs[0]));
+        rbs[1] = rbuf_pool_get(pool, 16);
+        rbs[2] = rbuf_pool_get(pool, 1);
+        REQUIRE(NULL != rbs[1] && NULL != rbs[2]);
+        REQUIRE(rbs[0] != rbs[1] && rbs[1] != rbs[2] && rbs[0] != rbs[2]);
+        // the class is used up, a larger one is given
+        rbs[3] = rbuf_pool_get(pool, 16);
+        REQUIRE(NULL != rbs[3]);
+        REQUIRE(100 == rbuf_max(rbs[3]));
+        rbs[4] = rbuf_pool_get(pool, 100);
+        REQUIRE(NULL != rbs[4]);
+        rbs[5] = rbuf_pool_get(pool, 100);
+        REQUIRE(NULL != rbs[5]);
+        REQUIRE(1000 == rbuf_max(rbs[5]));
+        REQUIRE(NULL == rbuf_pool_get(pool, 100));
+        REQUIRE(NULL == rbuf_pool_get(pool, 1001));
+
+        REQUIRE(0 == rbuf_pool_usage(pool, 0, &usage));
+        REQUIRE(16 == usage.data_size);
+        REQUIRE(3 == usage.num_blocks);
+        REQUIRE(3 == usage.num_used);
+        REQUIRE(3 == usage.high_water);
+        REQUIRE(1 == usage.cnt_fail);
+        REQUIRE(0 == rbuf_pool_usage(pool, 1, &usage));
+        REQUIRE(2 == usage.num_used);
+        REQUIRE(2 == usage.cnt_fail);
+        REQUIRE(0 == rbuf_pool_usage(pool, 2, &usage));
+        REQUIRE(1 == usage.num_used);
+        REQUIRE(0 == usage.cnt_fail);
+
+        // the blocks do not overlap
+        rbuf_fill_test_buffer(buffer_comp, 0, sizeof(buffer_comp));
+        for (i = 0; i < NUM_ARRAY(rbs); i ++) {
+            REQUIRE(UG_MIN(rbuf_max(rbs[i]), MAX_BUFFER_SEGMENT - i) == (size_t)rbuf_write(rbs[i], buffer_comp + i, MAX_BUFFER_SEGMENT - i));
+        }
+        for (i = 0; i < NUM_ARRAY(rbs); i ++) {
+            REQUIRE(UG_MIN(rbuf_max(rbs[i]), MAX_BUFFER_SEGMENT - i) == (size_t)rbuf_read(rbs[i], buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp + i, UG_MIN(rbuf_max(rbs[i]), MAX_BUFFER_SEGMENT - i)));
+        }
+
+        // the returned block is reused and initialized again
+        REQUIRE(5 == rbuf_write(rbs[1], buffer_comp, 5));
+        rbuf_pool_put(pool, rbs[1]);
+        rbuf_pool_put(pool, NULL);
+        REQUIRE(rbs[1] == rbuf_pool_get(pool, 2));
+        REQUIRE(0 == rbuf_size(rbs[1]));
+        for (i = 0; i < NUM_ARRAY(rbs); i ++) {
+            rbuf_pool_put(pool, rbs[i]);
+        }
+        for (i = 0; i < rbuf_pool_classes(pool); i ++) {
+            REQUIRE(0 == rbuf_pool_usage(pool, i, &usage));
+            REQUIRE(0 == usage.num_used);
+            REQUIRE(usage.num_blocks == usage.high_water);
+        }
+    }
+}
+
+static ssize_t
+cb_short_peek (void * userdata, size_t sz_max, size_t off_target, uint8_t * buf, size_t sz_buf)
+{
+    return sz_buf - 1;
+}
+
+TEST_CASE( .name="ring-buffer-stats", .description="test statistics of ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    uint8_t boundary[rbuf_occupied_bytes(MAX_SIZE)];
+    uint8_t macro_ring[RBUF_OCCUPIED_BYTES(MAX_SIZE + 1, sizeof(int))];
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    int items[MAX_SIZE];
+    ring_stats_t st;
+
+    prb = (ring_buffer_t *) boundary;
+    memset(buffer, 0, sizeof(buffer));
+    memset(items, 0, sizeof(items));
+
+    SECTION("test ring buffer, statistics") {
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(-1 == rbuf_read(prb, buffer, 10));
+        REQUIRE(30 == rbuf_write(prb, buffer, 30));
+        REQUIRE(20 == rbuf_read(prb, buffer, 20));
+        REQUIRE(MAX_SIZE - 10 == rbuf_write(prb, buffer, MAX_SIZE));
+        REQUIRE(-1 == rbuf_write(prb, buffer, 1));
+        REQUIRE(0 == rbuf_peek_cb(prb, 0, 10, NULL, cb_short_peek));
+        REQUIRE(5 == rbuf_consume(prb, 5));
+#if RBUF_WITH_STATS
+        REQUIRE(0 == rbuf_stats(prb, &st));
+        REQUIRE(MAX_SIZE == st.high_water);
+        REQUIRE(30 + MAX_SIZE - 10 == st.total_in);
+        REQUIRE(25 == st.total_out);
+        REQUIRE(1 == st.cnt_full);
+        REQUIRE(1 == st.cnt_empty);
+        REQUIRE(1 == st.cnt_truncated);
+        REQUIRE(1 == st.cnt_short_cb);
+#else
+        REQUIRE(-1 == rbuf_stats(prb, &st));
+        REQUIRE(0 == st.total_in);
+#endif
+    }
+
+    SECTION("test macro ring buffer, statistics") {
+        RBUF_INIT(macro_ring, sizeof(macro_ring), sizeof(int));
+        REQUIRE(MAX_SIZE == RBUF_MAX(macro_ring));
+        REQUIRE(-1 == RBUF_READ(macro_ring, items, 1));
+        REQUIRE(10 == RBUF_WRITE(macro_ring, items, 10));
+        REQUIRE(4 == RBUF_READ(macro_ring, items, 4));
+        REQUIRE(MAX_SIZE - 6 == RBUF_WRITE(macro_ring, items, MAX_SIZE));
+        REQUIRE(-1 == RBUF_WRITE(macro_ring, items, 1));
+#if RBUF_WITH_STATS
+        REQUIRE(0 == RBUF_GET_STATS(macro_ring, &st));
+        REQUIRE(MAX_SIZE == st.high_water);
+        REQUIRE(MAX_SIZE + 4 == st.total_in);
+        REQUIRE(4 == st.total_out);
+        REQUIRE(1 == st.cnt_full);
+        REQUIRE(1 == st.cnt_empty);
+        REQUIRE(1 == st.cnt_truncated);
+        RBUF_RESET(macro_ring);
+        REQUIRE(0 == RBUF_GET_STATS(macro_ring, &st));
+        REQUIRE(0 == st.total_in);
+#else
+        REQUIRE(-1 == RBUF_GET_STATS(macro_ring, &st));
+#endif
+    }
+}
+
+TEST_CASE( .name="ring-buffer-zero-copy", .description="test zero-copy access of ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    uint8_t boundary[rbuf_occupied_bytes(MAX_SIZE)];
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    uint8_t cur_val = 0;
+    uint8_t cur_rd = 0;
+    size_t i;
+
+    prb = (ring_buffer_t *) boundary;
+
+    SECTION("test ring buffer, reserve and commit") {
+        uint8_t *seg1;
+        uint8_t *seg2;
+        size_t len1;
+        size_t len2;
+
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(MAX_SIZE == rbuf_max(prb));
+        REQUIRE(-1 == rbuf_reserve(prb, 0, &seg1, &len1, &seg2, &len2));
+        REQUIRE(-1 == rbuf_commit(prb, MAX_SIZE + 1));
+
+        REQUIRE(MAX_SIZE == rbuf_reserve(prb, MAX_SIZE * 2, &seg1, &len1, &seg2, &len2));
+        REQUIRE(MAX_SIZE == len1 + len2);
+        // nothing is visible before commit
+        REQUIRE(0 == rbuf_size(prb));
+
+        for (i = 0; i < MAX_SIZE * 3; i ++) {
+            // write in place at different positions, some of them wrap
+            REQUIRE(11 == rbuf_reserve(prb, 11, &seg1, &len1, &seg2, &len2));
+            REQUIRE(11 == len1 + len2);
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 11);
+            memcpy(seg1, buffer_comp, len1);
+            memcpy(seg2, buffer_comp + len1, len2);
+            REQUIRE(11 == rbuf_commit(prb, 11));
+            cur_val += 11;
+            REQUIRE(11 == rbuf_size(prb));
+
+            REQUIRE(11 == rbuf_read(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 11));
+            cur_rd += 11;
+        }
+        REQUIRE(cur_rd == cur_val);
+
+        // partial commit
+        REQUIRE(MAX_SIZE == rbuf_reserve(prb, MAX_SIZE, &seg1, &len1, &seg2, &len2));
+        REQUIRE(0 == rbuf_commit(prb, 0));
+        REQUIRE(1 == rbuf_commit(prb, 1));
+        REQUIRE(1 == rbuf_size(prb));
+        REQUIRE(MAX_SIZE - 1 == rbuf_reserve(prb, MAX_SIZE, &seg1, &len1, &seg2, &len2));
+        REQUIRE(MAX_SIZE - 1 == rbuf_commit(prb, MAX_SIZE - 1));
+        REQUIRE(-1 == rbuf_reserve(prb, 1, &seg1, &len1, &seg2, &len2));
     }
 
-    SECTION("test ring buffer, parameters") {
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(-1 == rbuf_write(prb, NULL, 0));
-        REQUIRE(-1 == rbuf_write(prb, buffer, 0));
-        REQUIRE(-1 == rbuf_read(prb, NULL, 0));
-        REQUIRE(-1 == rbuf_read(prb, buffer, 0));
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
-        rbuf_reset(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    SECTION("test ring buffer, peek iov and consume") {
+        struct iovec iov[2];
+        int cnt;
+
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(-1 == rbuf_peek_iov(prb, 0, 0, iov));
+        REQUIRE(0 == rbuf_peek_iov(prb, 0, MAX_SIZE, iov));
+        REQUIRE(-1 == rbuf_consume(prb, 1));
+        REQUIRE(0 == rbuf_consume(prb, 0));
+
+        for (i = 0; i < MAX_SIZE * 3; i ++) {
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 13);
+            REQUIRE(13 == rbuf_write(prb, buffer_comp, 13));
+            cur_val += 13;
+
+            // the view at an offset
+            cnt = rbuf_peek_iov(prb, 3, 100, iov);
+            REQUIRE(cnt >= 1 && cnt <= 2);
+            REQUIRE(10 == iov[0].iov_len + ((cnt > 1)?iov[1].iov_len:0));
+            REQUIRE((uint8_t)(cur_rd + 3) == *(uint8_t *)(iov[0].iov_base));
+            REQUIRE(0 == rbuf_peek_iov(prb, 13, 1, iov));
+
+            // the whole data
+            cnt = rbuf_peek_iov(prb, 0, 100, iov);
+            REQUIRE(cnt >= 1 && cnt <= 2);
+            memcpy(buffer, iov[0].iov_base, iov[0].iov_len);
+            if (cnt > 1) {
+                REQUIRE(iov[1].iov_base == prb->buf1);
+                memcpy(buffer + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+            }
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 13));
+            REQUIRE(13 == rbuf_consume(prb, 13));
+            cur_rd += 13;
+            REQUIRE(0 == rbuf_size(prb));
+        }
     }
 
-    SECTION("test ring buffer, basic forward") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
-        REQUIRE(0 == rbuf_forward(prb, 1));
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+    SECTION("test ring buffer, fill from fd and drain to fd") {
+        int fds[2];
+        ssize_t ret;
+
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(0 == pipe(fds));
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+        REQUIRE(-1 == rbuf_fill_from_fd(prb, fds[0], MAX_SIZE));
+        REQUIRE(EAGAIN == errno);
+        REQUIRE(0 == rbuf_drain_to_fd(prb, fds[1], MAX_SIZE));
+
+        for (i = 0; i < MAX_SIZE; i ++) {
+            // the data goes pipe -> ring -> pipe -> ring, the positions wrap
+            rbuf_fill_test_buffer(buffer_comp, cur_val, 17);
+            REQUIRE(17 == write(fds[1], buffer_comp, 17));
+            cur_val += 17;
+            REQUIRE(17 == rbuf_fill_from_fd(prb, fds[0], MAX_SIZE));
+            REQUIRE(17 == rbuf_size(prb));
+            REQUIRE(17 == rbuf_drain_to_fd(prb, fds[1], MAX_SIZE));
+            REQUIRE(0 == rbuf_size(prb));
+            REQUIRE(17 == rbuf_fill_from_fd(prb, fds[0], MAX_SIZE));
+            REQUIRE(17 == rbuf_read(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 17));
+        }
+
+        // the ring is full
+        memset(buffer_comp, 0, sizeof(buffer_comp));
+        REQUIRE(MAX_SIZE + 5 == write(fds[1], buffer_comp, MAX_SIZE + 5));
+        REQUIRE(7 == rbuf_fill_from_fd(prb, fds[0], 7));
+        REQUIRE(MAX_SIZE - 7 == rbuf_fill_from_fd(prb, fds[0], MAX_SIZE));
+        REQUIRE(-1 == rbuf_fill_from_fd(prb, fds[0], MAX_SIZE));
+        REQUIRE(ENOBUFS == errno);
+        REQUIRE(MAX_SIZE == rbuf_drain_to_fd(prb, fds[1], MAX_SIZE * 2));
+        ret = read(fds[0], buffer, sizeof(buffer));
+        REQUIRE(MAX_SIZE + 5 == ret);
+
+        // the reader end is closed
+        close(fds[0]);
+        signal(SIGPIPE, SIG_IGN);
         REQUIRE(1 == rbuf_write(prb, buffer, 1));
+        REQUIRE(-1 == rbuf_drain_to_fd(prb, fds[1], MAX_SIZE));
+        REQUIRE(EPIPE == errno);
         REQUIRE(1 == rbuf_size(prb));
-        REQUIRE(1 == rbuf_forward(prb, 1));
+        close(fds[1]);
+    }
+#endif // ARDUINO _WIN32
+
+    SECTION("test ring buffer, find in place") {
+        const uint8_t delim[] = "\r\n";
+        const uint8_t set[] = ",;\n";
+        size_t shift;
+        size_t pos;
+
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(-1 == rbuf_find_byte(prb, 0, '\n'));
+        REQUIRE(-1 == rbuf_find_seq(prb, 0, delim, 2));
+        REQUIRE(-1 == rbuf_find_seq(prb, 0, delim, 0));
+
+        // the delimiter is placed at every position of the buffer, it wraps at one of them
+        for (shift = 0; shift < MAX_SIZE; shift ++) {
+            for (pos = 0; pos + 2 < MAX_SIZE - 1; pos ++) {
+                rbuf_reset(prb);
+                memset(buffer, '.', MAX_SIZE);
+                REQUIRE(shift + 1 == rbuf_write(prb, buffer, shift + 1));
+                REQUIRE(shift + 1 == rbuf_consume(prb, shift + 1));
+                memcpy(buffer + pos, delim, 2);
+                buffer[MAX_SIZE - 2] = ';';
+                REQUIRE(MAX_SIZE - 1 == rbuf_write(prb, buffer, MAX_SIZE - 1));
+
+                REQUIRE((ssize_t)pos == rbuf_find_seq(prb, 0, delim, 2));
+                REQUIRE((ssize_t)pos + 1 == rbuf_find_byte(prb, 0, '\n'));
+                REQUIRE((ssize_t)pos + 1 == rbuf_find_any(prb, 0, set, 3));
+                REQUIRE((ssize_t)pos == rbuf_find_seq(prb, pos, delim, 2));
+                REQUIRE(-1 == rbuf_find_seq(prb, pos + 1, delim, 2));
+                REQUIRE(MAX_SIZE - 2 == rbuf_find_any(prb, pos + 2, set, 3));
+                REQUIRE(-1 == rbuf_find_byte(prb, pos + 2, '\n'));
+                // only a part of the pattern
+                REQUIRE(-1 == rbuf_find_seq(prb, 0, (const uint8_t *)"\r\n\r", 3));
+            }
+        }
+    }
+}
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+static ssize_t
+cb_count_segments (void * userdata, size_t sz_max, size_t off_target, uint8_t * buf, size_t sz_buf)
+{
+    (*(int *)userdata) ++;
+    return sz_buf;
+}
+
+TEST_CASE( .name="ring-buffer-mirrored", .description="test mirrored ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    uint8_t cur_val = 0;
+    uint8_t cur_rd = 0;
+    size_t i;
+
+    SECTION("test mirrored ring buffer, single segment") {
+        uint8_t *seg1;
+        uint8_t *seg2;
+        size_t len1;
+        size_t len2;
+        struct iovec iov[2];
+        int cnt;
+
+        prb = rbuf_create_mirrored(MAX_SIZE);
+        REQUIRE(NULL != prb);
+        REQUIRE(rbuf_is_mirrored(prb));
+        REQUIRE(rbuf_max(prb) >= MAX_SIZE);
+        REQUIRE(0 == (rbuf_max(prb) + 1) % sysconf(_SC_PAGESIZE));
         REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(1 == rbuf_write(prb, buffer, 1));
-        REQUIRE(1 == rbuf_size(prb));
-        REQUIRE(1 == rbuf_forward(prb, 200));
+
+        for (i = 0; i < (rbuf_max(prb) + 1) / 100 * 3; i ++) {
+            rbuf_fill_test_buffer(buffer_comp, cur_val, MAX_BUFFER_SEGMENT);
+            REQUIRE(MAX_BUFFER_SEGMENT == rbuf_write(prb, buffer_comp, MAX_BUFFER_SEGMENT));
+            cur_val += MAX_BUFFER_SEGMENT;
+
+            // the data is one segment even if it crosses the end of the first mapping
+            REQUIRE(1 == rbuf_peek_iov(prb, 0, MAX_BUFFER_SEGMENT, iov));
+            REQUIRE(MAX_BUFFER_SEGMENT == iov[0].iov_len);
+            REQUIRE(0 == memcmp(iov[0].iov_base, buffer_comp, MAX_BUFFER_SEGMENT));
+            cnt = 0;
+            REQUIRE(MAX_BUFFER_SEGMENT == rbuf_peek_cb(prb, 0, MAX_BUFFER_SEGMENT, &cnt, cb_count_segments));
+            REQUIRE(1 == cnt);
+
+            REQUIRE(100 == rbuf_read(prb, buffer, 100));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, 100));
+            REQUIRE(MAX_BUFFER_SEGMENT - 100 == rbuf_read(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp + 100, MAX_BUFFER_SEGMENT - 100));
+            cur_rd += MAX_BUFFER_SEGMENT;
+        }
+        REQUIRE(cur_rd == cur_val);
+
+        // the spare space is one segment too
+        REQUIRE(rbuf_max(prb) == rbuf_reserve(prb, rbuf_max(prb), &seg1, &len1, &seg2, &len2));
+        REQUIRE(rbuf_max(prb) == len1);
+        REQUIRE(0 == len2);
+        memset(seg1, 0xA5, len1);
+        REQUIRE(rbuf_max(prb) == rbuf_commit(prb, len1));
+        REQUIRE(0xA5 == prb->buf1[0]);
+        REQUIRE(0xA5 == prb->buf1[prb->sz_buf]);
+
+        rbuf_reset(prb);
+        REQUIRE(rbuf_is_mirrored(prb));
         REQUIRE(0 == rbuf_size(prb));
+        rbuf_destroy_mirrored(prb);
     }
+}
+#endif // ARDUINO _WIN32
 
-    SECTION("test ring buffer, test forward") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+#if ! defined(__AVR__)
+typedef struct _mpmc_test_item_t {
+    uint16_t id;  // the writer thread
+    uint32_t val; // the sequence of the item in the writer
+    uint8_t dummy;
+} mpmc_test_item_t;
 
-        // fullfill the ring buffer
-        sz_buf = sizeof(buffer);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(sz_rd == rbuf_size(prb));
-        REQUIRE(0 == rbuf_spare(prb));
+#if ! defined(ARDUINO)
+#define MPMC_TEST_THREADS 4
+#define MPMC_TEST_ITEMS (64 * 1024)
 
-        // read all of the ring buffer
-        sz_buf = rbuf_size(prb);
-        sz_rd = sz_buf/2;
-        for (; sz_rd>0;) {
-            rbuf_forward(prb, sz_rd);
-            REQUIRE(sz_buf - sz_rd == rbuf_size(prb));
-            sz_buf = rbuf_size(prb);
-            sz_rd = sz_buf/2;
+typedef struct _mpmc_test_arg_t {
+    void * prb;
+    uint16_t id;
+    size_t cnt;      // the number of items read
+    uint64_t sum;    // the sum of the values read
+    uint32_t last[MPMC_TEST_THREADS]; // the last value read from each of the writers + 1
+    int flg_order;   // if the items from one writer are read in order
+} mpmc_test_arg_t;
+
+static void *
+rbuf_mpmc_test_writer(void * userdata)
+{
+    mpmc_test_arg_t * arg = (mpmc_test_arg_t *)userdata;
+    mpmc_test_item_t items[7];
+    uint32_t val = 0;
+    ssize_t ret;
+    size_t i;
+
+    while (val < MPMC_TEST_ITEMS) {
+        for (i = 0; i < NUM_ARRAY(items); i ++) {
+            items[i].id = arg->id;
+            items[i].val = val + i;
+        }
+        ret = rbuf_mpmc_write(arg->prb, items, UG_MIN(NUM_ARRAY(items), MPMC_TEST_ITEMS - val));
+        if (ret > 0) {
+            val += ret;
+        } else {
+            sched_yield();
         }
     }
-    SECTION("test ring buffer, test peek") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+    return NULL;
+}
 
-        // fullfill the ring buffer
-        sz_buf = sizeof(buffer);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(sz_rd == rbuf_size(prb));
-        REQUIRE(0 == rbuf_spare(prb));
+static size_t g_mpmc_test_read = 0;
 
-        // read all of the ring buffer
-        while (rbuf_size(prb) > 0) {
-            ret = rbuf_peek(prb, 0, buffer2, 1);
-            ret = rbuf_read(prb, buffer, 1);        
-            REQUIRE(buffer[0] == buffer2[0]);
+static void *
+rbuf_mpmc_test_reader(void * userdata)
+{
+    mpmc_test_arg_t * arg = (mpmc_test_arg_t *)userdata;
+    mpmc_test_item_t items[5];
+    ssize_t ret;
+    ssize_t i;
+
+    arg->flg_order = 1;
+    while (__atomic_load_n(&g_mpmc_test_read, __ATOMIC_RELAXED) < MPMC_TEST_THREADS * MPMC_TEST_ITEMS) {
+        ret = rbuf_mpmc_read(arg->prb, items, NUM_ARRAY(items));
+        if (ret < 1) {
+            sched_yield();
+            continue;
         }
+        for (i = 0; i < ret; i ++) {
+            if (items[i].val < arg->last[items[i].id]) {
+                arg->flg_order = 0;
+            }
+            arg->last[items[i].id] = items[i].val + 1;
+            arg->sum += items[i].val;
+        }
+        arg->cnt += ret;
+        __atomic_add_fetch(&g_mpmc_test_read, ret, __ATOMIC_RELAXED);
     }
-    SECTION("test ring buffer, basic read write") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
+    return NULL;
+}
+#endif // ARDUINO
 
-        // fullfill the ring buffer
-        sz_buf = sizeof(buffer);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(sz_rd == rbuf_size(prb));
-        REQUIRE(0 == rbuf_spare(prb));
+TEST_CASE( .name="mpmc-ring", .description="test MPMC ring buffer.", .skip=0 ) {
+    ring_mpmc_t *prb = NULL;
+    uint8_t boundary[RBUF_MPMC_OCCUPIED_BYTES(64, sizeof(mpmc_test_item_t))] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    mpmc_test_item_t items[100];
+    mpmc_test_item_t items2[100];
+    uint32_t cur_val = 0;
+    uint32_t cur_rd = 0;
+    size_t i;
+    size_t j;
 
-        // try to write to fulled ring buffer
-        REQUIRE(-1 == rbuf_write(prb, buffer_comp, sizeof(buffer_comp)));
+    prb = (ring_mpmc_t *) boundary;
 
-        // read all of the ring buffer
-        ret = rbuf_peek(prb, 0, buffer2, sz_rd);
-        REQUIRE(ret == rbuf_size(prb));
-        REQUIRE(ret == rbuf_size(prb));
-        ret = rbuf_peek(prb, sz_rd/2, buffer2+sz_rd/2, sz_rd/2);
-        REQUIRE(ret == sz_rd/2);
-        ret = rbuf_peek(prb, 1, buffer2+1, 1);
-        REQUIRE(ret == 1);
-        ret = rbuf_peek(prb, sz_rd-1, buffer2+sz_rd-1, 1);
-        REQUIRE(ret == 1);
+    SECTION("test MPMC ring buffer, init") {
+        REQUIRE(-1 == rbuf_mpmc_init(prb, sizeof(ring_mpmc_t), 1));
+        REQUIRE(-1 == rbuf_mpmc_init(prb, sizeof(boundary), 0));
+        REQUIRE(0 == rbuf_mpmc_init(prb, RBUF_MPMC_OCCUPIED_BYTES(1, 1), 1));
+        REQUIRE(1 == rbuf_mpmc_max(prb));
+        REQUIRE(0 == rbuf_mpmc_init(prb, sizeof(boundary) - 1, sizeof(mpmc_test_item_t)));
+        REQUIRE(32 == rbuf_mpmc_max(prb));
+        REQUIRE(0 == rbuf_mpmc_init(prb, sizeof(boundary), sizeof(mpmc_test_item_t)));
+        REQUIRE(64 == rbuf_mpmc_max(prb));
+        REQUIRE(0 == rbuf_mpmc_size(prb));
+        REQUIRE(-1 == rbuf_mpmc_write(prb, NULL, 1));
+        REQUIRE(-1 == rbuf_mpmc_write(prb, items, 0));
+        REQUIRE(-1 == rbuf_mpmc_read(prb, items, 1));
+    }
 
-        ret = rbuf_read(prb, buffer, sz_rd);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        cur_rd += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
+    SECTION("test MPMC ring buffer, wrap around") {
+        memset(items, 0, sizeof(items));
+        REQUIRE(0 == rbuf_mpmc_init(prb, sizeof(boundary), sizeof(mpmc_test_item_t)));
 
-        // try to read empty ring buffer
-        REQUIRE(-1 == rbuf_read(prb, buffer, sizeof(buffer)));
+        // all of the slots are used
+        for (j = 0; j < NUM_ARRAY(items); j ++) {
+            items[j].val = cur_val + j;
+        }
+        REQUIRE(64 == rbuf_mpmc_write(prb, items, NUM_ARRAY(items)));
+        cur_val += 64;
+        REQUIRE(64 == rbuf_mpmc_size(prb));
+        REQUIRE(-1 == rbuf_mpmc_write(prb, items, 1));
 
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
-        rbuf_reset(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        for (i = 0; i < 64 * 3; i ++) {
+            REQUIRE(7 == rbuf_mpmc_read(prb, items2, 7));
+            for (j = 0; j < 7; j ++) {
+                REQUIRE(cur_rd + j == items2[j].val);
+            }
+            cur_rd += 7;
+            for (j = 0; j < 7; j ++) {
+                items[j].val = cur_val + j;
+            }
+            REQUIRE(7 == rbuf_mpmc_write(prb, items, 7));
+            cur_val += 7;
+            REQUIRE(64 == rbuf_mpmc_size(prb));
+        }
+        REQUIRE(64 == rbuf_mpmc_read(prb, items2, NUM_ARRAY(items2)));
+        REQUIRE(cur_val - 1 == items2[63].val);
+        REQUIRE(0 == rbuf_mpmc_size(prb));
     }
-    SECTION("test ring buffer, reset after read and write") {
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        CIUT_LOG("rbuf_max=%d", rbuf_max(prb));
-        REQUIRE(rbuf_max(prb) % 12 == 0);
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
 
-        // full the ring buffer, after that size()=FULL, spare()=0
-        sz_buf = rbuf_max(prb);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(sz_rd == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_size(prb));
-        REQUIRE(0 == rbuf_spare(prb));
+#if ! defined(ARDUINO)
+    SECTION("test MPMC ring buffer, multiple threads") {
+        pthread_t thr_wr[MPMC_TEST_THREADS];
+        pthread_t thr_rd[MPMC_TEST_THREADS];
+        mpmc_test_arg_t arg_wr[MPMC_TEST_THREADS];
+        mpmc_test_arg_t arg_rd[MPMC_TEST_THREADS];
+        size_t cnt = 0;
+        uint64_t sum = 0;
 
-        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
-        sz_buf = rbuf_max(prb) * 5 / 6;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
-        sz_rd = rbuf_read(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE((rbuf_max(prb) - sz_buf) == rbuf_size(prb));
-        REQUIRE(sz_rd == rbuf_spare(prb));
-        CIUT_LOG("rbuf_max=%d; rbuf_size=%d", rbuf_max(prb), rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*2/12 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*10/12 == rbuf_spare(prb));
-        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
-        cur_rd += sz_rd;
+        REQUIRE(0 == rbuf_mpmc_init(prb, sizeof(boundary), sizeof(mpmc_test_item_t)));
+        g_mpmc_test_read = 0;
+        memset(arg_wr, 0, sizeof(arg_wr));
+        memset(arg_rd, 0, sizeof(arg_rd));
+        for (i = 0; i < MPMC_TEST_THREADS; i ++) {
+            arg_rd[i].prb = prb;
+            REQUIRE(0 == pthread_create(&thr_rd[i], NULL, rbuf_mpmc_test_reader, &arg_rd[i]));
+        }
+        for (i = 0; i < MPMC_TEST_THREADS; i ++) {
+            arg_wr[i].prb = prb;
+            arg_wr[i].id = i;
+            REQUIRE(0 == pthread_create(&thr_wr[i], NULL, rbuf_mpmc_test_writer, &arg_wr[i]));
+        }
+        for (i = 0; i < MPMC_TEST_THREADS; i ++) {
+            pthread_join(thr_wr[i], NULL);
+        }
+        for (i = 0; i < MPMC_TEST_THREADS; i ++) {
+            pthread_join(thr_rd[i], NULL);
+            // one reader gets the items of a writer in the order they were written
+            REQUIRE(arg_rd[i].flg_order);
+            cnt += arg_rd[i].cnt;
+            sum += arg_rd[i].sum;
+        }
+        // each of the items is read exactly once
+        REQUIRE(MPMC_TEST_THREADS * MPMC_TEST_ITEMS == cnt);
+        REQUIRE((uint64_t)MPMC_TEST_THREADS * MPMC_TEST_ITEMS * (MPMC_TEST_ITEMS - 1) / 2 == sum);
+        REQUIRE(0 == rbuf_mpmc_size(prb));
+    }
+#endif // ARDUINO
+}
+#endif // __AVR__
+
+typedef struct _lossy_test_item_t {
+    size_t seq;
+    size_t inv; // ~seq, to detect the torn items
+} lossy_test_item_t;
+
+#if ! defined(ARDUINO)
+#define LOSSY_TEST_ITEMS (1024 * 1024)
+
+static void *
+rbuf_lossy_test_writer(void * arg)
+{
+    lossy_test_item_t items[5];
+    size_t seq = 0;
+    size_t i;
+
+    while (seq < LOSSY_TEST_ITEMS) {
+        for (i = 0; i < NUM_ARRAY(items); i ++) {
+            items[i].seq = seq + i;
+            items[i].inv = ~(seq + i);
+        }
+        REQUIRE(NUM_ARRAY(items) == rbuf_lossy_write(arg, items, NUM_ARRAY(items)));
+        seq += NUM_ARRAY(items);
+    }
+    return NULL;
+}
+#endif // ARDUINO
+
+TEST_CASE( .name="lossy-ring", .description="test lossy ring buffer.", .skip=0 ) {
+    ring_lossy_t *prb = NULL;
+    uint8_t boundary[RBUF_LOSSY_OCCUPIED_BYTES(16, sizeof(lossy_test_item_t))] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    lossy_test_item_t items[40];
+    lossy_test_item_t items2[40];
+    size_t dropped;
+    size_t i;
+
+    prb = (ring_lossy_t *) boundary;
+    for (i = 0; i < NUM_ARRAY(items); i ++) {
+        items[i].seq = i;
+        items[i].inv = ~i;
+    }
+
+    SECTION("test lossy ring buffer, overwrite") {
+        REQUIRE(-1 == rbuf_lossy_init(prb, sizeof(boundary), 0));
+        REQUIRE(0 == rbuf_lossy_init(prb, sizeof(boundary), sizeof(lossy_test_item_t)));
+        REQUIRE(16 == rbuf_lossy_max(prb));
+        REQUIRE(0 == rbuf_lossy_size(prb));
+        REQUIRE(-1 == rbuf_lossy_write(prb, items, 0));
+        REQUIRE(-1 == rbuf_lossy_read(prb, items2, 1, &dropped));
+        REQUIRE(0 == dropped);
 
-        // reset the buffer and check boundary
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
-        rbuf_reset(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+        // not full
+        REQUIRE(10 == rbuf_lossy_write(prb, items, 10));
+        REQUIRE(4 == rbuf_lossy_read(prb, items2, 4, &dropped));
+        REQUIRE(0 == dropped);
+        REQUIRE(0 == items2[0].seq);
+        REQUIRE(6 == rbuf_lossy_size(prb));
+
+        // lapped: the items 4..23 are written, only the last 16 are kept
+        REQUIRE(14 == rbuf_lossy_write(prb, items + 10, 14));
+        REQUIRE(16 == rbuf_lossy_size(prb));
+        REQUIRE(3 == rbuf_lossy_read(prb, items2, 3, NULL));
+        REQUIRE(4 == rbuf_lossy_dropped(prb));
+        REQUIRE(8 == items2[0].seq);
+        REQUIRE(13 == rbuf_lossy_size(prb));
+
+        // more than the slots in one call
+        REQUIRE(16 == rbuf_lossy_write(prb, items, 40));
+        REQUIRE(16 == rbuf_lossy_read(prb, items2, NUM_ARRAY(items2), &dropped));
+        REQUIRE(13 + 24 == dropped);
+        REQUIRE(4 + 13 + 24 == rbuf_lossy_dropped(prb));
+        for (i = 0; i < 16; i ++) {
+            REQUIRE(24 + i == items2[i].seq);
+        }
+        REQUIRE(-1 == rbuf_lossy_read(prb, items2, NUM_ARRAY(items2), &dropped));
+        REQUIRE(0 == dropped);
     }
 
-    SECTION("test ring buffer, partial read write") {
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        rbuf_init(prb, TEST_RBUF_SIZE);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
-        REQUIRE(rbuf_max(prb) % 12 == 0);
+#if ! defined(ARDUINO)
+    SECTION("test lossy ring buffer, slow reader thread") {
+        pthread_t thr;
+        size_t next = 0;
+        size_t cnt = 0;
+        ssize_t ret;
+        REQUIRE(0 == rbuf_lossy_init(prb, sizeof(boundary), sizeof(lossy_test_item_t)));
+        REQUIRE(0 == pthread_create(&thr, NULL, rbuf_lossy_test_writer, prb));
+        while (next < LOSSY_TEST_ITEMS) {
+            ret = rbuf_lossy_read(prb, items2, 3, &dropped);
+            next += dropped;
+            if (ret < 1) {
+                sched_yield();
+                continue;
+            }
+            for (i = 0; i < (size_t)ret; i ++) {
+                // the items are in order and never torn
+                REQUIRE(next == items2[i].seq);
+                REQUIRE(~next == items2[i].inv);
+                next ++;
+            }
+            cnt += ret;
+        }
+        pthread_join(thr, NULL);
+        REQUIRE(LOSSY_TEST_ITEMS == next);
+        REQUIRE(LOSSY_TEST_ITEMS == cnt + rbuf_lossy_dropped(prb));
+    }
+#endif // ARDUINO
+}
 
-        // full the ring buffer, after that size()=FULL, spare()=0
-        sz_buf = rbuf_max(prb);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(sz_rd == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_size(prb));
-        REQUIRE(0 == rbuf_spare(prb));
+#if ! defined(__AVR__)
+#if ! defined(ARDUINO)
+#define BCAST_TEST_BYTES (1024 * 1024)
 
-        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
-        sz_buf = rbuf_max(prb) * 5 / 6;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
-        sz_rd = rbuf_read(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE((rbuf_max(prb) - sz_buf) == rbuf_size(prb));
-        REQUIRE(sz_rd == rbuf_spare(prb));
-        REQUIRE(rbuf_max(prb)*2/12 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*10/12 == rbuf_spare(prb));
-        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
-        cur_rd += sz_rd;
+typedef struct _rbuf_bcast_test_arg_t {
+    ring_bcast_t *prb;
+    int reader;
+} rbuf_bcast_test_arg_t;
 
-        // write all, after that size()=6/6, spare()=0/6
-        sz_buf = rbuf_max(prb)*2;
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sizeof(buffer_comp));
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(rbuf_max(prb)*12/12 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*0/12 == rbuf_spare(prb));
+static void *
+rbuf_bcast_test_reader(void * arg)
+{
+    uint8_t buffer[37];
+    struct iovec iov[2];
+    ring_bcast_t *prb = ((rbuf_bcast_test_arg_t *)arg)->prb;
+    int reader = ((rbuf_bcast_test_arg_t *)arg)->reader;
+    int cnt;
+    int j;
+    size_t i;
+    size_t sz = 0;
+    uint8_t cur_rd = 0;
 
-        // read 3/6, after that size()=3/6, spare()=3/6
-        sz_buf = rbuf_max(prb)*6/12;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        memset(buffer2, 0, sizeof(buffer));
-        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
-        sz_rd = rbuf_read(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(rbuf_max(prb)*6/12 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*6/12 == rbuf_spare(prb));
-        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
-        hex_dump_to_fp(stderr, buffer_comp, sz_rd);
-        hex_dump_to_fp(stderr, buffer, sz_rd);
-        hex_dump_to_fp(stderr, buffer2, sz_rd);
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
-        cur_rd += sz_rd;
+    while (sz < BCAST_TEST_BYTES) {
+        if (reader & 1) {
+            // in place
+            cnt = rbuf_bcast_peek_iov(prb, reader, 0, sizeof(buffer), iov);
+            if (cnt < 1) {
+                sched_yield();
+                continue;
+            }
+            for (j = 0; j < cnt; j ++) {
+                for (i = 0; i < iov[j].iov_len; i ++) {
+                    REQUIRE(cur_rd == ((uint8_t *)iov[j].iov_base)[i]);
+                    cur_rd ++;
+                }
+                sz += iov[j].iov_len;
+                rbuf_bcast_consume(prb, reader, iov[j].iov_len);
+            }
+        } else {
+            cnt = rbuf_bcast_read(prb, reader, buffer, sizeof(buffer));
+            if (cnt < 1) {
+                sched_yield();
+                continue;
+            }
+            for (j = 0; j < cnt; j ++) {
+                REQUIRE(cur_rd == buffer[j]);
+                cur_rd ++;
+            }
+            sz += cnt;
+        }
+    }
+    return NULL;
+}
+#endif // ARDUINO
 
-        // write another 2/6, after that size()=5/6, spare()=1/6
-        sz_buf = rbuf_max(prb)*2/6;
-        rbuf_fill_test_buffer(buffer_comp, cur_val, sz_buf);
-        sz_rd = rbuf_write(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        REQUIRE(sz_rd > 0);
-        REQUIRE(sz_rd == sz_buf);
-        cur_val += sz_rd;
-        REQUIRE(rbuf_max(prb)*5/6 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb)*1/6 == rbuf_spare(prb));
+TEST_CASE( .name="bcast-ring", .description="test broadcast ring buffer.", .skip=0 ) {
+    ring_bcast_t *prb = NULL;
+    uint8_t boundary[rbuf_bcast_occupied_bytes(64)] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    int readers[RBUF_BCAST_MAX_READERS];
+    size_t i;
 
-        // read all of them, after that size()=0, spare()=FULL
-        sz_buf = rbuf_max(prb) + 1;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        sz_rd = rbuf_peek(prb, 0, buffer2, sz_buf);
-        sz_rd = rbuf_read(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", rbuf_size(prb), rbuf_spare(prb), rbuf_max(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE(0 == rbuf_size(prb));
-        REQUIRE(rbuf_max(prb) == rbuf_spare(prb));
-        REQUIRE(0 == rbuf_size(prb));
-        rbuf_fill_test_buffer(buffer_comp, cur_rd, sizeof(buffer_comp));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sz_rd));
-        cur_rd += sz_rd;
+    prb = (ring_bcast_t *) boundary;
 
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
-        rbuf_reset(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((boundary + sizeof(boundary) - sizeof(ring_buffer_t)), ((char *)boundary + sizeof(boundary)));
+    SECTION("test broadcast ring buffer, join and leave") {
+        REQUIRE(-1 == rbuf_bcast_init(prb, sizeof(ring_bcast_t)));
+        REQUIRE(0 == rbuf_bcast_init(prb, sizeof(boundary)));
+        REQUIRE(64 == rbuf_bcast_max(prb));
+        REQUIRE(-1 == rbuf_bcast_write(prb, buffer, 0));
+
+        // no reader, the data is dropped
+        REQUIRE(64 == rbuf_bcast_spare(prb));
+        REQUIRE(64 == rbuf_bcast_write(prb, buffer, 100));
+        REQUIRE(64 == rbuf_bcast_spare(prb));
+
+        for (i = 0; i < RBUF_BCAST_MAX_READERS; i ++) {
+            readers[i] = rbuf_bcast_join(prb);
+            REQUIRE(readers[i] >= 0);
+            REQUIRE(0 == rbuf_bcast_size(prb, readers[i]));
+        }
+        REQUIRE(-1 == rbuf_bcast_join(prb));
+        for (i = 2; i < RBUF_BCAST_MAX_READERS; i ++) {
+            rbuf_bcast_leave(prb, readers[i]);
+        }
+
+        // the data is read by both readers, the writer waits for the slower one
+        rbuf_fill_test_buffer(buffer_comp, 0, 50);
+        REQUIRE(50 == rbuf_bcast_write(prb, buffer_comp, 50));
+        REQUIRE(50 == rbuf_bcast_read(prb, readers[0], buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 50));
+        REQUIRE(14 == rbuf_bcast_spare(prb));
+        rbuf_fill_test_buffer(buffer_comp, 50, 50);
+        REQUIRE(14 == rbuf_bcast_write(prb, buffer_comp, 50));
+        REQUIRE(-1 == rbuf_bcast_write(prb, buffer_comp, 50));
+        REQUIRE(14 == rbuf_bcast_size(prb, readers[0]));
+        REQUIRE(64 == rbuf_bcast_size(prb, readers[1]));
+        REQUIRE(10 == rbuf_bcast_read(prb, readers[1], buffer, 10));
+        rbuf_fill_test_buffer(buffer_comp, 0, 64);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+        REQUIRE(10 == rbuf_bcast_spare(prb));
+
+        // a new reader starts from the current position
+        readers[2] = rbuf_bcast_join(prb);
+        REQUIRE(readers[2] >= 0);
+        REQUIRE(0 == rbuf_bcast_size(prb, readers[2]));
+        rbuf_fill_test_buffer(buffer_comp, 64, 10);
+        REQUIRE(10 == rbuf_bcast_write(prb, buffer_comp, 10));
+        REQUIRE(10 == rbuf_bcast_read(prb, readers[2], buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+
+        // the slow reader leaves
+        rbuf_bcast_leave(prb, readers[1]);
+        REQUIRE(64 - 24 == rbuf_bcast_spare(prb));
+        rbuf_bcast_leave(prb, readers[0]);
+        REQUIRE(64 == rbuf_bcast_spare(prb));
+        rbuf_bcast_leave(prb, readers[2]);
+    }
+
+#if ! defined(ARDUINO)
+    SECTION("test broadcast ring buffer, reader threads") {
+        pthread_t thr[3];
+        rbuf_bcast_test_arg_t args[3];
+        size_t cnt = 0;
+        ssize_t ret;
+        uint8_t cur_val = 0;
+
+        REQUIRE(0 == rbuf_bcast_init(prb, sizeof(boundary)));
+        for (i = 0; i < NUM_ARRAY(thr); i ++) {
+            args[i].prb = prb;
+            args[i].reader = rbuf_bcast_join(prb);
+            REQUIRE(args[i].reader >= 0);
+            REQUIRE(0 == pthread_create(&thr[i], NULL, rbuf_bcast_test_reader, &args[i]));
+        }
+        while (cnt < BCAST_TEST_BYTES) {
+            rbuf_fill_test_buffer(buffer, cur_val, 29);
+            ret = rbuf_bcast_write(prb, buffer, UG_MIN(29, BCAST_TEST_BYTES - cnt));
+            if (ret < 1) {
+                sched_yield();
+                continue;
+            }
+            cur_val += ret;
+            cnt += ret;
+        }
+        for (i = 0; i < NUM_ARRAY(thr); i ++) {
+            pthread_join(thr[i], NULL);
+            REQUIRE(0 == rbuf_bcast_size(prb, args[i].reader));
+            rbuf_bcast_leave(prb, args[i].reader);
+        }
     }
+#endif // ARDUINO
 }
+#endif // __AVR__
 
-//#undef MAX_SIZE
-//#define MAX_SIZE 12
-#define ITEM_T char
-static void
-rbuf_fill_test_buffer_macro(ITEM_T *buf, ITEM_T start_value, size_t size)
+#if ! defined(__AVR__)
+#define SHARD_TEST_WRITERS 3
+#define SHARD_TEST_RECORDS 20000
+
+// the record of the writer threads
+typedef struct _rbuf_shard_test_rec_t {
+    uint32_t writer;
+    uint32_t cnt;
+} rbuf_shard_test_rec_t;
+
+typedef struct _rbuf_shard_test_arg_t {
+    ring_shard_t *prb;
+    uint32_t writer;
+    uint32_t num_records;
+    uint32_t *pnum_held; // if not NULL, the writer counts itself in it after writing and keeps its shard until it's reset to 0
+} rbuf_shard_test_arg_t;
+
+#if ! defined(ARDUINO)
+static void *
+rbuf_shard_test_writer(void * arg)
 {
-    size_t i;
-    for (i = 0; i < size; i ++) {
-        buf[i] = start_value;
-        start_value ++;
+    uint32_t *pnum_held = ((rbuf_shard_test_arg_t *)arg)->pnum_held;
+    ring_shard_t *prb = ((rbuf_shard_test_arg_t *)arg)->prb;
+    rbuf_shard_test_rec_t rec;
+
+    rec.writer = ((rbuf_shard_test_arg_t *)arg)->writer;
+    for (rec.cnt = 0; rec.cnt < ((rbuf_shard_test_arg_t *)arg)->num_records; ) {
+        if (rbuf_shard_write(prb, (uint8_t *)&rec, sizeof(rec)) < 1) {
+            sched_yield();
+            continue;
+        }
+        rec.cnt ++;
+    }
+    if (NULL != pnum_held) {
+        __atomic_add_fetch(pnum_held, 1, __ATOMIC_RELEASE);
+        while (0 != __atomic_load_n(pnum_held, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
     }
+    return NULL;
 }
 
+// the buffers written by one thread, one more than the thread local storage
+typedef struct _rbuf_shard_test_tls_t {
+    ring_shard_t * rings[RBUF_SHARD_TLS_SLOTS + 1];
+    ssize_t ret[RBUF_SHARD_TLS_SLOTS + 1]; // the first write to each buffer
+    ssize_t ret_again;   // the write to the first buffer again
+    int ret_release;     // the release of the second buffer
+    ssize_t ret_after;   // the write to the last buffer after the release
+} rbuf_shard_test_tls_t;
 
-TEST_CASE( .name="macro-ring", .description="test MACRO ring buffer.", .skip=0 ) {
+static uint8_t g_shard_test_rings[RBUF_SHARD_TLS_SLOTS + 1][RBUF_SHARD_OCCUPIED_BYTES(1, 128)] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
 
-    void *prb = NULL;
+static void *
+rbuf_shard_test_tls(void * arg)
+{
+    rbuf_shard_test_tls_t * pt = (rbuf_shard_test_tls_t *)arg;
+    uint8_t buffer[8];
+    size_t i;
 
-    ITEM_T buffer[MAX_BUFFER_SEGMENT];
-    ITEM_T buffer2[MAX_BUFFER_SEGMENT];
-    ITEM_T buffer_comp[MAX_BUFFER_SEGMENT];
+    memset(buffer, 0, sizeof(buffer));
+    for (i = 0; i <= RBUF_SHARD_TLS_SLOTS; i ++) {
+        pt->ret[i] = rbuf_shard_write(pt->rings[i], buffer, sizeof(buffer));
+    }
+    pt->ret_again = rbuf_shard_write(pt->rings[0], buffer, sizeof(buffer));
+    pt->ret_release = rbuf_shard_release(pt->rings[1]);
+    pt->ret_after = rbuf_shard_write(pt->rings[RBUF_SHARD_TLS_SLOTS], buffer, sizeof(buffer));
+    return NULL;
+}
+#endif // ARDUINO
 
-    ITEM_T boundary[MAX_SIZE*2];
+TEST_CASE( .name="shard-ring", .description="test sharded ring buffer.", .skip=0 ) {
+    ring_shard_t *prb = NULL;
+    uint8_t boundary[RBUF_SHARD_OCCUPIED_BYTES(SHARD_TEST_WRITERS, 128)] __attribute__((aligned(RBUF_CACHELINE_SIZE)));
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    ssize_t max;
+    size_t i;
 
-    size_t sz_buf = sizeof(buffer) / sizeof(ITEM_T);
-    ssize_t sz_rd = -1;
-    ITEM_T cur_val = 0; // current start write value
-    ITEM_T cur_rd = 0; // current read value
+    prb = (ring_shard_t *) boundary;
 
-#undef MASK_BOUNDARY
-#define MASK_BOUNDARY ('A')
-    prb = (char *)boundary + (sizeof(boundary)/2 - (sizeof(ITEM_T) * (MAX_SIZE/2)));
-    CIUT_LOG("boundary=%p; prb=%p, boundary end=%p", boundary, prb, (char *)boundary + sizeof(boundary));
+    SECTION("test sharded ring buffer, records of one writer") {
+        REQUIRE(-1 == rbuf_shard_init(prb, sizeof(ring_shard_t), 1, 0));
+        REQUIRE(-1 == rbuf_shard_init(prb, sizeof(boundary), 0, 0));
+        REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, 0));
+        REQUIRE(SHARD_TEST_WRITERS == rbuf_shard_max(prb));
+        REQUIRE(0 == (prb)->sz_stride % RBUF_CACHELINE_SIZE);
+        REQUIRE(0 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(-1 == rbuf_shard_write(prb, buffer, 0));
 
-    assert ((char *)boundary < (char *)prb && (char *)prb <= ((char *)boundary + sizeof(boundary)));
-    assert ( (char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)) < ((char *)boundary + sizeof(boundary) - 1));
-    memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-#define CHECK_BOUNDARY(b, end) \
-    { \
-        char *p; \
-        for (p = (char *)(b); p < (char *)(end); p ++) { \
-            REQUIRE(MASK_BOUNDARY == *p); \
-        } \
+        // the records are read as a whole
+        max = rbuf_spsc_max(RBUF_SHARD_PTR(prb, 0));
+        rbuf_fill_test_buffer(buffer_comp, 0, sizeof(buffer_comp));
+        REQUIRE(10 == rbuf_shard_write(prb, buffer_comp, 10));
+        REQUIRE(20 == rbuf_shard_write(prb, buffer_comp + 10, 20));
+        REQUIRE(1 == (prb)->num_claimed);
+        REQUIRE(-1 == rbuf_shard_write(prb, buffer_comp, max));
+        REQUIRE(-1 == rbuf_shard_read(prb, buffer, 5));
+        REQUIRE(10 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+        REQUIRE(20 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp + 10, 20));
+        REQUIRE(0 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+
+        // wrap around the shard
+        for (i = 0; i < 100; i ++) {
+            REQUIRE(i % 37 + 1 == (size_t)rbuf_shard_write(prb, buffer_comp + i, i % 37 + 1));
+            REQUIRE(i % 37 + 1 == (size_t)rbuf_shard_read(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp + i, i % 37 + 1));
+        }
+        REQUIRE(1 == (prb)->num_claimed);
+
+        // the thread claims a new shard after the buffer is initialized again
+        REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, 1));
+        REQUIRE(10 == rbuf_shard_write(prb, buffer_comp, 10));
+        REQUIRE(1 == (prb)->num_claimed);
+        REQUIRE(10 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+
+        // the shard is claimed again after it's released, with the records left in it
+        REQUIRE(10 == rbuf_shard_write(prb, buffer_comp, 10));
+        REQUIRE(0 == rbuf_shard_release(prb));
+        REQUIRE(-1 == rbuf_shard_release(prb));
+        REQUIRE(0 == RBUF_SHARD_SLOT(prb, 0)->flg_used);
+        REQUIRE(20 == rbuf_shard_write(prb, buffer_comp + 10, 20));
+        REQUIRE(1 == (prb)->num_claimed);
+        REQUIRE(10 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+        REQUIRE(20 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == memcmp(buffer, buffer_comp + 10, 20));
+        REQUIRE(0 == rbuf_shard_release(prb));
     }
 
-    SECTION("test ring buffer, parameters") {
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        REQUIRE(-1 == RBUF_WRITE(prb, NULL, 0));
-        REQUIRE(-1 == RBUF_WRITE(prb, buffer, 0));
-        REQUIRE(-1 == RBUF_READ(prb, NULL, 0));
-        REQUIRE(-1 == RBUF_READ(prb, buffer, 0));
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
-        RBUF_RESET(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+#if ! defined(ARDUINO)
+    SECTION("test sharded ring buffer, writer threads") {
+        pthread_t thr[SHARD_TEST_WRITERS];
+        rbuf_shard_test_arg_t args[SHARD_TEST_WRITERS];
+        rbuf_shard_test_rec_t rec;
+        uint32_t next[SHARD_TEST_WRITERS];
+        size_t cnt = 0;
+        ssize_t ret;
+        int flg_seq;
+
+        for (flg_seq = 0; flg_seq < 2; flg_seq ++) {
+            REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, flg_seq));
+            for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+                next[i] = 0;
+                args[i].prb = prb;
+                args[i].writer = i;
+                args[i].num_records = SHARD_TEST_RECORDS;
+                args[i].pnum_held = NULL;
+                REQUIRE(0 == pthread_create(&thr[i], NULL, rbuf_shard_test_writer, &args[i]));
+            }
+            // the records of each writer are in order
+            for (cnt = 0; cnt < SHARD_TEST_WRITERS * SHARD_TEST_RECORDS; ) {
+                ret = rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec));
+                if (ret < 1) {
+                    sched_yield();
+                    continue;
+                }
+                REQUIRE(sizeof(rec) == ret);
+                REQUIRE(rec.writer < SHARD_TEST_WRITERS);
+                REQUIRE(next[rec.writer] == rec.cnt);
+                next[rec.writer] ++;
+                cnt ++;
+            }
+            for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+                pthread_join(thr[i], NULL);
+            }
+            REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+            // the shards are released when the threads exit
+            for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+                REQUIRE(0 == RBUF_SHARD_SLOT(prb, i)->flg_used);
+            }
+            REQUIRE(10 == rbuf_shard_write(prb, buffer, 10));
+            REQUIRE(SHARD_TEST_WRITERS == (prb)->num_claimed);
+            REQUIRE(10 == rbuf_shard_read(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == rbuf_shard_release(prb));
+        }
     }
 
-    SECTION("test ring buffer, basic forward") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
-        REQUIRE(0 == RBUF_FORWARD(prb, 1));
-        REQUIRE(1 == RBUF_WRITE(prb, buffer, 1));
-        REQUIRE(1 == RBUF_SIZE(prb));
-        REQUIRE(1 == RBUF_FORWARD(prb, 1));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(1 == RBUF_WRITE(prb, buffer, 1));
-        REQUIRE(1 == RBUF_SIZE(prb));
-        REQUIRE(1 == RBUF_FORWARD(prb, 200));
-        REQUIRE(0 == RBUF_SIZE(prb));
+    SECTION("test sharded ring buffer, short-lived writer threads") {
+        pthread_t thr;
+        rbuf_shard_test_arg_t arg;
+        rbuf_shard_test_rec_t rec;
+        uint32_t cnt;
+
+        // more threads than the shards, one after another
+        REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, 0));
+        arg.prb = prb;
+        arg.num_records = 2;
+        arg.pnum_held = NULL;
+        for (i = 0; i < SHARD_TEST_WRITERS * 10; i ++) {
+            arg.writer = i;
+            REQUIRE(0 == pthread_create(&thr, NULL, rbuf_shard_test_writer, &arg));
+            pthread_join(thr, NULL);
+            // the records of the previous threads are read in the order of writing
+            if (i % 2) {
+                for (cnt = 0; cnt < 4; cnt ++) {
+                    REQUIRE(sizeof(rec) == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+                    REQUIRE(i - 1 + cnt / 2 == rec.writer);
+                    REQUIRE(cnt % 2 == rec.cnt);
+                }
+            }
+        }
+        // the shard released by the exiting thread is reused
+        REQUIRE(1 == (prb)->num_claimed);
+        REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
     }
 
-    SECTION("test ring buffer, forward") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        CIUT_LOG("max number=%d, OCCUPIED_BYTES(sz=%d)", MAX_SIZE+1, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("RBUF_POS_RD()=%d, RBUF_POS_WR()=%d, RBUF_ITEM_SIZE()=%d, RBUF_MAX_ITEMS()=%d", RBUF_POS_RD(prb), RBUF_POS_WR(prb), RBUF_ITEM_SIZE(prb), RBUF_MAX_ITEMS(prb));
-        CIUT_LOG("boundary sz=%d", sizeof(boundary));
-        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
-        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+    SECTION("test sharded ring buffer, too many buffers in one thread") {
+        pthread_t thr;
+        rbuf_shard_test_tls_t tls;
 
-        // fullfill the ring buffer
-        sz_buf = sizeof(buffer) / sizeof(ITEM_T);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(sz_rd == RBUF_SIZE(prb));
-        REQUIRE(0 == RBUF_SPARE(prb));
+        for (i = 0; i <= RBUF_SHARD_TLS_SLOTS; i ++) {
+            tls.rings[i] = (ring_shard_t *)g_shard_test_rings[i];
+            REQUIRE(0 == rbuf_shard_init(tls.rings[i], sizeof(g_shard_test_rings[i]), 1, 0));
+        }
+        REQUIRE(0 == pthread_create(&thr, NULL, rbuf_shard_test_tls, &tls));
+        pthread_join(thr, NULL);
+        for (i = 0; i < RBUF_SHARD_TLS_SLOTS; i ++) {
+            REQUIRE(8 == tls.ret[i]);
+        }
+        // no slot for the last buffer
+        REQUIRE(-1 == tls.ret[RBUF_SHARD_TLS_SLOTS]);
+        // the thread does not claim a second shard in the buffer written before
+        REQUIRE(8 == tls.ret_again);
+        REQUIRE(1 == (tls.rings[0])->num_claimed);
+        REQUIRE(0 == tls.ret_release);
+        REQUIRE(8 == tls.ret_after);
+        REQUIRE(1 == (tls.rings[RBUF_SHARD_TLS_SLOTS])->num_claimed);
+        // all of the shards are released when the thread exits
+        for (i = 0; i <= RBUF_SHARD_TLS_SLOTS; i ++) {
+            REQUIRE(0 == RBUF_SHARD_SLOT(tls.rings[i], 0)->flg_used);
+        }
+    }
+
+    SECTION("test sharded ring buffer, order of the numbered records") {
+        pthread_t thr[SHARD_TEST_WRITERS];
+        uint32_t num_held = 0;
+        rbuf_shard_test_arg_t arg;
+        rbuf_shard_test_rec_t rec;
+        ring_shard_hdr_t hdr;
+        size_t seq_gap;
+        size_t idx;
+        uint32_t cnt;
 
-        sz_buf = RBUF_SIZE(prb);
-        sz_rd = sz_buf/2;
-        for (; sz_rd>0;) {
-            RBUF_FORWARD(prb, sz_rd);
-            REQUIRE(sz_buf - sz_rd == RBUF_SIZE(prb));
-            sz_buf = RBUF_SIZE(prb);
-            sz_rd = sz_buf/2;
+        // the writers run one after another, writer i writes i + 2 records to its own shard
+        REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, 1));
+        arg.prb = prb;
+        arg.pnum_held = &num_held;
+        for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+            arg.writer = i;
+            arg.num_records = i + 2;
+            REQUIRE(0 == pthread_create(&thr[i], NULL, rbuf_shard_test_writer, &arg));
+            while (i + 1 != __atomic_load_n(&num_held, __ATOMIC_ACQUIRE)) {
+                sched_yield();
+            }
+        }
+        __atomic_store_n(&num_held, 0, __ATOMIC_RELEASE);
+        for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+            pthread_join(thr[i], NULL);
+        }
+        REQUIRE(SHARD_TEST_WRITERS == (prb)->num_claimed);
+        // in round robin, it would be the first record of each shard
+        for (i = 0; i < SHARD_TEST_WRITERS; i ++) {
+            for (cnt = 0; cnt < i + 2; cnt ++) {
+                REQUIRE(sizeof(rec) == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+                REQUIRE(i == rec.writer);
+                REQUIRE(cnt == rec.cnt);
+            }
+        }
+        REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+
+        // a writer is preempted between numbering and writing its record
+        REQUIRE(0 == rbuf_shard_init(prb, sizeof(boundary), SHARD_TEST_WRITERS, 1));
+        arg.writer = 0;
+        arg.num_records = 2;
+        REQUIRE(0 == pthread_create(&thr[0], NULL, rbuf_shard_test_writer, &arg));
+        while (1 != __atomic_load_n(&num_held, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
+        seq_gap = __atomic_add_fetch(&((prb)->seq), 1, __ATOMIC_RELAXED);
+        REQUIRE(3 == seq_gap);
+        arg.writer = 1;
+        arg.num_records = 3;
+        REQUIRE(0 == pthread_create(&thr[1], NULL, rbuf_shard_test_writer, &arg));
+        while (2 != __atomic_load_n(&num_held, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
+        __atomic_store_n(&num_held, 0, __ATOMIC_RELEASE);
+        for (i = 0; i < 2; i ++) {
+            pthread_join(thr[i], NULL);
+        }
+        REQUIRE(2 == (prb)->num_claimed);
+
+        // the later records are held back
+        for (cnt = 0; cnt < 2; cnt ++) {
+            REQUIRE(sizeof(rec) == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+            REQUIRE(0 == rec.writer);
+            REQUIRE(cnt == rec.cnt);
+        }
+        REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+        REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+
+        // the preempted writer goes on, the same as the end of rbuf_shard_write()
+        idx = (prb)->num_claimed ++;
+        rec.writer = 2;
+        rec.cnt = 0;
+        hdr.len = sizeof(rec);
+        hdr.seq = seq_gap;
+        REQUIRE(sizeof(hdr) == rbuf_spsc_write(RBUF_SHARD_PTR(prb, idx), (uint8_t *)&hdr, sizeof(hdr)));
+        REQUIRE(sizeof(rec) == rbuf_spsc_write(RBUF_SHARD_PTR(prb, idx), (uint8_t *)&rec, sizeof(rec)));
+
+        REQUIRE(sizeof(rec) == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+        REQUIRE(2 == rec.writer);
+        for (cnt = 0; cnt < 3; cnt ++) {
+            REQUIRE(sizeof(rec) == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
+            REQUIRE(1 == rec.writer);
+            REQUIRE(cnt == rec.cnt);
         }
+        REQUIRE(0 == rbuf_shard_read(prb, (uint8_t *)&rec, sizeof(rec)));
     }
-    SECTION("test ring buffer, basic read write") {
-        int ret;
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        CIUT_LOG("max number=%d, OCCUPIED_BYTES(sz=%d)", MAX_SIZE+1, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("RBUF_POS_RD()=%d, RBUF_POS_WR()=%d, RBUF_ITEM_SIZE()=%d, RBUF_MAX_ITEMS()=%d", RBUF_POS_RD(prb), RBUF_POS_WR(prb), RBUF_ITEM_SIZE(prb), RBUF_MAX_ITEMS(prb));
-        CIUT_LOG("boundary sz=%d", sizeof(boundary));
-        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
-        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+#endif // ARDUINO
+}
+#endif // __AVR__
 
-        // fullfill the ring buffer
-        sz_buf = sizeof(buffer) / sizeof(ITEM_T);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(sz_rd == RBUF_SIZE(prb));
-        REQUIRE(0 == RBUF_SPARE(prb));
+TEST_CASE( .name="ring-buffer-msg", .description="test messages in ring buffer.", .skip=0 ) {
+    ring_buffer_t *prb = NULL;
+    uint8_t boundary[rbuf_occupied_bytes(MAX_SIZE)];
+    uint8_t buffer[MAX_BUFFER_SEGMENT];
+    uint8_t buffer_comp[MAX_BUFFER_SEGMENT];
+    uint8_t cur_val = 0;
+    uint8_t cur_rd = 0;
+    size_t sz_msg;
+    size_t i;
 
-        // try to write to fulled ring buffer
-        REQUIRE(-1 == RBUF_WRITE(prb, buffer_comp, sizeof(buffer_comp)/sizeof(ITEM_T)));
+    prb = (ring_buffer_t *) boundary;
 
-        // read all of the ring buffer
-        ret = RBUF_PEEK(prb, 0, buffer2, sz_rd);
-        ret = RBUF_PEEK(prb, sz_rd/2, buffer2+sz_rd/2, sz_rd/2);
-        ret = RBUF_PEEK(prb, 1, buffer2+1, 1);
-        ret = RBUF_PEEK(prb, sz_rd-1, buffer2+sz_rd-1, 1);
+    SECTION("test ring buffer, messages") {
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(-1 == rbuf_write_msg(prb, buffer, 0));
+        REQUIRE(-1 == rbuf_write_msg(prb, NULL, 1));
+        REQUIRE(-1 == rbuf_msg_size(prb));
+        REQUIRE(0 == rbuf_read_msg(prb, buffer, sizeof(buffer)));
+        REQUIRE(0 == rbuf_forward_msg(prb));
+        // the header does not fit
+        REQUIRE(-1 == rbuf_write_msg(prb, buffer, MAX_SIZE));
+        REQUIRE(0 == rbuf_size(prb));
 
-        ret = RBUF_READ(prb, buffer, sz_rd);
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        cur_rd += sz_rd;
-        REQUIRE(sz_rd < sz_buf);
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
+        for (i = 0; i < MAX_SIZE * 3; i ++) {
+            // the header or the payload wraps at different positions
+            sz_msg = 1 + i % 29;
+            rbuf_fill_test_buffer(buffer_comp, cur_val, sz_msg);
+            REQUIRE(sz_msg == rbuf_write_msg(prb, buffer_comp, sz_msg));
+            cur_val += sz_msg;
+            REQUIRE(rbuf_msg_occupied_bytes(sz_msg) == rbuf_size(prb));
+            REQUIRE(sz_msg == rbuf_msg_size(prb));
+            if (sz_msg > 1) {
+                REQUIRE(-1 == rbuf_read_msg(prb, buffer, sz_msg - 1));
+            }
+            REQUIRE(sz_msg == rbuf_read_msg(prb, buffer, sizeof(buffer)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, sz_msg));
+            cur_rd += sz_msg;
+            REQUIRE(0 == rbuf_size(prb));
+        }
+        REQUIRE(cur_rd == cur_val);
+    }
 
-        // try to read empty ring buffer
-        REQUIRE(-1 == RBUF_READ(prb, buffer, sizeof(buffer)/sizeof(ITEM_T)));
+    SECTION("test ring buffer, all or nothing") {
+        struct iovec iov[2];
+        int cnt;
 
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
-        RBUF_RESET(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        // move the positions close to the end
+        REQUIRE(MAX_SIZE - 3 == rbuf_write(prb, buffer, MAX_SIZE - 3));
+        REQUIRE(MAX_SIZE - 3 == rbuf_forward(prb, MAX_SIZE));
+
+        // 3 messages take 3 * (header + 10) bytes
+        for (i = 0; i < 3; i ++) {
+            rbuf_fill_test_buffer(buffer_comp, (uint8_t)(i * 10), 10);
+            REQUIRE(10 == rbuf_write_msg(prb, buffer_comp, 10));
+        }
+        while (rbuf_spare(prb) >= rbuf_msg_occupied_bytes(10)) {
+            REQUIRE(10 == rbuf_write_msg(prb, buffer_comp, 10));
+        }
+        sz_msg = rbuf_size(prb);
+        REQUIRE(-1 == rbuf_write_msg(prb, buffer_comp, 10));
+        REQUIRE(sz_msg == rbuf_size(prb));
+
+        // the header of the first message wraps
+        cnt = rbuf_peek_msg(prb, iov);
+        REQUIRE(cnt >= 1 && cnt <= 2);
+        memcpy(buffer, iov[0].iov_base, iov[0].iov_len);
+        if (cnt > 1) {
+            memcpy(buffer + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+        }
+        REQUIRE(10 == iov[0].iov_len + ((cnt > 1)?iov[1].iov_len:0));
+        rbuf_fill_test_buffer(buffer_comp, 0, 10);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+        REQUIRE(10 == rbuf_forward_msg(prb));
+
+        REQUIRE(10 == rbuf_read_msg(prb, buffer, sizeof(buffer)));
+        rbuf_fill_test_buffer(buffer_comp, 10, 10);
+        REQUIRE(0 == memcmp(buffer, buffer_comp, 10));
+        while (rbuf_forward_msg(prb) > 0);
+        REQUIRE(0 == rbuf_size(prb));
+        REQUIRE(0 == rbuf_peek_msg(prb, iov));
     }
-    SECTION("test ring buffer, reset after read write") {
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
 
-        // full the ring buffer, after that size()=FULL, spare()=0
-        sz_buf = RBUF_MAX(prb);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(sz_rd == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SIZE(prb));
-        REQUIRE(0 == RBUF_SPARE(prb));
+    SECTION("test ring buffer, gather write and scatter read") {
+        uint8_t hdr[4];
+        uint8_t trailer[2];
+        uint8_t hdr_rd[4];
+        uint8_t trailer_rd[2];
+        struct iovec iov_wr[4];
+        struct iovec iov_rd[3];
+        struct iovec iov_seg[2];
+        uint8_t buffer2[MAX_SIZE];
+        size_t sz_frame;
+        size_t sz_fill;
+        size_t cnt_wrap = 0;
 
-        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
-        sz_buf = RBUF_MAX(prb) * 5 / 6;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        memset(buffer2, 0, sizeof(buffer));
-        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
-        sz_rd = RBUF_READ(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE((RBUF_MAX(prb) - sz_buf) == RBUF_SIZE(prb));
-        REQUIRE(sz_rd == RBUF_SPARE(prb));
-        REQUIRE(RBUF_MAX(prb)*2/12 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb)*10/12 == RBUF_SPARE(prb));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        cur_rd += sz_rd;
+        REQUIRE(0 == rbuf_init(prb, sizeof(boundary)));
+        REQUIRE(-1 == rbuf_writev(prb, iov_wr, 0));
+        REQUIRE(-1 == rbuf_readv(prb, iov_rd, 0));
 
-        // reset the buffer and check boundary
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
-        CIUT_LOG("boundary sz=%d", sizeof(boundary));
-        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
-        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        for (i = 0; i < MAX_SIZE * 3; i ++) {
+            // the frame wraps at different positions
+            sz_msg = 1 + i % 29;
+            memset(hdr, (uint8_t)i, sizeof(hdr));
+            memset(trailer, (uint8_t)~i, sizeof(trailer));
+            rbuf_fill_test_buffer(buffer_comp, cur_val, sz_msg);
+            cur_val += sz_msg;
+            iov_wr[0].iov_base = hdr;
+            iov_wr[0].iov_len = sizeof(hdr);
+            iov_wr[1].iov_base = NULL;
+            iov_wr[1].iov_len = 0;
+            iov_wr[2].iov_base = buffer_comp;
+            iov_wr[2].iov_len = sz_msg;
+            iov_wr[3].iov_base = trailer;
+            iov_wr[3].iov_len = sizeof(trailer);
+            sz_frame = sizeof(hdr) + sz_msg + sizeof(trailer);
 
-        RBUF_RESET(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+            // nothing is written if the whole frame does not fit, one byte short
+            sz_fill = rbuf_spare(prb) - sz_frame + 1;
+            rbuf_fill_test_buffer(buffer, 0, sz_fill);
+            REQUIRE(sz_fill == rbuf_write(prb, buffer, sz_fill));
+            REQUIRE(sz_frame - 1 == rbuf_spare(prb));
+            REQUIRE(-1 == rbuf_writev(prb, iov_wr, 4));
+            REQUIRE(sz_fill == rbuf_size(prb));
+            REQUIRE(sz_fill == rbuf_read(prb, buffer2, sz_fill));
+            REQUIRE(0 == memcmp(buffer, buffer2, sz_fill));
+
+            REQUIRE(sz_frame == rbuf_writev(prb, iov_wr, 4));
+            REQUIRE(sz_frame == rbuf_size(prb));
+            if (2 == rbuf_peek_iov(prb, 0, sz_frame, iov_seg)) {
+                cnt_wrap ++;
+            }
+
+            iov_rd[0].iov_base = hdr_rd;
+            iov_rd[0].iov_len = sizeof(hdr_rd);
+            iov_rd[1].iov_base = buffer;
+            iov_rd[1].iov_len = sz_msg + 1;
+            iov_rd[2].iov_base = trailer_rd;
+            iov_rd[2].iov_len = sizeof(trailer_rd);
+            // nothing is read if the data is not enough for all of the buffers
+            REQUIRE(-1 == rbuf_readv(prb, iov_rd, 3));
+            REQUIRE(sz_frame == rbuf_size(prb));
+            iov_rd[1].iov_len = sz_msg;
+            REQUIRE(sz_frame == rbuf_readv(prb, iov_rd, 3));
+            REQUIRE(0 == memcmp(hdr_rd, hdr, sizeof(hdr)));
+            REQUIRE(0 == memcmp(buffer, buffer_comp, sz_msg));
+            REQUIRE(0 == memcmp(trailer_rd, trailer, sizeof(trailer)));
+            REQUIRE(0 == rbuf_size(prb));
+        }
+        // some of the frames are split by the end of the buffer
+        REQUIRE(cnt_wrap > 0);
+
+        // a frame larger than the capacity
+        iov_wr[0].iov_base = buffer_comp;
+        iov_wr[0].iov_len = MAX_SIZE;
+        iov_wr[1].iov_base = hdr;
+        iov_wr[1].iov_len = 1;
+        REQUIRE(-1 == rbuf_writev(prb, iov_wr, 2));
+        REQUIRE(0 == rbuf_size(prb));
     }
-    SECTION("test ring buffer, partial read write") {
-        cur_val = 0;
-        cur_rd = 0;
-        memset(boundary, MASK_BOUNDARY, sizeof(boundary));
-        RBUF_INIT(prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), sizeof(ITEM_T));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
+}
 
-        // full the ring buffer, after that size()=FULL, spare()=0
-        sz_buf = RBUF_MAX(prb);
-        CIUT_LOG("rbuf_write(sz=%d)", sz_buf);
-        REQUIRE(sz_buf > 0);
-        memset(buffer, 0, sizeof(buffer));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(sz_rd == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SIZE(prb));
-        REQUIRE(0 == RBUF_SPARE(prb));
+#define WIN_TEST_SLOTS 32
 
-        // read 5/6 of the buffer, after that size()=1/6, spare()=5/6
-        sz_buf = RBUF_MAX(prb) * 5 / 6;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        memset(buffer2, 0, sizeof(buffer));
-        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
-        sz_rd = RBUF_READ(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE((RBUF_MAX(prb) - sz_buf) == RBUF_SIZE(prb));
-        REQUIRE(sz_rd == RBUF_SPARE(prb));
-        REQUIRE(RBUF_MAX(prb)*2/12 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb)*10/12 == RBUF_SPARE(prb));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        cur_rd += sz_rd;
+TEST_CASE( .name="window-ring", .description="test time-windowed ring buffer.", .skip=0 ) {
+    ring_window_t *prb = NULL;
+    size_t boundary[RBUF_WIN_OCCUPIED_BYTES(WIN_TEST_SLOTS) / sizeof(size_t) + 1];
+    ring_win_agg_t agg;
+    rbuf_win_ts_t ts;
+    rbuf_win_ts_t ts2;
+    rbuf_win_val_t val;
+    rbuf_win_sum_t sum;
+    rbuf_win_val_t vmin;
+    rbuf_win_val_t vmax;
+    size_t i;
+    size_t j;
 
-        // write all, after that size()=6/6, spare()=0/6
-        sz_buf = RBUF_MAX(prb)*2;
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sizeof(buffer_comp)/sizeof(ITEM_T));
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        cur_val += sz_rd;
-        REQUIRE(RBUF_MAX(prb)*12/12 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb)*0/12 == RBUF_SPARE(prb));
+    prb = (ring_window_t *) boundary;
 
-        // read 3/6, after that size()=3/6, spare()=3/6
-        sz_buf = RBUF_MAX(prb)*6/12;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        memset(buffer, 0, sizeof(buffer));
-        memset(buffer2, 0, sizeof(buffer));
-        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
-        sz_rd = RBUF_READ(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE(sz_rd == sz_buf);
-        REQUIRE(RBUF_MAX(prb)*6/12 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb)*6/12 == RBUF_SPARE(prb));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        cur_rd += sz_rd;
+    SECTION("test time-windowed ring buffer, push and evict") {
+        REQUIRE(-1 == rbuf_win_init(prb, sizeof(ring_window_t)));
+        REQUIRE(0 == rbuf_win_init(prb, RBUF_WIN_OCCUPIED_BYTES(WIN_TEST_SLOTS) + RBUF_WIN_SLOT_SIZE));
+        REQUIRE(WIN_TEST_SLOTS == rbuf_win_max(prb));
+        REQUIRE(0 == rbuf_win_size(prb));
+        REQUIRE(-1 == rbuf_win_range(prb, &ts, &ts2));
+        REQUIRE(-1 == rbuf_win_aggregate(prb, &agg));
+        REQUIRE(0 == agg.count);
+        REQUIRE(0 == rbuf_win_forward_until(prb, 100));
 
-        // write another 2/6, after that size()=5/6, spare()=1/6
-        sz_buf = RBUF_MAX(prb)*2/6;
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_val, sz_buf);
-        sz_rd = RBUF_WRITE(prb, buffer_comp, sz_buf);
-        CIUT_LOG("rbuf_write() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        REQUIRE(sz_rd > 0);
-        REQUIRE(sz_rd == sz_buf);
-        cur_val += sz_rd;
-        REQUIRE(RBUF_MAX(prb)*5/6 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb)*1/6 == RBUF_SPARE(prb));
+        REQUIRE(0 == rbuf_win_push(prb, 10, 5));
+        REQUIRE(0 == rbuf_win_push(prb, 10, -3));
+        REQUIRE(0 == rbuf_win_push(prb, 20, 7));
+        REQUIRE(-1 == rbuf_win_push(prb, 19, 1));
+        REQUIRE(0 == rbuf_win_push(prb, 30, 2));
+        REQUIRE(4 == rbuf_win_size(prb));
+        REQUIRE(0 == rbuf_win_range(prb, &ts, &ts2));
+        REQUIRE(10 == ts);
+        REQUIRE(30 == ts2);
+        REQUIRE(0 == rbuf_win_aggregate(prb, &agg));
+        REQUIRE(4 == agg.count);
+        REQUIRE(11 == agg.sum);
+        REQUIRE(-3 == agg.min);
+        REQUIRE(7 == agg.max);
+        REQUIRE(0 == rbuf_win_peek(prb, 2, &ts, &val));
+        REQUIRE(20 == ts);
+        REQUIRE(7 == val);
+        REQUIRE(-1 == rbuf_win_peek(prb, 4, &ts, &val));
 
-        // read all of them, after that size()=0, spare()=FULL
-        sz_buf = RBUF_MAX(prb) + 1;
-        CIUT_LOG("rbuf_read(sz=%d)", sz_buf);
-        sz_rd = RBUF_PEEK(prb, 0, buffer2, sz_buf);
-        sz_rd = RBUF_READ(prb, buffer, sz_buf);
-        CIUT_LOG("rbuf_read() return %d", sz_rd);
-        CIUT_LOG("rbuf_size()=%d, rbuf_spare()=%d, rbuf_max()=%d", RBUF_SIZE(prb), RBUF_SPARE(prb), RBUF_MAX(prb));
-        CIUT_LOG("buf=%s", buffer);
-        REQUIRE(sz_rd > 0);
-        REQUIRE(0 == RBUF_SIZE(prb));
-        REQUIRE(RBUF_MAX(prb) == RBUF_SPARE(prb));
-        REQUIRE(0 == RBUF_SIZE(prb));
-        rbuf_fill_test_buffer_macro(buffer_comp, cur_rd, sizeof(buffer_comp)/sizeof(ITEM_T));
-        REQUIRE(0 == memcmp(buffer, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        REQUIRE(0 == memcmp(buffer2, buffer_comp, sizeof(ITEM_T) * sz_rd));
-        cur_rd += sz_rd;
+        // the items at the start of the window are kept
+        REQUIRE(0 == rbuf_win_forward_until(prb, 10));
+        REQUIRE(2 == rbuf_win_forward_until(prb, 15));
+        REQUIRE(0 == rbuf_win_aggregate(prb, &agg));
+        REQUIRE(2 == agg.count);
+        REQUIRE(9 == agg.sum);
+        REQUIRE(2 == agg.min);
+        REQUIRE(7 == agg.max);
+        REQUIRE(20 == agg.oldest);
+        REQUIRE(1 == rbuf_win_forward(prb, 1));
+        REQUIRE(0 == rbuf_win_aggregate(prb, &agg));
+        REQUIRE(2 == agg.min);
+        REQUIRE(2 == agg.max);
+        REQUIRE(1 == rbuf_win_forward_until(prb, 100));
+        REQUIRE(-1 == rbuf_win_aggregate(prb, &agg));
+        REQUIRE(0 == agg.sum);
 
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
-        CIUT_LOG("boundary sz=%d", sizeof(boundary));
-        hex_dump_to_fp(stderr, boundary, sizeof(boundary));
-        CIUT_LOG("prb sz=%d", RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
-        hex_dump_to_fp(stderr, prb, RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)));
+        // full
+        for (i = 0; i < WIN_TEST_SLOTS; i ++) {
+            REQUIRE(0 == rbuf_win_push(prb, 100 + i, i));
+        }
+        REQUIRE(-1 == rbuf_win_push(prb, 200, 0));
+        rbuf_win_reset(prb);
+        REQUIRE(0 == rbuf_win_size(prb));
+    }
 
-        RBUF_RESET(prb);
-        CHECK_BOUNDARY(boundary, prb);
-        CHECK_BOUNDARY((char *)(prb) + RBUF_OCCUPIED_BYTES(MAX_SIZE+1, sizeof(ITEM_T)), ((char *)boundary + sizeof(boundary)));
+    SECTION("test time-windowed ring buffer, sliding window") {
+        REQUIRE(0 == rbuf_win_init(prb, RBUF_WIN_OCCUPIED_BYTES(WIN_TEST_SLOTS)));
+        // a window of 50 ticks, several items at each tick, the data wraps many times
+        srand(1);
+        ts = 0;
+        for (i = 0; i < 3000; i ++) {
+            ts += rand() % 4;
+            rbuf_win_forward_until(prb, (ts < 50) ? 0 : ts - 50);
+            if (rbuf_win_size(prb) >= rbuf_win_max(prb)) {
+                REQUIRE(1 == rbuf_win_forward(prb, 1));
+            }
+            REQUIRE(0 == rbuf_win_push(prb, ts, rand() % 2001 - 1000));
+
+            // compare with the linear scan
+            sum = 0;
+            vmin = vmax = 0;
+            for (j = 0; j < rbuf_win_size(prb); j ++) {
+                REQUIRE(0 == rbuf_win_peek(prb, j, &ts2, &val));
+                REQUIRE(ts2 + 50 >= ts);
+                sum += val;
+                if (0 == j || val < vmin) {
+                    vmin = val;
+                }
+                if (0 == j || val > vmax) {
+                    vmax = val;
+                }
+            }
+            REQUIRE(0 == rbuf_win_aggregate(prb, &agg));
+            REQUIRE(agg.count == rbuf_win_size(prb));
+            REQUIRE(agg.sum == sum);
+            REQUIRE(agg.min == vmin);
+            REQUIRE(agg.max == vmax);
+            REQUIRE(agg.newest == ts);
+        }
     }
 }
 
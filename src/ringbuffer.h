@@ -10,6 +10,16 @@
 
 #include "osporting.h"
 
+#if (defined(ARDUINO) && ! defined(ARDUINO_ARCH_ESP32)) || defined(_WIN32)
+// the same layout as the one in <sys/uio.h>
+struct iovec {
+    void * iov_base; // the start address of the segment
+    size_t iov_len;  // the byte size of the segment
+};
+#else
+#include <sys/uio.h> // struct iovec
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -21,12 +31,31 @@ extern "C" {
 // we use ring buffers to sync the data between
 // the sender and receiver, to avoid expose API
 
+#ifndef RBUF_WITH_STATS
+/// collect the statistics of ring_buffer_t and the RBUF_* ring, 0 keeps the structures and code without them
+#define RBUF_WITH_STATS 0
+#endif
+
+// the statistics for sizing a ring buffer, the sizes are in items for the RBUF_* ring
+typedef struct _ring_stats_t {
+    size_t high_water;    // the max data size after a write
+    size_t total_in;      // the total size of data written
+    size_t total_out;     // the total size of data read or discarded
+    size_t cnt_full;      // the number of writes which find no space
+    size_t cnt_empty;     // the number of reads which find no data
+    size_t cnt_truncated; // the number of writes which are cut to the spare size
+    size_t cnt_short_cb;  // the number of peek callbacks which process less than the data given
+} ring_stats_t;
+
 typedef struct _ring_buffer_t {
     size_t volatile pos_read;  // the read position
     size_t volatile pos_write; // the write position
     size_t sz_buf;  // byte size of buffer
 
     unsigned char * buf1; // the buffer
+#if RBUF_WITH_STATS
+    ring_stats_t stats;
+#endif
 } ring_buffer_t;
 
 #define rbuf_occupied_bytes(data_size) (sizeof(ring_buffer_t) + 1 + (data_size))
@@ -60,6 +89,15 @@ int rbuf_init(void *prb, size_t byte_size);
 //size_t rbuf_spare(ring_buffer_t *prb);
 #define rbuf_spare(prb) (rbuf_max(prb) - rbuf_size(prb))
 
+/**
+ * \brief check if the data area of the ring buffer is mapped twice back-to-back
+ * \param prb the ring buffer structure
+ * \return true if the buffer is created by rbuf_create_mirrored()
+ *
+ * The data area of a buffer from rbuf_init() always follows the structure.
+ */
+#define rbuf_is_mirrored(prb) (((ring_buffer_t *)(prb))->buf1 != (unsigned char *)((ring_buffer_t *)(prb) + 1))
+
 /**
  * \brief callback for filling target buffer from ring-buffer
  * \param userdata the pointer of user defined structure
@@ -77,8 +115,369 @@ ssize_t rbuf_read(void *prb, uint8_t * buf, size_t sz);
 ssize_t rbuf_write(void *prb, uint8_t * buf, size_t sz);
 ssize_t rbuf_forward(void *prb, size_t sz);
 
+// zero-copy write: fill the reserved segments (e.g. by read()) and then commit them
+ssize_t rbuf_reserve(void *prb, size_t want, uint8_t ** seg1, size_t * len1, uint8_t ** seg2, size_t * len2);
+ssize_t rbuf_commit(void *prb, size_t sz);
+
+// zero-copy read: process the data in place and then consume it
+int rbuf_peek_iov(void *prb, size_t offset, size_t sz, struct iovec iov[2]);
+ssize_t rbuf_consume(void *prb, size_t sz);
+
+// copy the statistics, it returns -1 if RBUF_WITH_STATS is 0
+int rbuf_stats(void *prb, ring_stats_t * pst);
+
+// search in place: the offset of the first match from the current read position, -1 if not found
+ssize_t rbuf_find_byte(void *prb, size_t offset, uint8_t val);
+ssize_t rbuf_find_any(void *prb, size_t offset, const uint8_t * set, size_t num);
+ssize_t rbuf_find_seq(void *prb, size_t offset, const uint8_t * pat, size_t len);
+
+// the ring buffer allocated in heap, the structure and data are in one block so it can be resized.
+// resizing returns a new pointer like realloc(), the old one is released on success.
+ring_buffer_t * rbuf_create(size_t data_size);
+void rbuf_destroy(ring_buffer_t * prb);
+ring_buffer_t * rbuf_resize(ring_buffer_t * prb, size_t data_size);
+// grow up to max_size if no enough space; shrink down to min_size if the data uses a quarter of the capacity
+ssize_t rbuf_write_grow(ring_buffer_t ** pprb, uint8_t * buf, size_t sz, size_t max_size);
+int rbuf_shrink_idle(ring_buffer_t ** pprb, size_t min_size);
+
+// the pool of ring buffers: the blocks of each size class are carved from one memory buffer,
+// the free blocks are linked in a list, so getting and putting a ring buffer is O(1) without malloc().
+// it's not thread safe.
+
+#ifndef RBUF_POOL_MAX_CLASSES
+/// the max number of size classes of one pool
+#define RBUF_POOL_MAX_CLASSES 8
+#endif
+
+/// the byte size of one block of a class, aligned to the pointer size
+#define RBUF_POOL_BLOCK_SIZE(data_size) ((rbuf_occupied_bytes(data_size) + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *))
+
+// the usage of one size class
+typedef struct _ring_pool_usage_t {
+    size_t data_size;  // the capacity of the ring buffers
+    size_t num_blocks; // the number of blocks
+    size_t num_used;   // the number of blocks in use
+    size_t high_water; // the max number of blocks in use
+    size_t cnt_fail;   // the number of requests for the class which got a larger class or nothing
+} ring_pool_usage_t;
+
+typedef struct _ring_pool_class_t {
+    ring_pool_usage_t usage;
+    unsigned char * start; // the first block
+    void * free_list;      // the first free block, the next one is stored in the block
+} ring_pool_class_t;
+
+typedef struct _ring_pool_t {
+    size_t num_classes;
+    ring_pool_class_t classes[RBUF_POOL_MAX_CLASSES];
+
+    // the blocks follow the structure
+} ring_pool_t;
 
-#define rbuf_reset(prb) rbuf_init(((ring_buffer_t *)(prb)), ((ring_buffer_t *)(prb))->sz_buf + sizeof(size_t)*3)
+/**
+ * \brief get the number of size classes
+ * \param pool the pool structure
+ * \return the number of size classes
+ */
+#define rbuf_pool_classes(pool) (((ring_pool_t *)(pool))->num_classes)
+
+size_t rbuf_pool_occupied_bytes(const size_t * data_sizes, const size_t * counts, size_t num_classes);
+int rbuf_pool_init(void *pool, size_t byte_size, const size_t * data_sizes, const size_t * counts, size_t num_classes);
+ring_buffer_t * rbuf_pool_get(void *pool, size_t data_size);
+void rbuf_pool_put(void *pool, ring_buffer_t * prb);
+int rbuf_pool_usage(void *pool, size_t cls, ring_pool_usage_t * pu);
+
+// messages: each message is stored as a length header and the payload
+
+#ifndef RBUF_MSG_LEN_T
+#if defined(ARDUINO)
+#define RBUF_MSG_LEN_T uint16_t
+#else
+#define RBUF_MSG_LEN_T uint32_t
+#endif
+#endif
+/// the type of the length header of a message, in host byte order
+typedef RBUF_MSG_LEN_T rbuf_msg_len_t;
+
+/// the byte size of the ring buffer data needed by a message of sz bytes
+#define rbuf_msg_occupied_bytes(sz) (sizeof(rbuf_msg_len_t) + (sz))
+
+ssize_t rbuf_write_msg(void *prb, uint8_t * buf, size_t sz);
+ssize_t rbuf_msg_size(void *prb);
+int rbuf_peek_msg(void *prb, struct iovec iov[2]);
+ssize_t rbuf_read_msg(void *prb, uint8_t * buf, size_t sz);
+ssize_t rbuf_forward_msg(void *prb);
+
+// gather write and scatter read: all of the buffers or none, the position is updated once
+ssize_t rbuf_writev(void *prb, const struct iovec * iov, int iovcnt);
+ssize_t rbuf_readv(void *prb, const struct iovec * iov, int iovcnt);
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+// one readv()/writev() for both of the segments
+ssize_t rbuf_fill_from_fd(void *prb, int fd, size_t sz);
+ssize_t rbuf_drain_to_fd(void *prb, int fd, size_t sz);
+
+// the data area is mapped twice, so the data and the spare space are always contiguous
+ring_buffer_t * rbuf_create_mirrored(size_t data_size);
+void rbuf_destroy_mirrored(ring_buffer_t * prb);
+
+// the ring buffer is stored in a mapped file, so the latest data survives a crash of the process.
+// the file starts with this header, the ring buffer structure and the data follow it.
+#define RBUF_FILE_MAGIC   0x52424646 // "RBFF"
+#define RBUF_FILE_VERSION 1
+typedef struct _ring_file_t {
+    uint32_t magic;   // RBUF_FILE_MAGIC, set after the ring buffer is created
+    uint32_t version; // RBUF_FILE_VERSION, the layout of ring_file_t and ring_buffer_t
+    size_t capacity;  // the byte size of the data area, the same as sz_buf of the ring buffer
+    // the ring_buffer_t follows the header, its buf1 is set again on open
+} ring_file_t;
+
+/// calculate the byte size of the file for a giving capacity
+#define rbuf_file_occupied_bytes(data_size) (sizeof(ring_file_t) + rbuf_occupied_bytes(data_size))
+
+// the returned ring buffer is used by rbuf_write(), rbuf_peek() and others
+ring_buffer_t * rbuf_file_open(const char * path, size_t data_size);
+int rbuf_file_sync(ring_buffer_t * prb, int flg_async);
+void rbuf_file_close(ring_buffer_t * prb);
+#endif
+
+
+// keep the data area, it's not following the structure in a mirrored buffer
+#define rbuf_reset(prb) (((ring_buffer_t *)(prb))->pos_read = 0, ((ring_buffer_t *)(prb))->pos_write = 1)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// SPSC version of ring buffer: one writer thread and one reader thread, lock-free
+
+#ifndef RBUF_CACHELINE_SIZE
+/// the byte size of one cache line, the indices of the two sides are kept in different lines
+#define RBUF_CACHELINE_SIZE 64
+#endif
+
+// the reader only writes the consumer line and the writer only writes the producer line,
+// each side keeps a local copy of the other side's index and reloads it only when the
+// copy says there's no enough data/space.
+typedef struct _ring_spsc_t {
+    size_t sz_buf;  // byte size of buffer, read only after init
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    // the consumer line
+    size_t pos_read;    // the read position, updated by the reader only
+    size_t cache_write; // the reader's copy of pos_write
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the producer line
+    size_t pos_write;   // the write position, updated by the writer only
+    size_t cache_read;  // the writer's copy of pos_read
+    uint8_t pad2[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the data follows the structure
+} ring_spsc_t;
+
+#define rbuf_spsc_occupied_bytes(data_size) (sizeof(ring_spsc_t) + 1 + (data_size))
+
+/// get the address of the data area
+#define RBUF_SPSC_DATA(prb) ((unsigned char *)((ring_spsc_t *)(prb) + 1))
+
+/**
+ * \brief get the capacity of the ring buffer
+ * \param prb the ring buffer structure
+ * \return the capacity of the ring buffer
+ */
+#define rbuf_spsc_max(prb) (((ring_spsc_t *)(prb))->sz_buf - 1)
+
+int rbuf_spsc_init(void *prb, size_t byte_size);
+size_t rbuf_spsc_size(void *prb);
+size_t rbuf_spsc_spare(void *prb);
+
+ssize_t rbuf_spsc_peek(void *prb, size_t offset, uint8_t * buf, size_t sz);
+ssize_t rbuf_spsc_read(void *prb, uint8_t * buf, size_t sz);
+ssize_t rbuf_spsc_write(void *prb, uint8_t * buf, size_t sz);
+ssize_t rbuf_spsc_forward(void *prb, size_t sz);
+
+#define rbuf_spsc_reset(prb) rbuf_spsc_init((prb), rbuf_spsc_occupied_bytes(rbuf_spsc_max(prb)))
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+// SPSC ring buffer in shared memory: the structure has only sizes and counters and the data follows it,
+// so two processes can map it at different addresses. The indices are updated by lock-free atomics,
+// which also work between processes.
+// the mapping starts with this header and the ring buffer structure follows it.
+#define RBUF_SHM_MAGIC   0x52425546 // "RBUF"
+#define RBUF_SHM_VERSION 1
+typedef struct _ring_shm_t {
+    uint32_t magic;   // RBUF_SHM_MAGIC, set by the creator after the ring buffer is ready
+    uint32_t version; // RBUF_SHM_VERSION, the layout of ring_shm_t and ring_spsc_t
+    size_t sz_map;    // the byte size of the whole mapping
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(uint32_t)*2 - sizeof(size_t)];
+
+    // the ring_spsc_t follows the header
+} ring_shm_t;
+
+/// calculate the byte size of the shared memory object for a giving capacity
+#define rbuf_shm_occupied_bytes(data_size) (sizeof(ring_shm_t) + rbuf_spsc_occupied_bytes(data_size))
+
+// the fd is from shm_open() or memfd_create(), the returned pointer is used by rbuf_spsc_*()
+void * rbuf_shm_create(int fd, size_t data_size);
+void * rbuf_shm_attach(int fd);
+void rbuf_shm_detach(void *prb);
+#endif // ARDUINO _WIN32
+
+#if defined(__linux__)
+// blocking wait of the SPSC ring buffer: the reader sleeps until the data size reaches the high watermark,
+// the writer sleeps until the data size falls to the low watermark.
+// the other side calls rbuf_spsc_notify_*() after read/write, it's only a check of a flag if no one is waiting.
+// if both sides are waiting, the watermarks are ignored so they don't wait for each other.
+typedef struct _ring_wait_t {
+    size_t low_watermark;  // wake the writer if data size <= low_watermark
+    size_t high_watermark; // wake the reader if data size >= high_watermark
+    int fd_rd; // the eventfd to wake the reader, -1 if futex is used
+    int fd_wr; // the eventfd to wake the writer, -1 if futex is used
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)*2 - sizeof(int)*2];
+
+    // the reader line
+    uint32_t seq_rd;     // the futex word, increased on waking the reader
+    uint32_t flg_wait_rd; // if the reader is waiting, cleared by the writer on waking it
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(uint32_t)*2];
+
+    // the writer line
+    uint32_t seq_wr;     // the futex word, increased on waking the writer
+    uint32_t flg_wait_wr; // if the writer is waiting, cleared by the reader on waking it
+    uint8_t pad2[RBUF_CACHELINE_SIZE - sizeof(uint32_t)*2];
+} ring_wait_t;
+
+/// get the eventfd which becomes readable when the reader should be woken, it can be added to epoll
+#define rbuf_wait_fd_readable(pw) (((ring_wait_t *)(pw))->fd_rd)
+/// get the eventfd which becomes readable when the writer should be woken, it can be added to epoll
+#define rbuf_wait_fd_writable(pw) (((ring_wait_t *)(pw))->fd_wr)
+
+int rbuf_wait_init(ring_wait_t * pw, size_t low_watermark, size_t high_watermark, int flg_eventfd);
+void rbuf_wait_destroy(ring_wait_t * pw);
+
+int rbuf_spsc_wait_readable(void *prb, ring_wait_t * pw, int timeout_ms);
+int rbuf_spsc_wait_writable(void *prb, ring_wait_t * pw, int timeout_ms);
+void rbuf_spsc_notify_written(void *prb, ring_wait_t * pw);
+void rbuf_spsc_notify_read(void *prb, ring_wait_t * pw);
+#endif // __linux__
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Power-of-two version of ring buffer: supports user specified length of items
+
+// the number of slots is power of two, so the index of a slot is (counter & mask).
+// the counters are free-running and never wrap in practice, so the size is
+// (pos_write - pos_read) and all of the slots can be used.
+typedef struct _ring_pow2_t {
+    uint64_t pos_read;  // the free-running read counter, in items
+    uint64_t pos_write; // the free-running write counter, in items
+    size_t mask;        // the number of item slots - 1
+    size_t item_size;   // the byte size of one item
+
+    // the data follows the structure
+} ring_pow2_t;
+
+/// calculate the occupied byte size space for a giving ring buffer, including the header and data space
+/// the items_in_buf should be power of two
+#define RBUF_POW2_OCCUPIED_BYTES(items_in_buf, item_size) (sizeof(ring_pow2_t) + (item_size) * (items_in_buf))
+
+/// get the address of the data area
+#define RBUF_POW2_DATA(prb) ((unsigned char *)((ring_pow2_t *)(prb) + 1))
+
+/**
+ * \brief get the max number of item slots in ring buffer
+ * \param prb the ring buffer structure
+ * \return the max number of item slots in ring buffer
+ */
+#define rbuf_pow2_max(prb) (((ring_pow2_t *)(prb))->mask + 1)
+
+/**
+ * \brief get number of items in ring buffer
+ * \param prb the ring buffer structure
+ * \return the number of items in ring buffer
+ */
+#define rbuf_pow2_size(prb) ((size_t)(((ring_pow2_t *)(prb))->pos_write - ((ring_pow2_t *)(prb))->pos_read))
+
+/**
+ * \brief get the number of spare item slots in ring buffer
+ * \param prb the ring buffer structure
+ * \return the number of spare item slots in ring buffer
+ */
+#define rbuf_pow2_spare(prb) (rbuf_pow2_max(prb) - rbuf_pow2_size(prb))
+
+int rbuf_pow2_init(void *prb, size_t byte_size, size_t item_size);
+
+ssize_t rbuf_pow2_peek_cb(void *prb, size_t offset, size_t num_items, void * userdata, rbuf_callback_write_t cb_write);
+ssize_t rbuf_pow2_peek(void *prb, size_t offset, void * buf, size_t num_items);
+ssize_t rbuf_pow2_read(void *prb, void * buf, size_t num_items);
+ssize_t rbuf_pow2_write(void *prb, void * buf, size_t num_items);
+ssize_t rbuf_pow2_forward(void *prb, size_t num_items);
+
+/**
+ * \brief reset the ring buffer
+ * \param prb the ring buffer structure
+ */
+#define rbuf_pow2_reset(prb) (((ring_pow2_t *)(prb))->pos_read = ((ring_pow2_t *)(prb))->pos_write = 0)
+
+#if ! defined(ARDUINO) && ! defined(_WIN32)
+#ifndef RBUF_HUGE_PAGE_SIZE
+/// the size of huge page used by rbuf_pow2_create_huge(), the mapping is rounded up to it
+#define RBUF_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#endif
+// large ring buffers for capture: huge pages reduce TLB misses, prefaulting avoids page faults in the first pass
+void * rbuf_pow2_create_huge(size_t items_in_buf, size_t item_size, int flg_prefault);
+void rbuf_pow2_destroy_huge(void *prb);
+#endif // ARDUINO _WIN32
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Lossy version of ring buffer: the writer overwrites the oldest items if the buffer is full
+
+// the writer never checks the reader, so writing is always done in constant time.
+// the reader detects the items overwritten after it's lapped and counts them as dropped.
+// the counters are free-running, the number of slots is power of two.
+typedef struct _ring_lossy_t {
+    size_t mask;      // the number of item slots - 1, read only after init
+    size_t item_size; // the byte size of one item
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the reader line
+    size_t pos_read;  // the read counter, updated by the reader only
+    size_t dropped;   // the total number of items dropped, updated by the reader only
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the writer line
+    size_t pos_write; // the write counter, updated after the items are written
+    size_t pos_claim; // the write counter, updated before the items are written
+    uint8_t pad2[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the data follows the structure
+} ring_lossy_t;
+
+/// calculate the occupied byte size space for a giving ring buffer, including the header and data space
+/// the items_in_buf should be power of two
+#define RBUF_LOSSY_OCCUPIED_BYTES(items_in_buf, item_size) (sizeof(ring_lossy_t) + (item_size) * (items_in_buf))
+
+/// get the address of the data area
+#define RBUF_LOSSY_DATA(prb) ((unsigned char *)((ring_lossy_t *)(prb) + 1))
+
+/**
+ * \brief get the max number of item slots in ring buffer
+ * \param prb the ring buffer structure
+ * \return the max number of item slots in ring buffer
+ */
+#define rbuf_lossy_max(prb) (((ring_lossy_t *)(prb))->mask + 1)
+
+/**
+ * \brief get the total number of items overwritten before the reader got them
+ * \param prb the ring buffer structure
+ * \return the number of items dropped, it's updated by the reader
+ */
+#define rbuf_lossy_dropped(prb) (((ring_lossy_t *)(prb))->dropped)
+
+int rbuf_lossy_init(void *prb, size_t byte_size, size_t item_size);
+size_t rbuf_lossy_size(void *prb);
+
+ssize_t rbuf_lossy_write(void *prb, void * buf, size_t num_items);
+ssize_t rbuf_lossy_read(void *prb, void * buf, size_t num_items, size_t * dropped);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -92,16 +491,25 @@ ssize_t rbuf_forward(void *prb, size_t sz);
 #define RBUF_ITEM_SIZE(prb) *((int *)(prb) + 2)
 /// get the max number of items can be stored, including the one used for barrier rd/wr
 #define RBUF_MAX_ITEMS(prb) *((int *)(prb) + 3)
+#if RBUF_WITH_STATS
+/// get the statistics following the four ints of the header, the buffer should be aligned to size_t
+#define RBUF_STATS_PTR(prb) ((ring_stats_t *)((int *)(prb) + 4))
+/// the byte size of the header
+#define RBUF_HEADER_BYTES (sizeof(int) * 4 + sizeof(ring_stats_t))
+#else
+/// the byte size of the header
+#define RBUF_HEADER_BYTES (sizeof(int) * 4)
+#endif
 /// get the address of item index x
-#define RBUF_ITEM_ADDR(prb, x) (((char *)((int *)(prb) + 4)) + RBUF_ITEM_SIZE(prb) * (x))
+#define RBUF_ITEM_ADDR(prb, x) (((char *)(prb) + RBUF_HEADER_BYTES) + RBUF_ITEM_SIZE(prb) * (x))
 
 /// calculate the occupied byte size space for a giving ring buffer, including the header and data space
 /// the items_in_buf includes the one used for barrier rd/wr
-#define RBUF_OCCUPIED_BYTES(items_in_buf, item_size) (sizeof(int) * 4 + (item_size) * (items_in_buf))
+#define RBUF_OCCUPIED_BYTES(items_in_buf, item_size) (RBUF_HEADER_BYTES + (item_size) * (items_in_buf))
 
 /// calculate the max available item slots for a given byte length of buffer, including the header and data space.
 /// the DATA_NUM includes the one used for barrier rd/wr
-#define RBUF_CALC_DATA_NUM(byte_size, item_size) (((byte_size) - sizeof(int)*4) / (item_size))
+#define RBUF_CALC_DATA_NUM(byte_size, item_size) (((byte_size) - RBUF_HEADER_BYTES) / (item_size))
 
 
 /**
@@ -114,7 +522,14 @@ ssize_t rbuf_forward(void *prb, size_t sz);
     RBUF_POS_RD(prb) = 0; \
     RBUF_POS_WR(prb) = 1; \
     RBUF_ITEM_SIZE(prb) = (item_size); \
-    RBUF_MAX_ITEMS(prb) = RBUF_CALC_DATA_NUM((byte_size_prb), (item_size))
+    RBUF_MAX_ITEMS(prb) = RBUF_CALC_DATA_NUM((byte_size_prb), (item_size)); \
+    RBUF_STATS_CLEAR(prb)
+
+#if RBUF_WITH_STATS
+#define RBUF_STATS_CLEAR(prb) memset(RBUF_STATS_PTR(prb), 0, sizeof(ring_stats_t))
+#else
+#define RBUF_STATS_CLEAR(prb) ((void)0)
+#endif
 
 ssize_t macro_rbuf_peek(void *prb, size_t offset, void * buf, size_t num_items);
 ssize_t macro_rbuf_read(void *prb, void * buf, size_t num_items);
@@ -184,6 +599,285 @@ ssize_t macro_rbuf_forward(void *prb, size_t num_items);
  */
 #define RBUF_RESET(prb) RBUF_INIT((prb), RBUF_OCCUPIED_BYTES(RBUF_MAX_ITEMS(prb), RBUF_ITEM_SIZE(prb)), RBUF_ITEM_SIZE(prb))
 
+int macro_rbuf_stats(void *prb, ring_stats_t * pst);
+/**
+ * \brief copy the statistics of the ring buffer, they are cleared by RBUF_INIT() and RBUF_RESET()
+ * \param prb the ring buffer structure
+ * \param pst the statistics to be filled
+ * \return 0 on success; -1 if RBUF_WITH_STATS is 0
+ */
+#define RBUF_GET_STATS(prb, pst) macro_rbuf_stats((prb), (pst))
+
+
+#if ! defined(__AVR__)
+////////////////////////////////////////////////////////////////////////////////
+// MPMC version of ring buffer: supports user specified length of items,
+// multiple writer threads and multiple reader threads, lock-free
+
+// each slot has a sequence number before the item, it tells the turn of the slot:
+// seq == pos: the slot is free for the writer which claims pos;
+// seq == pos + 1: the slot is filled for the reader which claims pos.
+// the writers and readers claim the positions by CAS, the number of slots is power of two.
+typedef struct _ring_mpmc_t {
+    size_t mask;      // the number of item slots - 1, read only after init
+    size_t item_size; // the byte size of one item
+    size_t sz_slot;   // the byte size of one slot, including the sequence number
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)*3];
+
+    size_t pos_read;  // the next position to be claimed by the readers
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    size_t pos_write; // the next position to be claimed by the writers
+    uint8_t pad2[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    // the slots follow the structure
+} ring_mpmc_t;
+
+/// the byte size of one slot: the sequence number and the item, aligned to size_t
+#define RBUF_MPMC_SLOT_SIZE(item_size) ((sizeof(size_t) + (item_size) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/// calculate the occupied byte size space for a giving ring buffer, including the header and data space
+/// the items_in_buf should be power of two
+#define RBUF_MPMC_OCCUPIED_BYTES(items_in_buf, item_size) (sizeof(ring_mpmc_t) + RBUF_MPMC_SLOT_SIZE(item_size) * (items_in_buf))
+
+/**
+ * \brief get the max number of item slots in ring buffer
+ * \param prb the ring buffer structure
+ * \return the max number of item slots in ring buffer
+ */
+#define rbuf_mpmc_max(prb) (((ring_mpmc_t *)(prb))->mask + 1)
+
+int rbuf_mpmc_init(void *prb, size_t byte_size, size_t item_size);
+size_t rbuf_mpmc_size(void *prb);
+
+ssize_t rbuf_mpmc_write(void *prb, void * buf, size_t num_items);
+ssize_t rbuf_mpmc_read(void *prb, void * buf, size_t num_items);
+#endif // __AVR__
+
+
+#if ! defined(__AVR__)
+////////////////////////////////////////////////////////////////////////////////
+// Broadcast version of ring buffer: one writer and multiple readers, each reader has its own read position
+
+#ifndef RBUF_BCAST_MAX_READERS
+/// the max number of readers of one broadcast ring buffer
+#define RBUF_BCAST_MAX_READERS 8
+#endif
+
+// each reader only writes its own line
+typedef struct _ring_bcast_reader_t {
+    size_t pos_read;   // the free-running read counter of the reader
+    size_t flg_active; // if the reader is joined
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+} ring_bcast_reader_t;
+
+// the data is written once and read by all of the joined readers in place,
+// the writer is gated by the slowest reader, the data is dropped if no reader is joined.
+// the counters are free-running, the byte size of data is power of two.
+typedef struct _ring_bcast_t {
+    size_t mask;      // the byte size of data - 1, read only after init
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    // the writer line
+    size_t pos_write; // the free-running write counter
+    size_t cache_min; // the writer's copy of the slowest read counter
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    ring_bcast_reader_t readers[RBUF_BCAST_MAX_READERS];
+
+    // the data follows the structure
+} ring_bcast_t;
+
+/// calculate the occupied byte size space for a giving ring buffer, the data_size should be power of two
+#define rbuf_bcast_occupied_bytes(data_size) (sizeof(ring_bcast_t) + (data_size))
+
+/// get the address of the data area
+#define RBUF_BCAST_DATA(prb) ((unsigned char *)((ring_bcast_t *)(prb) + 1))
+
+/**
+ * \brief get the capacity of the ring buffer
+ * \param prb the ring buffer structure
+ * \return the capacity of the ring buffer
+ */
+#define rbuf_bcast_max(prb) (((ring_bcast_t *)(prb))->mask + 1)
+
+int rbuf_bcast_init(void *prb, size_t byte_size);
+size_t rbuf_bcast_spare(void *prb);
+ssize_t rbuf_bcast_write(void *prb, uint8_t * buf, size_t sz);
+
+int rbuf_bcast_join(void *prb);
+void rbuf_bcast_leave(void *prb, int reader);
+size_t rbuf_bcast_size(void *prb, int reader);
+int rbuf_bcast_peek_iov(void *prb, int reader, size_t offset, size_t sz, struct iovec iov[2]);
+ssize_t rbuf_bcast_consume(void *prb, int reader, size_t sz);
+ssize_t rbuf_bcast_read(void *prb, int reader, uint8_t * buf, size_t sz);
+#endif // __AVR__
+
+
+#if ! defined(__AVR__)
+////////////////////////////////////////////////////////////////////////////////
+// Sharded version of ring buffer: multiple writer threads and one reader thread,
+// each writer thread has its own SPSC ring buffer (shard), no lock and no shared index
+
+#ifndef RBUF_SHARD_TLS_SLOTS
+/// the max number of sharded ring buffers one thread can write to at the same time
+#define RBUF_SHARD_TLS_SLOTS 4
+#endif
+
+// the header of each record in a shard
+typedef struct _ring_shard_hdr_t {
+    size_t len; // the byte size of the record
+    size_t seq; // the global sequence number, 0 if the records are not numbered
+} ring_shard_hdr_t;
+
+// a writer thread claims a free shard on its first write and keeps it in the thread local storage,
+// the shard is released by rbuf_shard_release() or when the thread exits, and it's reused by the
+// next thread with the records left in it. the ring buffer should not be released before the
+// writer threads exit or release their shards. the reader merges the records of all of
+// the claimed shards in round robin, or by the sequence number if flg_seq is set.
+// with flg_seq, the records are read strictly in the order of the numbers: a writer numbers
+// its record before writing it, so the reader waits for a record numbered but not written yet
+// and the records numbered after it are held back until then.
+// the buffer should be aligned to RBUF_CACHELINE_SIZE.
+typedef struct _ring_shard_t {
+    size_t num_shards; // the number of shards, read only after init
+    size_t sz_stride;  // the byte size of one shard, multiple of the cache line
+    size_t flg_seq;    // if the records are numbered
+    size_t id;         // the unique id to tell the thread local storage of a reinitialized buffer
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)*4];
+
+    size_t num_claimed; // the number of shards checked by the reader, 1 + the max index ever claimed
+    uint8_t pad1[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    size_t seq;         // the global sequence counter, updated by the writers only if flg_seq
+    uint8_t pad2[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+
+    // the reader line
+    size_t next;        // the shard to be checked first in round robin
+    size_t seq_read;    // the number of the last record read if flg_seq
+    uint8_t pad3[RBUF_CACHELINE_SIZE - sizeof(size_t)*2];
+
+    // the SPSC shards follow the structure
+} ring_shard_t;
+
+// the state of one shard, followed by its SPSC ring buffer
+typedef struct _ring_shard_slot_t {
+    size_t flg_used;    // 1 if the shard is owned by a writer thread
+    uint8_t pad0[RBUF_CACHELINE_SIZE - sizeof(size_t)];
+} ring_shard_slot_t;
+
+/// the byte size of one shard with data_size bytes of records, including the record headers
+#define RBUF_SHARD_STRIDE(data_size) ((sizeof(ring_shard_slot_t) + rbuf_spsc_occupied_bytes(data_size) + RBUF_CACHELINE_SIZE - 1) / RBUF_CACHELINE_SIZE * RBUF_CACHELINE_SIZE)
+
+/// calculate the occupied byte size space for a giving ring buffer, including the header and all of the shards
+#define RBUF_SHARD_OCCUPIED_BYTES(num_shards, data_size) (sizeof(ring_shard_t) + RBUF_SHARD_STRIDE(data_size) * (num_shards))
+
+/// get the state of the i-th shard
+#define RBUF_SHARD_SLOT(prb, i) ((ring_shard_slot_t *)((unsigned char *)((ring_shard_t *)(prb) + 1) + ((ring_shard_t *)(prb))->sz_stride * (i)))
+
+/// get the SPSC ring buffer of the i-th shard
+#define RBUF_SHARD_PTR(prb, i) ((ring_spsc_t *)(RBUF_SHARD_SLOT((prb), (i)) + 1))
+
+/**
+ * \brief get the max number of writer threads
+ * \param prb the ring buffer structure
+ * \return the number of shards
+ */
+#define rbuf_shard_max(prb) (((ring_shard_t *)(prb))->num_shards)
+
+int rbuf_shard_init(void *prb, size_t byte_size, size_t num_shards, int flg_seq);
+ssize_t rbuf_shard_write(void *prb, uint8_t * buf, size_t sz);
+ssize_t rbuf_shard_read(void *prb, uint8_t * buf, size_t sz);
+int rbuf_shard_release(void *prb);
+#endif // __AVR__
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Time-windowed version of ring buffer: each item is a timestamp and a value,
+// the sum, min and max of the items in the window are kept up to date
+
+#ifndef RBUF_WIN_TS_T
+#if defined(ARDUINO)
+#define RBUF_WIN_TS_T uint32_t // millis()
+#else
+#define RBUF_WIN_TS_T uint64_t
+#endif
+#endif
+#ifndef RBUF_WIN_VAL_T
+#define RBUF_WIN_VAL_T int32_t
+#endif
+#ifndef RBUF_WIN_SUM_T
+#define RBUF_WIN_SUM_T int64_t
+#endif
+/// the type of the timestamps, the timestamps of the items should not decrease
+typedef RBUF_WIN_TS_T rbuf_win_ts_t;
+/// the type of the values
+typedef RBUF_WIN_VAL_T rbuf_win_val_t;
+/// the type of the sum of the values, the sum is exact for the integer types
+typedef RBUF_WIN_SUM_T rbuf_win_sum_t;
+
+// the aggregates of the items in the window
+typedef struct _ring_win_agg_t {
+    size_t count;         // the number of items
+    rbuf_win_sum_t sum;   // the sum of the values
+    rbuf_win_val_t min;   // the min value
+    rbuf_win_val_t max;   // the max value
+    rbuf_win_ts_t oldest; // the timestamp of the oldest item
+    rbuf_win_ts_t newest; // the timestamp of the newest item
+} ring_win_agg_t;
+
+// the timestamps and values are stored in two arrays, the two monotonic queues keep
+// the counters of the items which may be the min or the max after the older items are
+// evicted, so the min and max are at the head of the queues.
+// the counters are free-running, the number of slots is power of two. it's not thread safe.
+typedef struct _ring_window_t {
+    size_t mask;      // the number of item slots - 1
+    size_t pos_read;  // the counter of the oldest item
+    size_t pos_write; // the counter of the next item
+    size_t min_head;  // the queue of the min candidates, the values increase from the head
+    size_t min_tail;
+    size_t max_head;  // the queue of the max candidates, the values decrease from the head
+    size_t max_tail;
+    rbuf_win_sum_t sum;
+
+    // the arrays of the timestamps, the min queue, the max queue and the values follow the structure
+} ring_window_t;
+
+/// the byte size of the arrays of one item slot
+#define RBUF_WIN_SLOT_SIZE (sizeof(rbuf_win_ts_t) + sizeof(size_t) * 2 + sizeof(rbuf_win_val_t))
+
+/// calculate the occupied byte size space for a giving ring buffer, including the header and data space
+/// the items_in_buf should be power of two
+#define RBUF_WIN_OCCUPIED_BYTES(items_in_buf) (sizeof(ring_window_t) + RBUF_WIN_SLOT_SIZE * (items_in_buf))
+
+/**
+ * \brief get the max number of item slots in ring buffer
+ * \param prb the ring buffer structure
+ * \return the max number of item slots in ring buffer
+ */
+#define rbuf_win_max(prb) (((ring_window_t *)(prb))->mask + 1)
+
+/**
+ * \brief get number of items in ring buffer
+ * \param prb the ring buffer structure
+ * \return the number of items in ring buffer
+ */
+#define rbuf_win_size(prb) (((ring_window_t *)(prb))->pos_write - ((ring_window_t *)(prb))->pos_read)
+
+int rbuf_win_init(void *prb, size_t byte_size);
+int rbuf_win_push(void *prb, rbuf_win_ts_t ts, rbuf_win_val_t val);
+int rbuf_win_peek(void *prb, size_t offset, rbuf_win_ts_t * pts, rbuf_win_val_t * pval);
+int rbuf_win_range(void *prb, rbuf_win_ts_t * oldest, rbuf_win_ts_t * newest);
+ssize_t rbuf_win_forward(void *prb, size_t num_items);
+ssize_t rbuf_win_forward_until(void *prb, rbuf_win_ts_t ts);
+int rbuf_win_aggregate(void *prb, ring_win_agg_t * pagg);
+
+/**
+ * \brief reset the ring buffer
+ * \param prb the ring buffer structure
+ */
+#define rbuf_win_reset(prb) rbuf_win_init((prb), RBUF_WIN_OCCUPIED_BYTES(rbuf_win_max(prb)))
+
 
 #ifdef __cplusplus
 }
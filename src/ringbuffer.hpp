@@ -0,0 +1,197 @@
+/**
+ * \file    ringbuffer.hpp
+ * \brief   Ring buffer with compile-time item type and capacity
+ * \author  Yunhui Fu <yhfudev@gmail.com>
+ * \version 1.0
+ */
+
+#ifndef _RING_BUFFER_HPP
+#define _RING_BUFFER_HPP 1
+
+#include <stddef.h> // size_t
+#include <string.h> // memcpy()
+#include <new>      // placement new
+#include <utility>  // std::move() std::forward()
+#include <type_traits>
+
+namespace ug {
+
+/**
+ * \brief ring buffer of N items of type T
+ *
+ * The item size and capacity are constants, so the compiler can inline and
+ * vectorize the accesses. The items are moved in and out; the bulk functions
+ * use memcpy() if T is trivially copyable.
+ *
+ * The header has the same layout as the macro version (RBUF_*) in ringbuffer.h:
+ * four ints of read position, write position, item size and the number of slots,
+ * followed by N+1 slots (one for the barrier between rd/wr). If T is trivially
+ * copyable and its alignment is not larger than the header, the object can be
+ * passed to RBUF_READ() and other macros as prb.
+ */
+template <typename T, size_t N>
+class RingBuffer {
+public:
+    typedef T value_type;
+
+    RingBuffer() : m_pos_rd(0), m_pos_wr(1), m_item_size(sizeof(T)), m_max_items(N + 1) {}
+    ~RingBuffer() { clear(); }
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer & operator = (const RingBuffer &) = delete;
+
+    /// the max number of items in the ring buffer
+    static constexpr size_t capacity() { return N; }
+    /// if the memory layout can be used by the macro version of ring buffer
+    /// the statistics (RBUF_WITH_STATS) in the header of the macro version are not kept here
+    static constexpr bool is_rbuf_compatible() {
+#if defined(RBUF_WITH_STATS) && RBUF_WITH_STATS
+        return false;
+#else
+        return std::is_trivially_copyable<T>::value && alignof(T) <= sizeof(int) * 4;
+#endif
+    }
+
+    /// get number of items in ring buffer
+    size_t size() const { return (m_pos_wr > m_pos_rd) ? (m_pos_wr - m_pos_rd - 1) : (m_pos_wr + (N + 1) - m_pos_rd - 1); }
+    /// get the number of spare item slots in ring buffer
+    size_t spare() const { return N - size(); }
+    bool empty() const { return 0 == size(); }
+    bool full() const { return N == size(); }
+
+    /**
+     * \brief construct an item in place at the end of the ring buffer
+     * \param args the arguments passed to the constructor of T
+     * \return true on success; false if the ring buffer is full
+     */
+    template <typename... Args>
+    bool emplace(Args &&... args) {
+        if (full()) {
+            return false;
+        }
+        new (slot(m_pos_wr)) T(std::forward<Args>(args)...);
+        m_pos_wr = next(m_pos_wr);
+        return true;
+    }
+    bool push(const T & item) { return emplace(item); }
+    bool push(T && item) { return emplace(std::move(item)); }
+
+    /**
+     * \brief get the first item without removing it
+     * \return the pointer to the item; NULL if the ring buffer is empty
+     */
+    T * front() { return empty() ? nullptr : slot(next(m_pos_rd)); }
+
+    /**
+     * \brief move out the first item
+     * \param item the item to be assigned
+     * \return true on success; false if the ring buffer is empty
+     */
+    bool pop(T & item) {
+        if (empty()) {
+            return false;
+        }
+        int pos = next(m_pos_rd);
+        item = std::move(*slot(pos));
+        slot(pos)->~T();
+        m_pos_rd = pos;
+        return true;
+    }
+
+    /**
+     * \brief discard the first num_items items
+     * \param num_items the number of items to be discarded
+     * \return the number of items discarded
+     */
+    size_t forward(size_t num_items) {
+        if (num_items > size()) {
+            num_items = size();
+        }
+        for (size_t i = 0; i < num_items; i ++) {
+            m_pos_rd = next(m_pos_rd);
+            slot(m_pos_rd)->~T();
+        }
+        return num_items;
+    }
+
+    /// discard all of the items
+    void clear() { forward(size()); m_pos_rd = 0; m_pos_wr = 1; }
+
+    /**
+     * \brief copy items to the ring buffer
+     * \param buf the items to be written
+     * \param num_items the number of items in buf
+     * \return the number of items written, it's smaller than num_items if no enough space
+     */
+    size_t write(const T * buf, size_t num_items) {
+        if (num_items > spare()) {
+            num_items = spare();
+        }
+        if (std::is_trivially_copyable<T>::value) {
+            // the first part
+            size_t sz = (N + 1) - m_pos_wr;
+            if (sz > num_items) {
+                sz = num_items;
+            }
+            memcpy ((void *)slot(m_pos_wr), buf, sz * sizeof(T));
+            // second part
+            if (sz < num_items) {
+                memcpy ((void *)slot(0), buf + sz, (num_items - sz) * sizeof(T));
+            }
+            m_pos_wr = wrap(m_pos_wr + num_items);
+        } else {
+            for (size_t i = 0; i < num_items; i ++) {
+                emplace(buf[i]);
+            }
+        }
+        return num_items;
+    }
+
+    /**
+     * \brief move items out of the ring buffer
+     * \param buf the buffer to be filled by items from ring buffer
+     * \param num_items the number of items in buf
+     * \return the number of items read, it's smaller than num_items if no enough data
+     */
+    size_t read(T * buf, size_t num_items) {
+        if (num_items > size()) {
+            num_items = size();
+        }
+        if (std::is_trivially_copyable<T>::value) {
+            // the data starts from the next position of pos_read
+            int pos = next(m_pos_rd);
+            // the first part
+            size_t sz = (N + 1) - pos;
+            if (sz > num_items) {
+                sz = num_items;
+            }
+            memcpy ((void *)buf, slot(pos), sz * sizeof(T));
+            // second part
+            if (sz < num_items) {
+                memcpy ((void *)(buf + sz), slot(0), (num_items - sz) * sizeof(T));
+            }
+            m_pos_rd = wrap(m_pos_rd + num_items);
+        } else {
+            for (size_t i = 0; i < num_items; i ++) {
+                pop(buf[i]);
+            }
+        }
+        return num_items;
+    }
+
+private:
+    static int next(int pos) { return (pos + 1 >= (int)(N + 1)) ? 0 : (pos + 1); }
+    static int wrap(size_t pos) { return (int)((pos >= N + 1) ? (pos - (N + 1)) : pos); }
+    T * slot(int pos) { return reinterpret_cast<T *>(m_items) + pos; }
+
+    // the same as RBUF_POS_RD, RBUF_POS_WR, RBUF_ITEM_SIZE and RBUF_MAX_ITEMS
+    int m_pos_rd;
+    int m_pos_wr;
+    int m_item_size;
+    int m_max_items;
+    alignas(T) unsigned char m_items[sizeof(T) * (N + 1)];
+};
+
+} // namespace ug
+
+#endif /* _RING_BUFFER_HPP */
@@ -0,0 +1,214 @@
+/**
+ * \file    ringchannel.hpp
+ * \brief   C++20 coroutine channel over the byte ring buffer
+ * \author  Yunhui Fu <yhfudev@gmail.com>
+ * \version 1.0
+ */
+
+#ifndef _RING_CHANNEL_HPP
+#define _RING_CHANNEL_HPP 1
+
+// the standard headers are included before ringbuffer.h, which may define nullptr as a macro
+#include <assert.h>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <span>
+#include <utility>  // std::exchange()
+
+#include "ringbuffer.h"
+
+namespace ug {
+
+/**
+ * \brief run coroutines in one thread, in the order they become ready
+ *
+ * The coroutines are resumed only in run(), so there's no lock.
+ */
+class Scheduler {
+public:
+    Scheduler() {}
+    Scheduler(const Scheduler &) = delete;
+    Scheduler & operator = (const Scheduler &) = delete;
+
+    /// queue a suspended coroutine to be resumed by run()
+    void post(std::coroutine_handle<> h) { m_ready.push_back(h); }
+
+    /// start a coroutine returning Task
+    template <typename T>
+    void spawn(T && task) { post(task.release()); }
+
+    /// resume the ready coroutines until no one is ready
+    void run() {
+        while (! m_ready.empty()) {
+            std::coroutine_handle<> h = m_ready.front();
+            m_ready.pop_front();
+            h.resume();
+        }
+    }
+
+    bool empty() const { return m_ready.empty(); }
+
+private:
+    std::deque<std::coroutine_handle<> > m_ready;
+};
+
+/**
+ * \brief the return type of a coroutine started by Scheduler::spawn()
+ *
+ * The coroutine does not run until it's spawned, and its frame is released when it returns.
+ */
+class Task {
+public:
+    struct promise_type {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(Task && other) : m_handle(std::exchange(other.m_handle, std::coroutine_handle<promise_type>())) {}
+    Task(const Task &) = delete;
+    Task & operator = (const Task &) = delete;
+    ~Task() { if (m_handle) { m_handle.destroy(); } }
+
+    /// give the coroutine to the scheduler
+    std::coroutine_handle<> release() { return std::exchange(m_handle, std::coroutine_handle<promise_type>()); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * \brief a byte stream between one reader coroutine and one writer coroutine
+ *
+ * co_await read() suspends if the ring buffer is empty, co_await write() suspends if it's full.
+ * The side making progress moves the data for the waiting side and posts it to the scheduler,
+ * so a resumed coroutine does not check the ring buffer again.
+ */
+class RingChannel {
+public:
+    class ReadAwaiter {
+    public:
+        bool await_ready() { return m_ch.try_read(*this); }
+        void await_suspend(std::coroutine_handle<> h) {
+            assert (NULL == m_ch.m_reader);
+            m_handle = h;
+            m_ch.m_reader = this;
+        }
+        /// the number of bytes read; 0 if the channel is closed and there's no data
+        size_t await_resume() const { return m_done; }
+
+    private:
+        friend class RingChannel;
+        ReadAwaiter(RingChannel & ch, std::span<uint8_t> buf) : m_ch(ch), m_buf(buf), m_done(0) {}
+        RingChannel & m_ch;
+        std::span<uint8_t> m_buf;
+        size_t m_done;
+        std::coroutine_handle<> m_handle;
+    };
+
+    class WriteAwaiter {
+    public:
+        bool await_ready() { return m_ch.try_write(*this); }
+        void await_suspend(std::coroutine_handle<> h) {
+            assert (NULL == m_ch.m_writer);
+            m_handle = h;
+            m_ch.m_writer = this;
+        }
+        /// the number of bytes written; smaller than the size of data if the channel is closed
+        size_t await_resume() const { return m_done; }
+
+    private:
+        friend class RingChannel;
+        WriteAwaiter(RingChannel & ch, std::span<const uint8_t> buf) : m_ch(ch), m_buf(buf), m_done(0) {}
+        RingChannel & m_ch;
+        std::span<const uint8_t> m_buf;
+        size_t m_done;
+        std::coroutine_handle<> m_handle;
+    };
+
+    /**
+     * \brief create a channel
+     * \param sched the scheduler running both of the coroutines
+     * \param capacity the byte size of the ring buffer
+     */
+    RingChannel(Scheduler & sched, size_t capacity)
+        : m_sched(sched), m_ring(rbuf_create(capacity)), m_reader(NULL), m_writer(NULL), m_closed(false) {}
+    ~RingChannel() { rbuf_destroy(m_ring); }
+
+    RingChannel(const RingChannel &) = delete;
+    RingChannel & operator = (const RingChannel &) = delete;
+
+    /// if the ring buffer is allocated
+    bool valid() const { return NULL != m_ring; }
+    bool closed() const { return m_closed; }
+
+    /// read at least one byte, up to the size of buf
+    ReadAwaiter read(std::span<uint8_t> buf) { return ReadAwaiter(*this, buf); }
+    /// write all of the bytes in buf
+    WriteAwaiter write(std::span<const uint8_t> buf) { return WriteAwaiter(*this, buf); }
+
+    /**
+     * \brief stop the channel, the waiting writer is resumed with the bytes written so far,
+     * the reader gets the data left in the ring buffer and then 0
+     */
+    void close() {
+        m_closed = true;
+        if (NULL != m_writer) {
+            m_sched.post(m_writer->m_handle);
+            m_writer = NULL;
+        }
+        if (NULL != m_reader) {
+            m_sched.post(m_reader->m_handle);
+            m_reader = NULL;
+        }
+    }
+
+private:
+    // copy data to the reader, return true if it's done
+    bool try_read(ReadAwaiter & aw) {
+        if (aw.m_buf.size() < 1 || rbuf_size(m_ring) < 1) {
+            return (aw.m_buf.size() < 1 || m_closed);
+        }
+        aw.m_done = rbuf_read(m_ring, aw.m_buf.data(), aw.m_buf.size());
+        // the space is released for the waiting writer
+        if (NULL != m_writer && try_write(*m_writer)) {
+            m_sched.post(m_writer->m_handle);
+            m_writer = NULL;
+        }
+        return true;
+    }
+
+    // copy data from the writer, return true if it's done
+    bool try_write(WriteAwaiter & aw) {
+        size_t sz;
+
+        if (m_closed) {
+            return true;
+        }
+        // the waiting reader empties the ring buffer, so go on with the rest of data
+        while (aw.m_done < aw.m_buf.size() && rbuf_spare(m_ring) > 0) {
+            sz = UG_MIN(aw.m_buf.size() - aw.m_done, rbuf_spare(m_ring));
+            rbuf_write(m_ring, (uint8_t *)aw.m_buf.data() + aw.m_done, sz);
+            aw.m_done += sz;
+            if (NULL != m_reader && try_read(*m_reader)) {
+                m_sched.post(m_reader->m_handle);
+                m_reader = NULL;
+            }
+        }
+        return aw.m_done >= aw.m_buf.size();
+    }
+
+    Scheduler & m_sched;
+    ring_buffer_t * m_ring;
+    ReadAwaiter * m_reader;  // the suspended reader
+    WriteAwaiter * m_writer; // the suspended writer
+    bool m_closed;
+};
+
+} // namespace ug
+
+#endif /* _RING_CHANNEL_HPP */
@@ -0,0 +1,107 @@
+/**
+ * \file    ringstream.hpp
+ * \brief   std::streambuf on the byte ring buffer
+ * \author  Yunhui Fu <yhfudev@gmail.com>
+ * \version 1.0
+ */
+
+#ifndef _RING_STREAM_HPP
+#define _RING_STREAM_HPP 1
+
+// the standard headers are included before ringbuffer.h, which may define nullptr as a macro
+#include <streambuf>
+
+#include "ringbuffer.h"
+
+namespace ug {
+
+/**
+ * \brief stream buffer whose put area is the spare space and get area is the data of a ring buffer
+ *
+ * The formatted output of std::ostream is written in place by rbuf_reserve(), and it's visible
+ * to the reader after flush() (or when the put area is full). The input of std::istream is parsed
+ * in place from rbuf_peek_iov(), and the bytes are consumed when the get area is refilled or on sync().
+ * Each area is one segment of the ring buffer, it's refilled at the end of the buffer.
+ *
+ * The ring buffer is not owned, and it should not be accessed by other functions in between.
+ * Usage:
+ *   ug::RingStreamBuf sb(prb);
+ *   std::ostream os(&sb);
+ *   os << "id=" << 12 << std::endl;
+ */
+class RingStreamBuf : public std::streambuf {
+public:
+    explicit RingStreamBuf(ring_buffer_t * prb) : m_ring(prb) {}
+    ~RingStreamBuf() { sync(); }
+
+    RingStreamBuf(const RingStreamBuf &) = delete;
+    RingStreamBuf & operator = (const RingStreamBuf &) = delete;
+
+protected:
+    /// commit the output and consume the input processed so far
+    int sync() {
+        commit_put();
+        consume_get();
+        return 0;
+    }
+
+    int_type overflow(int_type ch) {
+        uint8_t * seg1;
+        uint8_t * seg2;
+        size_t len1;
+        size_t len2;
+
+        commit_put();
+        // the space before the end of the buffer, or at the start of the buffer
+        if (rbuf_spare(m_ring) < 1 || rbuf_reserve(m_ring, rbuf_spare(m_ring), &seg1, &len1, &seg2, &len2) < 1) {
+            return traits_type::eof();
+        }
+        setp((char *)seg1, (char *)seg1 + len1);
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
+    }
+
+    int_type underflow() {
+        struct iovec iov[2];
+
+        consume_get();
+        // read the data written by this stream buffer
+        commit_put();
+        if (rbuf_peek_iov(m_ring, 0, rbuf_size(m_ring), iov) < 1) {
+            return traits_type::eof();
+        }
+        setg((char *)iov[0].iov_base, (char *)iov[0].iov_base, (char *)iov[0].iov_base + iov[0].iov_len);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize showmanyc() {
+        return rbuf_size(m_ring) - (gptr() - eback());
+    }
+
+private:
+    // make the output visible to the reader, the rest of the put area is still reserved
+    void commit_put() {
+        if (pptr() > pbase()) {
+            rbuf_commit(m_ring, pptr() - pbase());
+            setp(pptr(), epptr());
+        }
+    }
+
+    // release the input parsed, the rest of the get area is still valid
+    void consume_get() {
+        if (gptr() > eback()) {
+            rbuf_consume(m_ring, gptr() - eback());
+            setg(gptr(), gptr(), egptr());
+        }
+    }
+
+    ring_buffer_t * m_ring;
+};
+
+} // namespace ug
+
+#endif /* _RING_STREAM_HPP */
@@ -0,0 +1,571 @@
+/**
+ * \file    ringbench.cpp
+ * \brief   performance benchmark of the ring buffers
+ * \author  Yunhui Fu <yhfudev@gmail.com>
+ * \version 1.0
+ */
+
+// the standard headers are included before ringbuffer.h, which may define nullptr as a macro
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <deque>
+
+#include "ringbuffer.h"
+#include "ringbuffer.hpp"
+
+#define BENCH_TOTAL_BYTES (256UL * 1024 * 1024)
+#define BENCH_RING_BYTES  (64 * 1024)
+#define BENCH_CHUNK_MAX   4096
+#define BENCH_ROUND_TRIPS 100000
+
+typedef struct _bench_ops_t {
+    const char * name;
+    size_t (* occupied_bytes)(size_t data_size);
+    int (* init)(void *prb, size_t byte_size);
+    ssize_t (* write)(void *prb, uint8_t * buf, size_t sz);
+    ssize_t (* read)(void *prb, uint8_t * buf, size_t sz);
+    bool flg_threads; // if it can be used by one writer thread and one reader thread
+} bench_ops_t;
+
+static size_t rbuf_occupied_bytes_func(size_t data_size) { return rbuf_occupied_bytes(data_size); }
+static size_t rbuf_spsc_occupied_bytes_func(size_t data_size) { return rbuf_spsc_occupied_bytes(data_size); }
+static size_t rbuf_pow2_occupied_bytes_func(size_t data_size) { return RBUF_POW2_OCCUPIED_BYTES(data_size, 1); }
+static int rbuf_pow2_init_func(void *prb, size_t byte_size) { return rbuf_pow2_init(prb, byte_size, 1); }
+static ssize_t rbuf_pow2_write_func(void *prb, uint8_t * buf, size_t sz) { return rbuf_pow2_write(prb, buf, sz); }
+static ssize_t rbuf_pow2_read_func(void *prb, uint8_t * buf, size_t sz) { return rbuf_pow2_read(prb, buf, sz); }
+
+static const bench_ops_t g_bench_ops[] = {
+    // the original ring buffer has only 'volatile' indices, it's measured here as the reference
+    { "rbuf", rbuf_occupied_bytes_func, rbuf_init, rbuf_write, rbuf_read, true, },
+    { "rbuf_spsc", rbuf_spsc_occupied_bytes_func, rbuf_spsc_init, rbuf_spsc_write, rbuf_spsc_read, true, },
+    { "rbuf_pow2", rbuf_pow2_occupied_bytes_func, rbuf_pow2_init_func, rbuf_pow2_write_func, rbuf_pow2_read_func, false, },
+};
+
+typedef struct _bench_arg_t {
+    const bench_ops_t * ops;
+    void * prb;
+    size_t sz_chunk;
+    size_t sz_total;
+    int cpu;
+    size_t checksum;
+} bench_arg_t;
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * \brief print one line of the CSV report
+ * \param test the name of the test
+ * \param impl the name of the implementation
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes transferred
+ * \param num_ops the number of operations timed, a write/read pair or a round trip
+ * \param tm_used the seconds used
+ */
+static void
+bench_report(const char * test, const char * impl, size_t sz_chunk, size_t sz_total, size_t num_ops, double tm_used)
+{
+    printf("%s,%s,%" PRIuSZ ",%" PRIuSZ ",%.6f,%.2f,%.1f\n", test, impl, sz_chunk, sz_total, tm_used,
+        sz_total / tm_used / 1e6, (num_ops > 0) ? tm_used * 1e9 / num_ops : 0.0);
+}
+
+static void
+bench_pin_cpu(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void *
+bench_writer(void * userdata)
+{
+    bench_arg_t * arg = (bench_arg_t *)userdata;
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t cnt = 0;
+    size_t i;
+    ssize_t ret;
+
+    bench_pin_cpu(arg->cpu);
+    for (i = 0; i < sizeof(buf); i ++) {
+        buf[i] = (uint8_t)i;
+    }
+    while (cnt < arg->sz_total) {
+        ret = arg->ops->write(arg->prb, buf, UG_MIN(arg->sz_chunk, arg->sz_total - cnt));
+        if (ret > 0) {
+            cnt += ret;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *
+bench_reader(void * userdata)
+{
+    bench_arg_t * arg = (bench_arg_t *)userdata;
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t cnt = 0;
+    ssize_t ret;
+
+    bench_pin_cpu(arg->cpu);
+    while (cnt < arg->sz_total) {
+        ret = arg->ops->read(arg->prb, buf, arg->sz_chunk);
+        if (ret > 0) {
+            cnt += ret;
+            arg->checksum += buf[0];
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief measure the throughput of one writer thread and one reader thread on different cores
+ * \param ops the ring buffer functions
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_cross_core(const bench_ops_t * ops, size_t sz_chunk, size_t sz_total)
+{
+    pthread_t thr_wr;
+    pthread_t thr_rd;
+    bench_arg_t arg_wr;
+    bench_arg_t arg_rd;
+    double tm_start;
+    double tm_used;
+    void * prb;
+
+    prb = malloc(ops->occupied_bytes(BENCH_RING_BYTES));
+    if (NULL == prb) {
+        return;
+    }
+    ops->init(prb, ops->occupied_bytes(BENCH_RING_BYTES));
+
+    memset(&arg_wr, 0, sizeof(arg_wr));
+    arg_wr.ops = ops;
+    arg_wr.prb = prb;
+    arg_wr.sz_chunk = sz_chunk;
+    arg_wr.sz_total = sz_total;
+    arg_rd = arg_wr;
+    arg_wr.cpu = 0;
+    arg_rd.cpu = 1;
+
+    tm_start = bench_now();
+    pthread_create(&thr_rd, NULL, bench_reader, &arg_rd);
+    pthread_create(&thr_wr, NULL, bench_writer, &arg_wr);
+    pthread_join(thr_wr, NULL);
+    pthread_join(thr_rd, NULL);
+    tm_used = bench_now() - tm_start;
+
+    bench_report("cross_core", ops->name, sz_chunk, sz_total, (sz_total + sz_chunk - 1) / sz_chunk, tm_used);
+    free(prb);
+}
+
+typedef struct _bench_pingpong_t {
+    const bench_ops_t * ops;
+    void * prb_req;  // from the pinger to the echo thread
+    void * prb_resp; // from the echo thread to the pinger
+    size_t sz_chunk;
+    size_t rounds;
+    int cpu;
+    double tm_used;
+} bench_pingpong_t;
+
+// move exactly sz bytes through the ring buffer, spin until done
+static void
+bench_write_all(const bench_ops_t * ops, void * prb, uint8_t * buf, size_t sz)
+{
+    size_t cnt = 0;
+    ssize_t ret;
+    while (cnt < sz) {
+        ret = ops->write(prb, buf + cnt, sz - cnt);
+        if (ret > 0) {
+            cnt += ret;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void
+bench_read_all(const bench_ops_t * ops, void * prb, uint8_t * buf, size_t sz)
+{
+    size_t cnt = 0;
+    ssize_t ret;
+    while (cnt < sz) {
+        ret = ops->read(prb, buf + cnt, sz - cnt);
+        if (ret > 0) {
+            cnt += ret;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void *
+bench_pinger(void * userdata)
+{
+    bench_pingpong_t * arg = (bench_pingpong_t *)userdata;
+    uint8_t buf[BENCH_CHUNK_MAX];
+    double tm_start;
+    size_t i;
+
+    bench_pin_cpu(arg->cpu);
+    memset(buf, 0x5A, sizeof(buf));
+    tm_start = bench_now();
+    for (i = 0; i < arg->rounds; i ++) {
+        bench_write_all(arg->ops, arg->prb_req, buf, arg->sz_chunk);
+        bench_read_all(arg->ops, arg->prb_resp, buf, arg->sz_chunk);
+    }
+    arg->tm_used = bench_now() - tm_start;
+    return NULL;
+}
+
+static void *
+bench_echo(void * userdata)
+{
+    bench_pingpong_t * arg = (bench_pingpong_t *)userdata;
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t i;
+
+    bench_pin_cpu(arg->cpu);
+    for (i = 0; i < arg->rounds; i ++) {
+        bench_read_all(arg->ops, arg->prb_req, buf, arg->sz_chunk);
+        bench_write_all(arg->ops, arg->prb_resp, buf, arg->sz_chunk);
+    }
+    return NULL;
+}
+
+/**
+ * \brief measure the round trip latency between two cores, the message is sent back by the other core
+ * \param ops the ring buffer functions
+ * \param sz_chunk the size of the message
+ * \param rounds the number of round trips
+ */
+static void
+bench_latency(const bench_ops_t * ops, size_t sz_chunk, size_t rounds)
+{
+    pthread_t thr_ping;
+    pthread_t thr_echo;
+    bench_pingpong_t arg_ping;
+    bench_pingpong_t arg_echo;
+    void * prb_req;
+    void * prb_resp;
+
+    prb_req = malloc(ops->occupied_bytes(BENCH_RING_BYTES));
+    prb_resp = malloc(ops->occupied_bytes(BENCH_RING_BYTES));
+    if (NULL == prb_req || NULL == prb_resp) {
+        free(prb_req);
+        free(prb_resp);
+        return;
+    }
+    ops->init(prb_req, ops->occupied_bytes(BENCH_RING_BYTES));
+    ops->init(prb_resp, ops->occupied_bytes(BENCH_RING_BYTES));
+
+    memset(&arg_ping, 0, sizeof(arg_ping));
+    arg_ping.ops = ops;
+    arg_ping.prb_req = prb_req;
+    arg_ping.prb_resp = prb_resp;
+    arg_ping.sz_chunk = sz_chunk;
+    arg_ping.rounds = rounds;
+    arg_echo = arg_ping;
+    arg_ping.cpu = 0;
+    arg_echo.cpu = 1;
+
+    pthread_create(&thr_echo, NULL, bench_echo, &arg_echo);
+    pthread_create(&thr_ping, NULL, bench_pinger, &arg_ping);
+    pthread_join(thr_ping, NULL);
+    pthread_join(thr_echo, NULL);
+
+    bench_report("latency", ops->name, sz_chunk, rounds * sz_chunk * 2, rounds, arg_ping.tm_used);
+    free(prb_req);
+    free(prb_resp);
+}
+
+/**
+ * \brief measure the cost of small write/read pairs in one thread on a giving ring buffer
+ * \param test the name of the test in the report
+ * \param name the name of the implementation in the report
+ * \param ops the ring buffer functions
+ * \param prb the ring buffer structure
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_single_ring(const char * test, const char * name, const bench_ops_t * ops, void * prb, size_t sz_chunk, size_t sz_total)
+{
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t num = sz_total / sz_chunk;
+    size_t cnt = 0;
+    size_t i;
+    ssize_t ret;
+    double tm_start;
+    double tm_used;
+
+    memset(buf, 0x5A, sizeof(buf));
+
+    tm_start = bench_now();
+    for (i = 0; i < num; i ++) {
+        ops->write(prb, buf, sz_chunk);
+        ret = ops->read(prb, buf, sz_chunk);
+        if (ret > 0) {
+            cnt += ret;
+        }
+    }
+    tm_used = bench_now() - tm_start;
+
+    // the bytes really moved, a small ring buffer may take only a part of the chunk
+    bench_report(test, name, sz_chunk, cnt, num, tm_used);
+}
+
+/**
+ * \brief measure the cost of small write/read pairs in one thread
+ * \param test the name of the test in the report
+ * \param ops the ring buffer functions
+ * \param data_size the capacity of the ring buffer
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_single(const char * test, const bench_ops_t * ops, size_t data_size, size_t sz_chunk, size_t sz_total)
+{
+    void * prb;
+
+    prb = malloc(ops->occupied_bytes(data_size));
+    if (NULL == prb) {
+        return;
+    }
+    ops->init(prb, ops->occupied_bytes(data_size));
+    bench_single_ring(test, ops->name, ops, prb, sz_chunk, sz_total);
+    free(prb);
+}
+
+/**
+ * \brief the baseline of bench_single(): copy in and out of a flat buffer without any index check
+ * \param sz_chunk the size of each copy
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_memcpy(size_t sz_chunk, size_t sz_total)
+{
+    static uint8_t flat[BENCH_RING_BYTES];
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t num = sz_total / sz_chunk;
+    size_t off = 0;
+    size_t i;
+    double tm_start;
+    double tm_used;
+
+    memset(buf, 0x5A, sizeof(buf));
+    tm_start = bench_now();
+    for (i = 0; i < num; i ++) {
+        memcpy(flat + off, buf, sz_chunk);
+        memcpy(buf, flat + off, sz_chunk);
+        off += sz_chunk;
+        if (off + sz_chunk > sizeof(flat)) {
+            off = 0;
+        }
+    }
+    tm_used = bench_now() - tm_start;
+    bench_report("single", "memcpy", sz_chunk, num * sz_chunk, num, tm_used);
+}
+
+/**
+ * \brief the std::deque<uint8_t> as a byte queue, the way to compare with bench_single()
+ * \param sz_chunk the size of each push/pop
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_deque(size_t sz_chunk, size_t sz_total)
+{
+    std::deque<uint8_t> dq;
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t num = sz_total / sz_chunk;
+    size_t i;
+    double tm_start;
+    double tm_used;
+
+    memset(buf, 0x5A, sizeof(buf));
+    tm_start = bench_now();
+    for (i = 0; i < num; i ++) {
+        dq.insert(dq.end(), buf, buf + sz_chunk);
+        std::copy(dq.begin(), dq.begin() + sz_chunk, buf);
+        dq.erase(dq.begin(), dq.begin() + sz_chunk);
+    }
+    tm_used = bench_now() - tm_start;
+    bench_report("single", "std_deque", sz_chunk, num * sz_chunk, num, tm_used);
+}
+
+// copy the data from the ring buffer to the target buffer of userdata
+static ssize_t
+bench_cb_copy(void * userdata, size_t sz_max, size_t off_target, uint8_t * buf, size_t sz_buf)
+{
+    memcpy((uint8_t *)userdata + off_target, buf, sz_buf);
+    return sz_buf;
+}
+
+/**
+ * \brief measure the peek callback path: write, rbuf_peek_cb() and forward, the data is copied by the callback
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_peek_cb(size_t sz_chunk, size_t sz_total)
+{
+    uint8_t buf[BENCH_CHUNK_MAX];
+    size_t num = sz_total / sz_chunk;
+    size_t i;
+    double tm_start;
+    double tm_used;
+    void * prb;
+
+    memset(buf, 0x5A, sizeof(buf));
+
+    prb = malloc(rbuf_occupied_bytes(BENCH_RING_BYTES));
+    if (NULL != prb) {
+        rbuf_init(prb, rbuf_occupied_bytes(BENCH_RING_BYTES));
+        tm_start = bench_now();
+        for (i = 0; i < num; i ++) {
+            rbuf_write(prb, buf, sz_chunk);
+            rbuf_peek_cb(prb, 0, sz_chunk, buf, bench_cb_copy);
+            rbuf_forward(prb, sz_chunk);
+        }
+        tm_used = bench_now() - tm_start;
+        bench_report("peek_cb", "rbuf", sz_chunk, num * sz_chunk, num, tm_used);
+        free(prb);
+    }
+
+    prb = malloc(RBUF_POW2_OCCUPIED_BYTES(BENCH_RING_BYTES, 1));
+    if (NULL != prb) {
+        rbuf_pow2_init(prb, RBUF_POW2_OCCUPIED_BYTES(BENCH_RING_BYTES, 1), 1);
+        tm_start = bench_now();
+        for (i = 0; i < num; i ++) {
+            rbuf_pow2_write(prb, buf, sz_chunk);
+            rbuf_pow2_peek_cb(prb, 0, sz_chunk, buf, bench_cb_copy);
+            rbuf_pow2_forward(prb, sz_chunk);
+        }
+        tm_used = bench_now() - tm_start;
+        bench_report("peek_cb", "rbuf_pow2", sz_chunk, num * sz_chunk, num, tm_used);
+        free(prb);
+    }
+}
+
+#define BENCH_FILE_PATH "/tmp/ringbench.rbuf"
+
+/**
+ * \brief measure the overhead of the ring buffer stored in a mapped file, against the one in RAM
+ * \param sz_chunk the size of each read/write call
+ * \param sz_total the total bytes to be transferred
+ */
+static void
+bench_file(size_t sz_chunk, size_t sz_total)
+{
+    ring_buffer_t * prb;
+
+    unlink(BENCH_FILE_PATH);
+    prb = rbuf_file_open(BENCH_FILE_PATH, BENCH_RING_BYTES);
+    if (NULL == prb) {
+        return;
+    }
+    bench_single_ring("single", "rbuf_file", &g_bench_ops[0], prb, sz_chunk, sz_total);
+    rbuf_file_close(prb);
+    unlink(BENCH_FILE_PATH);
+}
+
+typedef struct _bench_item_t {
+    uint32_t id;
+    uint32_t len;
+    uint64_t tm;
+} bench_item_t;
+
+#define BENCH_ITEMS 1024
+
+/**
+ * \brief measure the cost of pushing and popping items one by one in one thread
+ * \param sz_total the total bytes of the items to be transferred
+ */
+static void
+bench_items(size_t sz_total)
+{
+    static uint8_t macro_ring[RBUF_OCCUPIED_BYTES(BENCH_ITEMS + 1, sizeof(bench_item_t))] __attribute__((aligned(sizeof(size_t))));
+    static ug::RingBuffer<bench_item_t, BENCH_ITEMS> tpl_ring;
+    bench_item_t item;
+    size_t num = sz_total / sizeof(bench_item_t);
+    size_t checksum = 0;
+    size_t i;
+    double tm_start;
+    double tm_used;
+
+    memset(&item, 0, sizeof(item));
+    RBUF_INIT(macro_ring, sizeof(macro_ring), sizeof(bench_item_t));
+    tm_start = bench_now();
+    for (i = 0; i < num; i ++) {
+        item.id = i;
+        RBUF_WRITE(macro_ring, &item, 1);
+        RBUF_READ(macro_ring, &item, 1);
+        checksum += item.id;
+    }
+    tm_used = bench_now() - tm_start;
+    bench_report("items", "RBUF", sizeof(bench_item_t), num * sizeof(bench_item_t), num, tm_used);
+
+    tm_start = bench_now();
+    for (i = 0; i < num; i ++) {
+        item.id = i;
+        tpl_ring.push(item);
+        tpl_ring.pop(item);
+        checksum += item.id;
+    }
+    tm_used = bench_now() - tm_start;
+    bench_report("items", "RingBuffer", sizeof(bench_item_t), num * sizeof(bench_item_t), num, tm_used);
+    if (0 == checksum) {
+        printf("# checksum=0\n");
+    }
+}
+
+int
+main(int argc, char * argv[])
+{
+    size_t sz_total = BENCH_TOTAL_BYTES;
+    size_t sz_chunk;
+    size_t i;
+
+    if (argc > 1) {
+        sz_total = strtoul(argv[1], NULL, 0);
+    }
+    // ns_op is the time of one write/read pair, or one round trip for the latency test
+    printf("test,impl,chunk,bytes,seconds,MBps,ns_op\n");
+    for (sz_chunk = 16; sz_chunk <= BENCH_CHUNK_MAX; sz_chunk *= 4) {
+        bench_memcpy(sz_chunk, sz_total);
+        bench_deque(sz_chunk, sz_total);
+        for (i = 0; i < NUM_ARRAY(g_bench_ops); i ++) {
+            bench_single("single", &g_bench_ops[i], BENCH_RING_BYTES, sz_chunk, sz_total);
+            // the ring buffer is a bit larger than the chunk, almost every call wraps around
+            bench_single("wrap", &g_bench_ops[i], sz_chunk + sz_chunk / 2 + 1, sz_chunk, sz_total);
+            if (g_bench_ops[i].flg_threads) {
+                bench_cross_core(&g_bench_ops[i], sz_chunk, sz_total);
+                bench_latency(&g_bench_ops[i], sz_chunk, BENCH_ROUND_TRIPS);
+            }
+        }
+        bench_peek_cb(sz_chunk, sz_total);
+        bench_file(sz_chunk, sz_total);
+    }
+    bench_items(sz_total);
+    return 0;
+}
@@ -0,0 +1,506 @@
+/**
+ * \file    ringtest.cpp
+ * \brief   unit tests of the C++ wrappers of the ring buffers
+ * \author  Yunhui Fu <yhfudev@gmail.com>
+ * \version 1.0
+ */
+
+// the standard headers are included before ringbuffer.h, which may define nullptr as a macro
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define CIUT_PLACE_MAIN 1
+#include <ciut.h>
+
+#include "ringbuffer.h"
+#include "ringbuffer.hpp"
+#include "ringchannel.hpp"
+#include "ringstream.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// ug::RingBuffer
+
+// count the live objects to check that every item constructed in the ring is destroyed
+static int g_num_tracked = 0;
+
+class TrackedItem {
+public:
+    TrackedItem() : m_val(-1) { g_num_tracked ++; }
+    explicit TrackedItem(int val) : m_val(val) { g_num_tracked ++; }
+    TrackedItem(const TrackedItem & other) : m_val(other.m_val) { g_num_tracked ++; }
+    TrackedItem(TrackedItem && other) : m_val(other.m_val) { other.m_val = -1; g_num_tracked ++; }
+    ~TrackedItem() { g_num_tracked --; }
+    TrackedItem & operator = (const TrackedItem & other) { m_val = other.m_val; return *this; }
+    TrackedItem & operator = (TrackedItem && other) { m_val = other.m_val; other.m_val = -1; return *this; }
+
+    int m_val;
+};
+
+// the strings are longer than the small string buffer, so a missed destructor shows up as a leak
+static std::string
+test_string(int i)
+{
+    return "the item of the ring buffer with a long text #" + std::to_string(i);
+}
+
+TEST_CASE( .name="cpp-ring", .description="test ug::RingBuffer template.", .skip=0 ) {
+
+    SECTION("test push, emplace and pop across the wrap") {
+        ug::RingBuffer<int, 5> rb;
+        int val;
+        int next_wr = 0;
+        int next_rd = 0;
+
+        REQUIRE(5 == rb.capacity());
+        REQUIRE(rb.empty());
+        // 3 items in and out in each round, so the positions wrap at different slots
+        for (int round = 0; round < 20; round ++) {
+            REQUIRE(rb.push(next_wr ++));
+            REQUIRE(rb.emplace(next_wr ++));
+            int tmp = next_wr ++;
+            REQUIRE(rb.push(std::move(tmp)));
+            REQUIRE(3 == rb.size());
+            REQUIRE(2 == rb.spare());
+            REQUIRE(NULL != rb.front());
+            REQUIRE(next_rd == *rb.front());
+            for (int i = 0; i < 3; i ++) {
+                REQUIRE(rb.pop(val));
+                REQUIRE(next_rd ++ == val);
+            }
+            REQUIRE(rb.empty());
+        }
+    }
+
+    SECTION("test bulk write and read across the wrap") {
+        ug::RingBuffer<int, 7> rb;
+        int buf[7];
+        int out[7];
+        int next_wr = 0;
+        int next_rd = 0;
+
+        for (int round = 0; round < 20; round ++) {
+            for (int i = 0; i < 5; i ++) {
+                buf[i] = next_wr ++;
+            }
+            REQUIRE(5 == rb.write(buf, 5));
+            REQUIRE(5 == rb.size());
+            REQUIRE(5 == rb.read(out, 7));
+            for (int i = 0; i < 5; i ++) {
+                REQUIRE(next_rd ++ == out[i]);
+            }
+        }
+        // one item dropped by forward() in the middle of the wrapped data
+        REQUIRE(5 == rb.write(buf, 5));
+        REQUIRE(1 == rb.forward(1));
+        REQUIRE(4 == rb.read(out, 7));
+        REQUIRE(buf[1] == out[0]);
+        REQUIRE(buf[4] == out[3]);
+    }
+
+    SECTION("test full and empty") {
+        ug::RingBuffer<int, 4> rb;
+        int buf[6] = { 1, 2, 3, 4, 5, 6 };
+        int out[6];
+        int val = 0;
+
+        REQUIRE(rb.empty());
+        REQUIRE(! rb.full());
+        REQUIRE(NULL == rb.front());
+        REQUIRE(! rb.pop(val));
+        REQUIRE(0 == rb.read(out, 6));
+        REQUIRE(0 == rb.forward(1));
+
+        for (int i = 0; i < 4; i ++) {
+            REQUIRE(rb.push(i));
+        }
+        REQUIRE(rb.full());
+        REQUIRE(0 == rb.spare());
+        REQUIRE(! rb.push(100));
+        REQUIRE(! rb.emplace(100));
+        REQUIRE(0 == rb.write(buf, 6));
+        REQUIRE(rb.pop(val));
+        REQUIRE(0 == val);
+
+        // the write is cut to the spare slots
+        REQUIRE(1 == rb.write(buf, 6));
+        REQUIRE(rb.full());
+        REQUIRE(4 == rb.read(out, 6));
+        REQUIRE(1 == out[0]);
+        REQUIRE(3 == out[2]);
+        REQUIRE(1 == out[3]);
+        REQUIRE(rb.empty());
+
+        rb.push(7);
+        rb.clear();
+        REQUIRE(rb.empty());
+        REQUIRE(4 == rb.spare());
+    }
+
+    SECTION("test std::string items") {
+        ug::RingBuffer<std::string, 3> rb;
+        std::string str;
+        std::string buf[3];
+        int next_wr = 0;
+        int next_rd = 0;
+
+        REQUIRE(! rb.is_rbuf_compatible());
+        for (int round = 0; round < 10; round ++) {
+            REQUIRE(rb.push(test_string(next_wr ++)));
+            str = test_string(next_wr ++);
+            REQUIRE(rb.push(str));
+            REQUIRE(rb.emplace(test_string(next_wr ++)));
+            REQUIRE(rb.full());
+            REQUIRE(rb.pop(str));
+            REQUIRE(test_string(next_rd ++) == str);
+            REQUIRE(2 == rb.read(buf, 3));
+            REQUIRE(test_string(next_rd ++) == buf[0]);
+            REQUIRE(test_string(next_rd ++) == buf[1]);
+        }
+        for (int i = 0; i < 3; i ++) {
+            buf[i] = test_string(next_wr ++);
+        }
+        REQUIRE(3 == rb.write(buf, 3));
+        REQUIRE(1 == rb.forward(1));
+        next_rd ++;
+        REQUIRE(rb.pop(str));
+        REQUIRE(test_string(next_rd ++) == str);
+        // one item is left to the destructor
+    }
+
+    SECTION("test construct and destroy of the items") {
+        TrackedItem item;
+        TrackedItem buf[4];
+
+        REQUIRE(5 == g_num_tracked);
+        {
+            ug::RingBuffer<TrackedItem, 4> rb;
+            REQUIRE(5 == g_num_tracked);
+            for (int round = 0; round < 6; round ++) {
+                REQUIRE(rb.emplace(round));
+                REQUIRE(rb.push(TrackedItem(round + 100)));
+                item.m_val = round + 200;
+                REQUIRE(rb.push(item));
+                REQUIRE(8 == g_num_tracked);
+                REQUIRE(rb.pop(item));
+                REQUIRE(round == item.m_val);
+                REQUIRE(1 == rb.forward(1));
+                REQUIRE(6 == g_num_tracked);
+                REQUIRE(1 == rb.read(buf, 4));
+                REQUIRE(round + 200 == buf[0].m_val);
+                REQUIRE(5 == g_num_tracked);
+            }
+            REQUIRE(3 == rb.write(buf, 3));
+            REQUIRE(8 == g_num_tracked);
+        }
+        // the destructor of the ring buffer destroyed the rest of items
+        REQUIRE(5 == g_num_tracked);
+    }
+
+    SECTION("test layout compatible with the RBUF_* macros") {
+        ug::RingBuffer<uint16_t, 10> rb;
+        uint16_t buf[10];
+        uint16_t val;
+
+        if (! rb.is_rbuf_compatible()) {
+            // the statistics block is in the header of the macro version
+            return;
+        }
+        REQUIRE(10 == RBUF_MAX(&rb));
+        REQUIRE(sizeof(uint16_t) == RBUF_ITEM_SIZE(&rb));
+        REQUIRE(RBUF_OCCUPIED_BYTES(10 + 1, sizeof(uint16_t)) <= sizeof(rb));
+
+        // move the positions close to the end, so the data wraps
+        for (int i = 0; i < 8; i ++) {
+            REQUIRE(rb.push(0));
+        }
+        REQUIRE(8 == rb.forward(8));
+
+        // written by template, read by macros
+        for (uint16_t i = 0; i < 6; i ++) {
+            REQUIRE(rb.push(1000 + i));
+        }
+        REQUIRE(6 == RBUF_SIZE(&rb));
+        REQUIRE(4 == RBUF_SPARE(&rb));
+        REQUIRE(2 == RBUF_PEEK(&rb, 4, buf, 10));
+        REQUIRE(1004 == buf[0]);
+        REQUIRE(6 == RBUF_READ(&rb, buf, 10));
+        for (uint16_t i = 0; i < 6; i ++) {
+            REQUIRE(1000 + i == buf[i]);
+        }
+        REQUIRE(rb.empty());
+
+        // written by macros, read by template
+        for (uint16_t i = 0; i < 10; i ++) {
+            buf[i] = 2000 + i;
+        }
+        REQUIRE(10 == RBUF_WRITE(&rb, buf, 10));
+        REQUIRE(rb.full());
+        for (uint16_t i = 0; i < 10; i ++) {
+            REQUIRE(rb.pop(val));
+            REQUIRE(2000 + i == val);
+        }
+        REQUIRE(rb.empty());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ug::RingChannel
+
+typedef struct _chan_test_t {
+    size_t cnt_wr;      // the number of bytes accepted by the channel
+    size_t cnt_rd;      // the number of bytes got by the reader
+    bool flg_wr_end;    // the writer coroutine returned
+    bool flg_rd_end;    // the reader coroutine returned
+    bool flg_rd_error;  // the reader got a byte out of order
+} chan_test_t;
+
+// write the bytes 0, 1, 2, ... in chunks, close the channel after all of them are written
+static ug::Task
+chan_test_writer(ug::RingChannel & ch, size_t total, size_t sz_chunk, chan_test_t * pres)
+{
+    std::vector<uint8_t> buf(sz_chunk);
+    size_t sz;
+    size_t ret;
+
+    while (pres->cnt_wr < total) {
+        sz = UG_MIN(sz_chunk, total - pres->cnt_wr);
+        for (size_t i = 0; i < sz; i ++) {
+            buf[i] = (uint8_t)(pres->cnt_wr + i);
+        }
+        ret = co_await ch.write(std::span<const uint8_t>(buf.data(), sz));
+        pres->cnt_wr += ret;
+        if (ret < sz) {
+            // closed by the reader
+            break;
+        }
+    }
+    if (! ch.closed()) {
+        ch.close();
+    }
+    pres->flg_wr_end = true;
+}
+
+// read and check the bytes until the channel is closed, close it after the first read if flg_close
+static ug::Task
+chan_test_reader(ug::RingChannel & ch, size_t sz_chunk, bool flg_close, chan_test_t * pres)
+{
+    std::vector<uint8_t> buf(sz_chunk);
+    size_t ret;
+
+    while ((ret = co_await ch.read(std::span<uint8_t>(buf.data(), sz_chunk))) > 0) {
+        for (size_t i = 0; i < ret; i ++) {
+            if ((uint8_t)(pres->cnt_rd + i) != buf[i]) {
+                pres->flg_rd_error = true;
+            }
+        }
+        pres->cnt_rd += ret;
+        if (flg_close && ! ch.closed()) {
+            ch.close();
+        }
+    }
+    pres->flg_rd_end = true;
+}
+
+static void
+chan_test_run(size_t capacity, size_t total, size_t sz_wr, size_t sz_rd, bool flg_reader_first, bool flg_close, chan_test_t * pres)
+{
+    ug::Scheduler sched;
+    ug::RingChannel ch(sched, capacity);
+
+    memset(pres, 0, sizeof(*pres));
+    if (! ch.valid()) {
+        return;
+    }
+    if (flg_reader_first) {
+        sched.spawn(chan_test_reader(ch, sz_rd, flg_close, pres));
+        sched.spawn(chan_test_writer(ch, total, sz_wr, pres));
+    } else {
+        sched.spawn(chan_test_writer(ch, total, sz_wr, pres));
+        sched.spawn(chan_test_reader(ch, sz_rd, flg_close, pres));
+    }
+    sched.run();
+}
+
+TEST_CASE( .name="cpp-channel", .description="test ug::RingChannel.", .skip=0 ) {
+    chan_test_t res;
+    int order;
+
+    SECTION("test channel, write larger than the capacity") {
+        for (order = 0; order < 2; order ++) {
+            chan_test_run(16, 1000, 100, 10, order, false, &res);
+            REQUIRE(res.flg_wr_end);
+            REQUIRE(res.flg_rd_end);
+            REQUIRE(1000 == res.cnt_wr);
+            REQUIRE(1000 == res.cnt_rd);
+            REQUIRE(! res.flg_rd_error);
+
+            // the reader asks for more than the capacity
+            chan_test_run(16, 1000, 7, 64, order, false, &res);
+            REQUIRE(res.flg_wr_end);
+            REQUIRE(res.flg_rd_end);
+            REQUIRE(1000 == res.cnt_rd);
+            REQUIRE(! res.flg_rd_error);
+        }
+    }
+
+    SECTION("test channel, capacity 1") {
+        for (order = 0; order < 2; order ++) {
+            chan_test_run(1, 300, 7, 5, order, false, &res);
+            REQUIRE(res.flg_wr_end);
+            REQUIRE(res.flg_rd_end);
+            REQUIRE(300 == res.cnt_wr);
+            REQUIRE(300 == res.cnt_rd);
+            REQUIRE(! res.flg_rd_error);
+        }
+    }
+
+    SECTION("test channel, close with a pending writer") {
+        for (order = 0; order < 2; order ++) {
+            // the writer is waiting for space when the reader closes the channel
+            chan_test_run(16, 1000, 100, 10, order, true, &res);
+            REQUIRE(res.flg_wr_end);
+            REQUIRE(res.flg_rd_end);
+            REQUIRE(res.cnt_wr > 16);
+            REQUIRE(res.cnt_wr < 100);
+            // the data left in the ring buffer is still delivered
+            REQUIRE(res.cnt_wr == res.cnt_rd);
+            REQUIRE(! res.flg_rd_error);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ug::RingStreamBuf
+
+// the number of segments of the data in the ring buffer, and the size of the first one
+static int
+stream_test_segments(ring_buffer_t * prb, size_t * len1)
+{
+    struct iovec iov[2];
+    int ret;
+
+    *len1 = 0;
+    ret = rbuf_peek_iov(prb, 0, rbuf_size(prb), iov);
+    if (ret > 0) {
+        *len1 = iov[0].iov_len;
+    }
+    return ret;
+}
+
+TEST_CASE( .name="cpp-stream", .description="test ug::RingStreamBuf.", .skip=0 ) {
+    ring_buffer_t * prb;
+    char buf[32];
+    size_t len1;
+
+    SECTION("test stream buffer, put area wraps at the end of buffer") {
+        prb = rbuf_create(16);
+        REQUIRE(NULL != prb);
+        {
+            ug::RingStreamBuf sb(prb);
+            std::ostream os(&sb);
+            std::istream is(&sb);
+
+            // move the positions close to the end of the buffer
+            os << "0123456789";
+            os.flush();
+            REQUIRE(10 == rbuf_size(prb));
+            REQUIRE(is.read(buf, 10));
+            REQUIRE(0 == memcmp(buf, "0123456789", 10));
+            sb.pubsync();
+            REQUIRE(0 == rbuf_size(prb));
+
+            // the put area is refilled at the start of the buffer
+            os << "abcdefghijkl";
+            os.flush();
+            REQUIRE(os.good());
+            REQUIRE(12 == rbuf_size(prb));
+            REQUIRE(2 == stream_test_segments(prb, &len1));
+            REQUIRE(len1 < 12);
+
+            // the get area is one segment, the rest is counted by showmanyc()
+            REQUIRE(12 == sb.in_avail());
+            REQUIRE(is.read(buf, len1));
+            REQUIRE((std::streamsize)(12 - len1) == sb.in_avail());
+            REQUIRE(is.read(buf + len1, 12 - len1));
+            REQUIRE(0 == memcmp(buf, "abcdefghijkl", 12));
+            REQUIRE(0 == sb.in_avail());
+            sb.pubsync();
+            REQUIRE(0 == rbuf_size(prb));
+        }
+        rbuf_destroy(prb);
+    }
+
+    SECTION("test stream buffer, token split across the wrap") {
+        prb = rbuf_create(16);
+        REQUIRE(NULL != prb);
+        {
+            ug::RingStreamBuf sb(prb);
+            std::ostream os(&sb);
+            std::istream is(&sb);
+            int val = 0;
+            std::string str;
+
+            for (int round = 0; round < 20; round ++) {
+                os << round * 1000 + 123 << ' ' << "tok" << round << '\n';
+                os.flush();
+                REQUIRE(os.good());
+                REQUIRE(is >> val >> str);
+                REQUIRE(round * 1000 + 123 == val);
+                REQUIRE("tok" + std::to_string(round) == str);
+                is.ignore(1);
+                sb.pubsync();
+                REQUIRE(0 == rbuf_size(prb));
+            }
+
+            // the number is split by the end of the buffer
+            os << "0123456789012";
+            os.flush();
+            REQUIRE(is.read(buf, 13));
+            sb.pubsync();
+            os << 987654 << " x\n";
+            os.flush();
+            REQUIRE(2 == stream_test_segments(prb, &len1));
+            REQUIRE(len1 > 0);
+            REQUIRE(len1 < 6);
+            REQUIRE(is >> val >> str);
+            REQUIRE(987654 == val);
+            REQUIRE("x" == str);
+        }
+        rbuf_destroy(prb);
+    }
+
+    SECTION("test stream buffer, ring buffer is full") {
+        prb = rbuf_create(8);
+        REQUIRE(NULL != prb);
+        {
+            ug::RingStreamBuf sb(prb);
+            std::ostream os(&sb);
+            std::istream is(&sb);
+
+            os << "0123456789";
+            REQUIRE(os.bad());
+            // the bytes before the ring buffer is full are kept
+            REQUIRE(8 == rbuf_size(prb));
+            REQUIRE(8 == sb.in_avail());
+            REQUIRE(is.read(buf, 8));
+            REQUIRE(0 == memcmp(buf, "01234567", 8));
+            REQUIRE(! is.read(buf, 1));
+            REQUIRE(0 == is.gcount());
+
+            // go on after the space is released
+            is.clear();
+            sb.pubsync();
+            os.clear();
+            os << "89";
+            os.flush();
+            REQUIRE(os.good());
+            REQUIRE(is.read(buf, 2));
+            REQUIRE(0 == memcmp(buf, "89", 2));
+        }
+        rbuf_destroy(prb);
+    }
+}
+
+int main(int argc, const char * argv[]) { return ciut_main(argc, argv); }